@@ -0,0 +1,225 @@
+// Measures the throughput of GpuPrimitives operations in elements per second,
+// with GPU timestamps around every operation. Needs a Vulkan 1.3 device.
+// Usage: etna_gpu_primitives_bench [iterations]
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/GpuPrimitives.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/BlockingTransferHelper.hpp>
+
+
+static constexpr std::array<std::uint32_t, 4> SIZES{1 << 14, 1 << 18, 1 << 22, 1 << 24};
+static constexpr std::uint32_t MAX_ELEMENTS = SIZES.back();
+static constexpr std::uint32_t WARMUP_ITERATIONS = 3;
+
+static void global_barrier(vk::CommandBuffer cmd_buf)
+{
+  // Iterations are measured one after another, not overlapped
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+  };
+  cmd_buf.pipelineBarrier2(
+    vk::DependencyInfo{.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+}
+
+class Timer
+{
+public:
+  explicit Timer(etna::OneShotCmdMgr& cmd_mgr)
+    : cmdMgr{cmd_mgr}
+    , device{etna::get_context().getDevice()}
+    , nanosecondsPerTick{etna::get_context()
+                           .getPhysicalDevice()
+                           .getProperties()
+                           .limits.timestampPeriod}
+    , queryPool{etna::unwrap_vk_result(device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+        .queryType = vk::QueryType::eTimestamp,
+        .queryCount = 2,
+      }))}
+  {
+  }
+
+  // Seconds the GPU spent on the commands recorded by measured, the commands recorded
+  // by prepare, e.g. restoring the inputs of in-place operations, aren't measured.
+  double measure(
+    const std::function<void(vk::CommandBuffer)>& prepare,
+    const std::function<void(vk::CommandBuffer)>& measured)
+  {
+    // Every measurement is a frame of its own, so the descriptor pools get recycled
+    etna::begin_frame();
+    auto cmdBuf = cmdMgr.start();
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    cmdBuf.resetQueryPool(queryPool.get(), 0, 2);
+    global_barrier(cmdBuf);
+    prepare(cmdBuf);
+    global_barrier(cmdBuf);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 0);
+    measured(cmdBuf);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 1);
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+    cmdMgr.submitAndWait(cmdBuf);
+    etna::end_frame();
+
+    std::array<std::uint64_t, 2> ticks{};
+    ETNA_CHECK_VK_RESULT(device.getQueryPoolResults(
+      queryPool.get(),
+      0,
+      2,
+      sizeof(ticks),
+      ticks.data(),
+      sizeof(std::uint64_t),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+    return static_cast<double>(ticks[1] - ticks[0]) * nanosecondsPerTick * 1e-9;
+  }
+
+private:
+  etna::OneShotCmdMgr& cmdMgr;
+  vk::Device device;
+  double nanosecondsPerTick;
+  vk::UniqueQueryPool queryPool;
+};
+
+static etna::Buffer create_buffer(std::uint32_t count, std::string_view name)
+{
+  return etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * std::max(count, 1u),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+      vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+    .name = name,
+  });
+}
+
+static void copy_buffer(
+  vk::CommandBuffer cmd_buf, const etna::Buffer& src, const etna::Buffer& dst, std::uint32_t count)
+{
+  vk::BufferCopy2 region{.size = sizeof(std::uint32_t) * count};
+  cmd_buf.copyBuffer2(vk::CopyBufferInfo2{
+    .srcBuffer = src.get(),
+    .dstBuffer = dst.get(),
+    .regionCount = 1,
+    .pRegions = &region,
+  });
+}
+
+static void report(
+  std::string_view operation,
+  std::string_view variant,
+  std::uint32_t count,
+  std::vector<double>& seconds)
+{
+  std::sort(seconds.begin(), seconds.end());
+  const double median = seconds[seconds.size() / 2];
+  spdlog::info(
+    "{:<14} {:<13} {:>9} elements: {:8.3f} ms, {:7.2f} Gelements/s",
+    operation,
+    variant,
+    count,
+    median * 1e3,
+    count / median * 1e-9);
+}
+
+int main(int argc, char** argv)
+{
+  const std::uint32_t iterations = argc > 1 ? static_cast<std::uint32_t>(std::atoi(argv[1])) : 20;
+  if (iterations == 0)
+  {
+    spdlog::error("Usage: {} [iterations]", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  etna::initialize(etna::InitParams{
+    .applicationName = "etna_gpu_primitives_bench",
+    .applicationVersion = vk::makeApiVersion(0, 0, 1, 0),
+    .profile = etna::ContextProfile::eComputeOnly,
+  });
+
+  {
+    auto cmdMgr = etna::get_context().createOneShotCmdMgr();
+    Timer timer{*cmdMgr};
+
+    // Inputs are random, as the performance of the sort depends on the distribution of keys
+    std::mt19937 rng{20240229};
+    std::vector<std::uint32_t> values(MAX_ELEMENTS);
+    std::generate(values.begin(), values.end(), [&rng]() { return rng(); });
+    std::vector<std::uint32_t> flags(MAX_ELEMENTS);
+    std::generate(flags.begin(), flags.end(), [&rng]() { return rng() & 1; });
+
+    auto input = create_buffer(MAX_ELEMENTS, "bench_input");
+    auto inputFlags = create_buffer(MAX_ELEMENTS, "bench_flags");
+    {
+      etna::BlockingTransferHelper transfer{{.stagingSize = 16 << 20}};
+      transfer.uploadBuffer(*cmdMgr, input, 0, std::span<const std::uint32_t>{values});
+      transfer.uploadBuffer(*cmdMgr, inputFlags, 0, std::span<const std::uint32_t>{flags});
+    }
+    auto keys = create_buffer(MAX_ELEMENTS, "bench_keys");
+    auto output = create_buffer(MAX_ELEMENTS, "bench_output");
+    auto result = create_buffer(1, "bench_result");
+
+    for (bool disableSubgroups : {false, true})
+    {
+      etna::GpuPrimitives primitives{{
+        .maxElements = MAX_ELEMENTS,
+        .disableSubgroups = disableSubgroups,
+      }};
+      if (!disableSubgroups && !primitives.usesSubgroups())
+        continue;
+      const std::string_view variant = disableSubgroups ? "shared memory" : "subgroups";
+
+      const auto nothing = [](vk::CommandBuffer) {};
+      const auto run = [&](std::string_view operation,
+                         std::uint32_t count,
+                         const std::function<void(vk::CommandBuffer)>& prepare,
+                         const std::function<void(vk::CommandBuffer)>& measured) {
+        std::vector<double> seconds;
+        for (std::uint32_t i = 0; i < WARMUP_ITERATIONS + iterations; ++i)
+        {
+          const double time = timer.measure(prepare, measured);
+          if (i >= WARMUP_ITERATIONS)
+            seconds.push_back(time);
+        }
+        report(operation, variant, count, seconds);
+      };
+
+      for (std::uint32_t count : SIZES)
+      {
+        run("exclusiveScan", count, nothing, [&](vk::CommandBuffer cmd_buf) {
+          primitives.exclusiveScan(cmd_buf, input, output, count);
+        });
+        run("reduce(eAdd)", count, nothing, [&](vk::CommandBuffer cmd_buf) {
+          primitives.reduce(cmd_buf, input, result, count, etna::ReduceOp::eAdd);
+        });
+        run("compact", count, nothing, [&](vk::CommandBuffer cmd_buf) {
+          primitives.compact(cmd_buf, input, inputFlags, output, result, count);
+        });
+        run(
+          "sortPairs",
+          count,
+          [&](vk::CommandBuffer cmd_buf) {
+            copy_buffer(cmd_buf, input, keys, count);
+            copy_buffer(cmd_buf, input, output, count);
+          },
+          [&](vk::CommandBuffer cmd_buf) {
+            primitives.sortPairs(cmd_buf, keys, output, count);
+          });
+      }
+    }
+  }
+
+  etna::shutdown();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+// Measures the bandwidth of StagingCopier across part sizes and thread counts,
+// which the defaults in StagingCopier.hpp and StagingCopier.cpp are based on.
+// Copies go into a mapped staging buffer, like the ones of BlockingTransferHelper,
+// or into plain memory with --host, which doesn't need a Vulkan device.
+// Usage: etna_staging_copier_bench [--host]
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include "StagingCopier.hpp"
+
+
+static constexpr std::array<std::size_t, 3> COPY_SIZES{
+  std::size_t{4} << 20, std::size_t{32} << 20, std::size_t{256} << 20};
+static constexpr std::array<std::size_t, 5> PART_SIZES{
+  std::size_t{64} << 10,
+  std::size_t{256} << 10,
+  std::size_t{1} << 20,
+  std::size_t{4} << 20,
+  std::size_t{16} << 20};
+static constexpr std::size_t ITERATIONS = 10;
+
+static std::vector<std::size_t> get_thread_counts()
+{
+  const std::size_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<std::size_t> result;
+  for (std::size_t count = 1; count < hardwareThreads; count *= 2)
+    result.push_back(count);
+  result.push_back(hardwareThreads);
+  return result;
+}
+
+// Median bandwidth in GiB/s
+static double measure(
+  etna::StagingCopier& copier, std::span<std::byte> dst, std::span<const std::byte> src)
+{
+  // Starts the workers and faults the pages in
+  copier.copy(dst.data(), src.data(), src.size());
+
+  std::array<double, ITERATIONS> bandwidths{};
+  for (auto& bandwidth : bandwidths)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    copier.copy(dst.data(), src.data(), src.size());
+    const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    bandwidth = static_cast<double>(src.size()) / seconds.count() / (1 << 30);
+  }
+  std::sort(bandwidths.begin(), bandwidths.end());
+  return bandwidths[ITERATIONS / 2];
+}
+
+static void run(std::span<std::byte> dst)
+{
+  std::vector<std::byte> src(COPY_SIZES.back());
+  for (std::size_t i = 0; i < src.size(); ++i)
+    src[i] = static_cast<std::byte>(i * 2654435761u >> 24);
+
+  for (std::size_t copySize : COPY_SIZES)
+    for (std::size_t threadCount : get_thread_counts())
+      for (std::size_t partSize : PART_SIZES)
+      {
+        // Skips splits that leave some of the threads idle
+        if (threadCount > 1 && partSize * threadCount > copySize)
+          continue;
+        if (threadCount == 1 && partSize != PART_SIZES.front())
+          continue;
+        etna::StagingCopier copier{threadCount, partSize};
+        const double bandwidth =
+          measure(copier, dst.first(copySize), std::span{src}.first(copySize));
+        spdlog::info(
+          "{:>4} MiB, {:>2} threads, {:>5} KiB min part size: {:6.2f} GiB/s",
+          copySize >> 20,
+          threadCount,
+          partSize >> 10,
+          bandwidth);
+      }
+}
+
+int main(int argc, char** argv)
+{
+  const bool host = argc > 1 && std::string_view{argv[1]} == "--host";
+  if (argc > 2 || (argc == 2 && !host))
+  {
+    spdlog::error("Usage: {} [--host]", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (host)
+  {
+    std::vector<std::byte> dst(COPY_SIZES.back());
+    run(dst);
+    return EXIT_SUCCESS;
+  }
+
+  etna::initialize(etna::InitParams{
+    .applicationName = "etna_staging_copier_bench",
+    .applicationVersion = vk::makeApiVersion(0, 0, 1, 0),
+    .profile = etna::ContextProfile::eComputeOnly,
+  });
+  {
+    auto staging = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = COPY_SIZES.back(),
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+      .allocationCreate =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .name = "bench_staging",
+    });
+    run(std::span{staging.map(), COPY_SIZES.back()});
+    staging.unmap();
+  }
+  etna::shutdown();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+# Turns a SPIR-V binary into a C++ source with the words of the module as an array.
+# Usage: cmake -DINPUT=shader.spv -DOUTPUT=shader.spv.cpp -DSYMBOL=name -P EmbedSpirv.cmake
+
+file(READ ${INPUT} SPIRV_HEX HEX)
+string(LENGTH "${SPIRV_HEX}" SPIRV_HEX_LENGTH)
+math(EXPR SPIRV_WORD_REMAINDER "${SPIRV_HEX_LENGTH} % 8")
+if (SPIRV_HEX_LENGTH EQUAL 0 OR NOT SPIRV_WORD_REMAINDER EQUAL 0)
+  message(FATAL_ERROR "${INPUT} is not a valid SPIR-V module")
+endif()
+
+# glslc writes words in the byte order of the host, which is little endian
+# on every platform etna supports, so bytes are reversed within every word.
+string(REGEX REPLACE
+  "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])"
+  "0x\\4\\3\\2\\1u,\n" SPIRV_WORDS "${SPIRV_HEX}")
+
+file(WRITE ${OUTPUT}
+  "// Generated from ${INPUT}, do not edit\n"
+  "#include <cstddef>\n"
+  "#include <cstdint>\n"
+  "#include <iterator>\n"
+  "\n"
+  "namespace etna\n"
+  "{\n"
+  "\n"
+  "extern const std::uint32_t ${SYMBOL}[] = {\n"
+  "${SPIRV_WORDS}"
+  "};\n"
+  "extern const std::size_t ${SYMBOL}_size = std::size(${SYMBOL});\n"
+  "\n"
+  "} // namespace etna\n")
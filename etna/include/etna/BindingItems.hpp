@@ -2,6 +2,11 @@
 #ifndef ETNA_BINDING_ITEMS_HPP_INCLUDED
 #define ETNA_BINDING_ITEMS_HPP_INCLUDED
 
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
 #include <etna/Vulkan.hpp>
 
 
@@ -23,6 +28,22 @@ struct ImageBinding
   vk::DescriptorImageInfo descriptor_info;
 };
 
+// Contents of an inline uniform block, see ShaderProgramLayoutOptions::inlineUniformBlocks
+struct InlineBinding
+{
+  std::vector<std::byte> bytes;
+};
+
+// Makes an InlineBinding out of a struct mirroring the uniform block
+template <class T>
+InlineBinding make_inline_binding(const T& value)
+{
+  static_assert(std::is_trivially_copyable_v<T>, "Inline uniform blocks are copied bytewise!");
+  InlineBinding result{std::vector<std::byte>(sizeof(T))};
+  std::memcpy(result.bytes.data(), &value, sizeof(T));
+  return result;
+}
+
 } // namespace etna
 
 #endif // ETNA_BINDING_ITEMS_HPP_INCLUDED
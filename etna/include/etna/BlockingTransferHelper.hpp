@@ -2,16 +2,22 @@
 #ifndef ETNA_BLOCKING_TRANSFER_HELPER_HPP_INCLUDED
 #define ETNA_BLOCKING_TRANSFER_HELPER_HPP_INCLUDED
 
+#include <memory>
+#include <optional>
 #include <type_traits>
 
 #include <etna/Vulkan.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/OneShotCmdMgr.hpp>
+#include <etna/PixelConversion.hpp>
 
 
 namespace etna
 {
 
+class StagingCopier;
+class MappedTexture;
+
 /**
  * Simplest possible GPU-CPU data transfer helper:
  * blocks CPU until the transfer operation finishes.
@@ -25,9 +31,14 @@ public:
   struct CreateInfo
   {
     vk::DeviceSize stagingSize;
+
+    // Threads copying large uploads into the staging buffer, including the calling one.
+    // 0 shares the threads of the context, whose count is based on the CPU.
+    std::size_t copyThreadCount = 0;
   };
 
   explicit BlockingTransferHelper(CreateInfo info);
+  ~BlockingTransferHelper();
 
   BlockingTransferHelper(const BlockingTransferHelper&) = delete;
   BlockingTransferHelper& operator=(const BlockingTransferHelper&) = delete;
@@ -69,9 +80,35 @@ public:
     uint32_t layer,
     std::span<std::byte const> src);
 
+  // Same as above, but src consists of pixels of the given layout, which are converted
+  // into the format of the image while being written into the staging buffer.
+  // See can_convert_pixels for the supported image formats.
+  void uploadImage(
+    OneShotCmdMgr& cmd_mgr,
+    Image& dst,
+    uint32_t mip_level,
+    uint32_t layer,
+    std::span<std::byte const> src,
+    PixelSource source);
+
+  // Uploads all subresources of a texture loaded from a TextureCache, the image
+  // must have the same format and extent and at least as many mips and layers.
+  void uploadImage(OneShotCmdMgr& cmd_mgr, Image& dst, const MappedTexture& texture);
+
 private:
+  void uploadImageRows(
+    OneShotCmdMgr& cmd_mgr,
+    Image& dst,
+    uint32_t mip_level,
+    uint32_t layer,
+    std::span<std::byte const> src,
+    std::optional<PixelSource> source);
+
   vk::DeviceSize stagingSize;
   Buffer stagingBuffer;
+  // Only set when the helper doesn't use the copier of the context
+  std::unique_ptr<StagingCopier> ownCopier;
+  StagingCopier* copier;
 };
 
 } // namespace etna
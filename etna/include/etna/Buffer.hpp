@@ -6,12 +6,15 @@
 
 #include <etna/Vulkan.hpp>
 #include <etna/BindingItems.hpp>
+#include <etna/GpuPtr.hpp>
 #include <vk_mem_alloc.h>
 
 
 namespace etna
 {
 
+class GlobalContext;
+
 class Buffer
 {
 public:
@@ -24,6 +27,7 @@ public:
     vk::DeviceSize size;
 
     // How will this buffer be used?
+    // Add eShaderDeviceAddress to be able to use getDeviceAddress.
     vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer;
 
     // Basically determines the memory type this buffer will live in.
@@ -57,6 +61,17 @@ public:
 
   BufferBinding genBinding(vk::DeviceSize offset = 0, vk::DeviceSize range = vk::WholeSize) const;
 
+  // Address of the buffer for shaders to access it without descriptors.
+  // The buffer must have been created with the eShaderDeviceAddress usage.
+  vk::DeviceAddress getDeviceAddress() const;
+
+  // Typed version of getDeviceAddress, offset is in bytes
+  template <class T>
+  GpuPtr<T> getGpuPtr(vk::DeviceSize offset = 0) const
+  {
+    return GpuPtr<T>{getDeviceAddress() + offset};
+  }
+
   // If the buffer is in CPU_TO_GPU or GPU_TO_CPU memory, returns a CPU-accessible
   // pointer to the start of this buffer's bytes, which can be used for reading or
   // writing the buffer (preferably in a linear manner).
@@ -65,15 +80,22 @@ public:
   // Invalidates the pointer returned by map.
   void unmap();
 
+  // Makes writes of the GPU visible to the CPU through the mapping, which is needed
+  // for memory that isn't host coherent, e.g. with HOST_ACCESS_RANDOM_BIT.
+  void invalidate(vk::DeviceSize offset = 0, vk::DeviceSize size = vk::WholeSize);
+
   ~Buffer();
   void reset();
 
 private:
+  // Its resource tracker has to forget the buffer once it is destroyed
+  GlobalContext* context{};
   VmaAllocator allocator{};
 
   VmaAllocation allocation{};
   vk::Buffer buffer{};
   std::byte* mapped{};
+  vk::DeviceAddress deviceAddress{};
 };
 
 } // namespace etna
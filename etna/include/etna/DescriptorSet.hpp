@@ -2,6 +2,10 @@
 #ifndef ETNA_DESCRIPTOR_SET_HPP_INCLUDED
 #define ETNA_DESCRIPTOR_SET_HPP_INCLUDED
 
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -40,11 +44,19 @@ struct Binding
     , resources{std::vector<BufferBinding>{buffer_info}}
   {
   }
+  // For inline uniform blocks, the offset and the size are in bytes
+  Binding(uint32_t rbinding, InlineBinding inline_data, uint32_t byte_offset = 0)
+    : binding{rbinding}
+    , arrayElem{byte_offset}
+    , size(static_cast<uint32_t>(inline_data.bytes.size()))
+    , resources{std::move(inline_data)}
+  {
+  }
 
   uint32_t binding;
   uint32_t arrayElem;
   uint32_t size;
-  std::variant<std::vector<ImageBinding>, std::vector<BufferBinding>> resources;
+  std::variant<std::vector<ImageBinding>, std::vector<BufferBinding>, InlineBinding> resources;
 };
 
 /*Maybe we need a hierarchy of descriptor sets*/
@@ -88,6 +100,11 @@ private:
   vk::DescriptorSet set{};
   std::vector<Binding> bindings{};
   vk::CommandBuffer command_buffer;
+  // Batches of the context the set was allocated in
+  const GpuWorkCount* workCount = nullptr;
+
+  friend struct DynamicDescriptorPool;
+  friend struct RecordingDescriptorPool;
 };
 
 /**
@@ -95,12 +112,16 @@ private:
  * destroyed automaticaly. Resource allocation tracking shoud be added. For long-living descriptor
  * sets (e.g bindless resource sets) separate allocator shoud be added, with ManagedDescriptorSet
  * with destructor
+ *
+ * Every thread allocates from its own pools, one per frame in flight, so sets can be
+ * allocated from several threads at once. A pool is reset by the first allocation
+ * of its thread in a new frame, when the GPU is done with the sets it had.
  */
 struct DynamicDescriptorPool
 {
-  DynamicDescriptorPool(vk::Device dev, const GpuWorkCount& work_count);
+  DynamicDescriptorPool(
+    vk::Device dev, const GpuWorkCount& work_count, bool inline_uniform_blocks = false);
 
-  void beginFrame();
   void destroyAllocatedSets();
   void reset(uint32_t frames_in_flight);
 
@@ -116,11 +137,51 @@ struct DynamicDescriptorPool
       set.getGen() + workCount.multiBufferingCount() > workCount.batchIndex();
   }
 
+private:
+  struct FramePool
+  {
+    vk::UniqueDescriptorPool pool;
+    std::uint64_t lastBatch = 0;
+  };
+  using ThreadPools = GpuSharedResource<FramePool>;
+
+  ThreadPools& getThreadPools();
+
+  vk::Device vkDevice;
+  const GpuWorkCount& workCount;
+  bool inlineUniformBlocks;
+  // Distinguishes pools in the caches of threads, never reused
+  std::uint64_t instanceId;
+
+  std::mutex mutex;
+  std::unordered_map<std::thread::id, std::unique_ptr<ThreadPools>> threadPools;
+};
+
+/**
+ * Sets that are only freed all at once, together with the pool, e.g. the sets of a
+ * StaticCommandBuffer recording. Such recordings use a handful of sets, so the pool
+ * starts out small and adds bigger pools only when the previous one runs out.
+ * Must only be used by one thread at a time.
+ */
+struct RecordingDescriptorPool
+{
+  RecordingDescriptorPool(
+    vk::Device dev, const GpuWorkCount& work_count, bool inline_uniform_blocks = false);
+
+  DescriptorSet allocateSet(
+    DescriptorLayoutId layout_id,
+    std::vector<Binding> bindings,
+    vk::CommandBuffer command_buffer,
+    BarrierBehavoir behavoir = BarrierBehavoir::eDefault);
+
 private:
   vk::Device vkDevice;
   const GpuWorkCount& workCount;
+  bool inlineUniformBlocks;
 
-  GpuSharedResource<vk::UniqueDescriptorPool> pools;
+  std::vector<vk::UniqueDescriptorPool> pools;
+  // Sets fitting into the last pool
+  std::uint32_t poolCapacity = 0;
 };
 
 void write_set(const DescriptorSet& dst);
@@ -4,10 +4,12 @@
 
 #include <array>
 #include <bitset>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
 
 #include <etna/Vulkan.hpp>
+#include <etna/detail/RcuCell.hpp>
 
 
 struct SpvReflectDescriptorSet;
@@ -27,6 +29,14 @@ struct DescriptorSetInfo
   void addResource(const vk::DescriptorSetLayoutBinding& binding);
   void merge(const DescriptorSetInfo& info);
 
+  // Bakes `sampler` into the layout for every array element of `binding`,
+  // which has to be a sampler or a combined image sampler binding.
+  void setImmutableSampler(uint32_t binding, vk::Sampler sampler);
+
+  // Turns the uniform buffer `binding` into an inline uniform block of the size
+  // of the block declared in the shader, so its contents live in the set itself.
+  void setInlineUniformBlock(uint32_t binding);
+
   bool operator==(const DescriptorSetInfo& rhs) const;
 
   vk::DescriptorSetLayout createVkLayout(vk::Device device) const;
@@ -44,12 +54,28 @@ struct DescriptorSetInfo
     return bindings.at(binding);
   }
 
+  bool hasImmutableSampler(uint32_t binding) const
+  {
+    return isBindingUsed(binding) && immutableSamplers[binding];
+  }
+
+  vk::Sampler getImmutableSampler(uint32_t binding) const
+  {
+    ETNA_VERIFY(isBindingUsed(binding));
+    return immutableSamplers.at(binding);
+  }
+
 private:
   uint32_t maxUsedBinding = 0;
   uint32_t dynOffsets = 0;
 
   std::bitset<MAX_DESCRIPTOR_BINDINGS> usedBindings{};
   std::array<vk::DescriptorSetLayoutBinding, MAX_DESCRIPTOR_BINDINGS> bindings{};
+  // Kept separately from bindings, as pImmutableSamplers has to point to an array
+  // of descriptorCount samplers which only exists while the layout is being created.
+  std::array<vk::Sampler, MAX_DESCRIPTOR_BINDINGS> immutableSamplers{};
+  // Sizes of uniform blocks as declared in shaders, used for inline uniform blocks
+  std::array<uint32_t, MAX_DESCRIPTOR_BINDINGS> uniformBlockSizes{};
 
   friend DescriptorSetLayoutHash;
 };
@@ -61,6 +87,7 @@ struct DescriptorSetLayoutHash
 
 using DescriptorLayoutId = uint32_t;
 
+// Layouts are looked up lock-free from any thread, registration takes a lock
 struct DescriptorSetLayoutCache
 {
   DescriptorSetLayoutCache() {}
@@ -71,10 +98,18 @@ struct DescriptorSetLayoutCache
 
   DescriptorLayoutId registerLayout(vk::Device device, const DescriptorSetInfo& info);
   void clear(vk::Device device);
+  // Frees the snapshots replaced long enough ago, called by begin_frame
+  void collectRetiredSnapshots();
 
-  const DescriptorSetInfo& getLayoutInfo(DescriptorLayoutId id) const { return descriptors.at(id); }
+  const DescriptorSetInfo& getLayoutInfo(DescriptorLayoutId id) const
+  {
+    return *snapshot.read()->infos.at(id);
+  }
 
-  vk::DescriptorSetLayout getVkLayout(DescriptorLayoutId id) const { return vkLayouts.at(id); }
+  vk::DescriptorSetLayout getVkLayout(DescriptorLayoutId id) const
+  {
+    return snapshot.read()->vkLayouts.at(id);
+  }
 
   std::pair<DescriptorLayoutId, vk::DescriptorSetLayout> get(
     vk::Device device, const DescriptorSetInfo& info);
@@ -83,9 +118,16 @@ struct DescriptorSetLayoutCache
   DescriptorSetLayoutCache& operator=(const DescriptorSetLayoutCache&) = delete;
 
 private:
+  struct Snapshot
+  {
+    // Point to the keys of map, which never move
+    std::vector<const DescriptorSetInfo*> infos;
+    std::vector<vk::DescriptorSetLayout> vkLayouts;
+  };
+
+  std::mutex mutex;
   std::unordered_map<DescriptorSetInfo, DescriptorLayoutId, DescriptorSetLayoutHash> map;
-  std::vector<DescriptorSetInfo> descriptors;
-  std::vector<vk::DescriptorSetLayout> vkLayouts;
+  detail::RcuCell<Snapshot> snapshot;
 };
 
 } // namespace etna
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef ETNA_DOWNSAMPLER_HPP_INCLUDED
+#define ETNA_DOWNSAMPLER_HPP_INCLUDED
+
+#include <cstdint>
+#include <unordered_map>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <etna/ComputePipeline.hpp>
+
+
+namespace etna
+{
+
+// How 2x2 blocks of texels are combined into a texel of the next mip
+enum class DownsampleReduction : std::uint32_t
+{
+  // Regular mips, bloom chains
+  eAverage,
+  // Depth pyramids for reversed depth
+  eMin,
+  // Depth pyramids for hi-Z occlusion culling, see GpuCulling
+  eMax,
+};
+
+/**
+ * Builds mip chains with a single compute dispatch instead of a blit and a barrier
+ * per mip, which keeps the GPU busy even when processing tiny mips.
+ * Supports up to 12 mips of images up to 4096x4096 in size. Destination images
+ * must be created with the storage usage and be of one of the following formats:
+ * R32Sfloat, R16G16B16A16Sfloat, B10G11R11UfloatPack32 or R8G8B8A8Unorm.
+ * NOTE: for odd sizes, the last row/column of a mip doesn't contribute to the next one,
+ * just like with blits. Averaging doesn't account for sRGB.
+ */
+class Downsampler
+{
+public:
+  Downsampler();
+
+  Downsampler(const Downsampler&) = delete;
+  Downsampler& operator=(const Downsampler&) = delete;
+  Downsampler(Downsampler&&) = delete;
+  Downsampler& operator=(Downsampler&&) = delete;
+
+  // Fills mips 1 and further of the image out of mip 0.
+  // The image is left in the general layout.
+  void generateMips(
+    vk::CommandBuffer cmd_buf,
+    const Image& image,
+    DownsampleReduction reduction = DownsampleReduction::eAverage);
+
+  // Fills all mips of dst out of mip 0 of src, mip 0 of dst being half as big as src.
+  // This allows src to be a depth buffer, which can't be used as a storage image.
+  // src is left in the shader read only layout and dst in the general one.
+  void downsample(
+    vk::CommandBuffer cmd_buf,
+    const Image& src,
+    const Image& dst,
+    DownsampleReduction reduction = DownsampleReduction::eAverage);
+
+private:
+  const ComputePipeline& getPipeline(vk::Format format);
+
+  void dispatch(
+    vk::CommandBuffer cmd_buf,
+    const Image& src,
+    vk::ImageLayout src_layout,
+    const Image& dst,
+    std::uint32_t first_dst_mip,
+    DownsampleReduction reduction);
+
+  Sampler sampler;
+  Buffer counter;
+  bool counterInitialized = false;
+  std::unordered_map<vk::Format, ComputePipeline> pipelines;
+};
+
+} // namespace etna
+
+#endif // ETNA_DOWNSAMPLER_HPP_INCLUDED
@@ -2,6 +2,7 @@
 #ifndef ETNA_ETNA_HPP_INCLUDED
 #define ETNA_ETNA_HPP_INCLUDED
 
+#include <memory>
 #include <optional>
 #include <vector>
 #include <span>
@@ -21,6 +22,16 @@ enum class ValidationLevel : uint32_t
   eExtensive
 };
 
+enum class ContextProfile : uint32_t
+{
+  // A single queue for graphics, compute and transfer work
+  eUniversal,
+  // Compute and transfer work only, e.g. for headless batch processing. Queue families
+  // without graphics support are accepted and preferred, graphics features and the GPU
+  // profiler are not initialized, and windows and graphics pipelines can't be created.
+  eComputeOnly,
+};
+
 struct InitParams
 {
   /// Can be anything
@@ -43,12 +54,27 @@ struct InitParams
 
   /// Whether things like createDescriptorSet or renderTarget should auto-create barriers
   bool generateBarriersAutomatically = true;
+
+  ContextProfile profile = ContextProfile::eUniversal;
+
+  /// Amount of queues created with ContextProfile::eComputeOnly, clamped to what the
+  /// device supports, see GlobalContext::getComputeQueue
+  uint32_t computeQueueCount = 1;
 };
 
+// Manage the default context, which is used unless a ContextScope says otherwise
 bool is_initilized();
 void initialize(const InitParams& params);
 void shutdown();
 
+/**
+ * Creates a context in addition to the default one, e.g. to render on several
+ * devices at once. Use ContextScope to make etna calls of a thread use it.
+ * NOTE: contexts should be created and destroyed while no other thread is
+ * using etna, as that reloads the global Vulkan-Hpp dispatcher.
+ */
+std::unique_ptr<GlobalContext> create_context(const InitParams& params);
+
 void begin_frame();
 void end_frame();
 
@@ -58,10 +84,14 @@ void end_frame();
  *
  * \param name The name to give this shader program.
  * \param shaders_path Paths to shaders to use in this program.
+ * \param layout_options Layout details that can't be deduced from the shaders,
+ * e.g. immutable samplers.
  * \return ID of the newly created shader program.
  */
 ShaderProgramId create_program(
-  const char* name, std::initializer_list<std::filesystem::path> shaders_path);
+  const char* name,
+  std::initializer_list<std::filesystem::path> shaders_path,
+  ShaderProgramLayoutOptions layout_options = {});
 
 ShaderProgramId get_program_id(const char* name);
 
@@ -122,6 +152,23 @@ void set_state(
   vk::ImageAspectFlags aspect_flags,
   ForceSetState force = ForceSetState::eFalse);
 
+/**
+ * \brief Sets the state of a buffer before using it in a certain way,
+ * e.g. as an indirect draw argument buffer after filling it in a compute shader.
+ * Note that Etna calls this automatically for buffers bound with descriptor sets.
+ *
+ * \param com_buffer The command buffer being recorded.
+ * \param buffer The buffer to set the state for.
+ * \param pipeline_stage_flags Where will the buffer be used?
+ * \param access_flags How will it be used?
+ */
+void set_state(
+  vk::CommandBuffer com_buffer,
+  vk::Buffer buffer,
+  vk::PipelineStageFlags2 pipeline_stage_flags,
+  vk::AccessFlags2 access_flags,
+  ForceSetState force = ForceSetState::eFalse);
+
 /**
  * \brief Flushes all barriers resulting from set_state calls.
  * \note Remember to call this before any draw/dispatch/transfer commands!
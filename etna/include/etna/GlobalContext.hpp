@@ -3,6 +3,7 @@
 #define ETNA_GLOBAL_CONTEXT_HPP_INCLUDED
 
 #include <memory>
+#include <vector>
 
 #include <etna/Vulkan.hpp>
 #include <etna/GpuWorkCount.hpp>
@@ -10,6 +11,7 @@
 #include <etna/Buffer.hpp>
 #include <etna/Window.hpp>
 #include <etna/BarrierBehavoir.hpp>
+#include <etna/ResidencyManager.hpp>
 
 #include <vk_mem_alloc.h>
 
@@ -24,19 +26,51 @@ struct DynamicDescriptorPool;
 class ResourceStates;
 class PerFrameCmdMgr;
 class OneShotCmdMgr;
+class SecondaryCmdMgr;
+class StaticCommandBuffer;
+class StaticRecordingRetireList;
+class StagingCopier;
+class RenderTargetPool;
 
 class GlobalContext
 {
   friend void initialize(const struct InitParams&);
+  friend std::unique_ptr<GlobalContext> create_context(const struct InitParams&);
+  friend class ResidencyManager;
 
   explicit GlobalContext(const struct InitParams& params);
 
 public:
+  // Optional device features that etna enables whenever the device supports them
+  struct OptionalFeatures
+  {
+    // VK_KHR_multiview, core since Vulkan 1.1, see RenderTargetState::CreateInfo::viewMask
+    bool multiview = false;
+    // VK_KHR_dynamic_rendering_local_read, see RenderTargetState::CreateInfo::localRead
+    bool dynamicRenderingLocalRead = false;
+    // Core since Vulkan 1.2, required for GpuCulling::drawIndexedIndirectCount
+    bool drawIndirectCount = false;
+    // Core since Vulkan 1.2, required for Buffer::getDeviceAddress
+    bool bufferDeviceAddress = false;
+    // Core since Vulkan 1.3, see ShaderProgramLayoutOptions::inlineUniformBlocks
+    bool inlineUniformBlock = false;
+    // VK_EXT_image_view_min_lod, see Image::ViewParams::minLod
+    bool imageViewMinLod = false;
+    // Whether etna itself enables Vulkan 1.2 features, which is only possible when
+    // the application doesn't specify any of them in InitParams::features
+    bool ownsVulkan12Features = false;
+  };
+
   Image createImage(const Image::CreateInfo& info);
   Buffer createBuffer(const Buffer::CreateInfo& info);
   std::unique_ptr<Window> createWindow(Window::CreateInfo info);
   std::unique_ptr<PerFrameCmdMgr> createPerFrameCmdMgr();
   std::unique_ptr<OneShotCmdMgr> createOneShotCmdMgr();
+  std::unique_ptr<SecondaryCmdMgr> createSecondaryCmdMgr(std::size_t thread_count);
+  std::unique_ptr<StaticCommandBuffer> createStaticCommandBuffer();
+  std::unique_ptr<RenderTargetPool> createRenderTargetPool();
+  // Only one residency manager may exist at a time
+  std::unique_ptr<ResidencyManager> createResidencyManager(ResidencyManager::CreateInfo info);
   bool shouldGenerateBarriersWhen(BarrierBehavoir behavoir) const;
 
   vk::Device getDevice() const { return vkDevice.get(); }
@@ -44,12 +78,24 @@ public:
   vk::Instance getInstance() const { return vkInstance.get(); }
   vk::Queue getQueue() const { return universalQueue; }
   uint32_t getQueueFamilyIdx() const { return universalQueueFamilyIdx; }
+  // All queues come from getQueueFamilyIdx and the first one is getQueue. Only contexts
+  // with ContextProfile::eComputeOnly may have more than one, for submitting independent
+  // jobs from several threads.
+  vk::Queue getComputeQueue(std::size_t index) const { return computeQueues.at(index); }
+  std::size_t getComputeQueueCount() const { return computeQueues.size(); }
+  bool isComputeOnly() const { return computeOnly; }
+  const OptionalFeatures& getOptionalFeatures() const { return optionalFeatures; }
 
   ShaderProgramManager& getShaderManager();
   PipelineManager& getPipelineManager();
   DescriptorSetLayoutCache& getDescriptorSetLayouts();
   DynamicDescriptorPool& getDescriptorPool();
   ResourceStates& getResourceTracker();
+  StaticRecordingRetireList& getStaticRecordingRetireList();
+  // Shared by the transfer helpers of the context, its threads start on first use
+  StagingCopier& getStagingCopier();
+  // nullptr unless a residency manager was created
+  ResidencyManager* getResidencyManager() { return residencyManager; }
   GpuWorkCount& getMainWorkCount() { return mainWorkStream; }
   const GpuWorkCount& getMainWorkCount() const { return mainWorkStream; }
 
@@ -70,11 +116,15 @@ private:
   vk::UniqueDebugUtilsMessengerEXT vkDebugCallback{};
   vk::PhysicalDevice vkPhysDevice{};
   vk::UniqueDevice vkDevice{};
+  OptionalFeatures optionalFeatures{};
 
   // We use a single queue for all purposes.
   // Async compute/transfer is too complicated for demos.
+  // Compute only contexts use the first of their compute queues instead.
   vk::Queue universalQueue{};
   uint32_t universalQueueFamilyIdx{};
+  std::vector<vk::Queue> computeQueues;
+  bool computeOnly;
 
   std::unique_ptr<VmaAllocator_T, void (*)(VmaAllocator)> vmaAllocator{nullptr, nullptr};
 
@@ -83,13 +133,36 @@ private:
   std::unique_ptr<PipelineManager> pipelineManager;
   std::unique_ptr<DynamicDescriptorPool> descriptorPool;
   std::unique_ptr<ResourceStates> resourceTracking;
+  std::unique_ptr<StaticRecordingRetireList> staticRecordings;
+  std::unique_ptr<StagingCopier> stagingCopier;
   std::unique_ptr<void, void (*)(void*)> tracyCtx;
+  ResidencyManager* residencyManager = nullptr;
 
   bool shouldGenerateBarriersFlag;
 };
 
+// The context of the innermost ContextScope of the current thread, if any,
+// or the default one created by etna::initialize otherwise.
 GlobalContext& get_context();
 
+/**
+ * Makes etna calls of the current thread use the given context for as long as
+ * the scope lives. Objects that are used long after their creation, like images
+ * and shader programs, stay bound to the context they were created in.
+ */
+class ContextScope
+{
+public:
+  explicit ContextScope(GlobalContext& context);
+  ~ContextScope();
+
+  ContextScope(const ContextScope&) = delete;
+  ContextScope& operator=(const ContextScope&) = delete;
+
+private:
+  GlobalContext* previous;
+};
+
 } // namespace etna
 
 #endif // ETNA_GLOBAL_CONTEXT_HPP_INCLUDED
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef ETNA_GPU_CULLING_HPP_INCLUDED
+#define ETNA_GPU_CULLING_HPP_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+namespace etna
+{
+
+// A single drawable instance of the scene as seen by the culling shader.
+// Every instance is drawn with a separate indexed draw command, whose
+// firstInstance is the index of the instance, so vertex shaders can fetch
+// per-instance data, e.g. transforms, using gl_InstanceIndex.
+struct GpuInstance
+{
+  // World space bounding sphere: center and radius
+  std::array<float, 4> boundingSphere;
+  std::uint32_t indexCount;
+  std::uint32_t firstIndex;
+  std::int32_t vertexOffset;
+  std::uint32_t padding = 0;
+};
+static_assert(sizeof(GpuInstance) == 32);
+
+/**
+ * GPU-driven drawing: culls instances of the scene in a compute shader and
+ * compacts draw commands of the visible ones into an indirect buffer, which is
+ * then drawn with a single vkCmdDrawIndexedIndirectCount. The CPU cost of
+ * drawing doesn't depend on the amount of instances this way.
+ * Instances are culled against the view frustum and, optionally, against a
+ * depth pyramid of the previous frame (hi-Z occlusion culling).
+ * NOTE: requires OptionalFeatures::drawIndirectCount.
+ */
+class GpuCulling
+{
+public:
+  struct CreateInfo
+  {
+    // Determines the sizes of the instance and draw command buffers
+    std::uint32_t maxInstances;
+
+    // Whether to cull instances hidden behind the depth pyramid passed to cull()
+    bool occlusionCulling = false;
+
+    // Name of the buffers for debugging tools
+    std::string_view name = "GpuCulling";
+  };
+
+  explicit GpuCulling(CreateInfo info);
+
+  GpuCulling(const GpuCulling&) = delete;
+  GpuCulling& operator=(const GpuCulling&) = delete;
+  GpuCulling(GpuCulling&&) = delete;
+  GpuCulling& operator=(GpuCulling&&) = delete;
+
+  // Storage buffer of GpuInstance, fill it e.g. with BlockingTransferHelper
+  Buffer& getInstanceBuffer() { return instances; }
+  const Buffer& getDrawCommandBuffer() const { return drawCommands; }
+  const Buffer& getDrawCountBuffer() const { return drawCount; }
+
+  struct CullParams
+  {
+    // Column-major view-projection matrix, i.e. the memory layout of glm::mat4.
+    // Depth is expected to be in [0, 1] and not reversed.
+    std::array<float, 16> viewProj;
+
+    // Amount of instances at the start of the instance buffer to process
+    std::uint32_t instanceCount;
+
+    // Required with occlusion culling. Every texel of mip N must contain
+    // the farthest depth among the texels of mip N-1 it covers, mip 0
+    // being e.g. the depth buffer of the previous frame.
+    const Image* depthPyramid = nullptr;
+  };
+
+  // Records culling of the instances. Must be recorded outside of RenderTargetState
+  // scopes. The draw buffers are left ready for indirect drawing, so no barriers
+  // are needed before drawIndexedIndirectCount.
+  void cull(vk::CommandBuffer cmd_buf, const CullParams& params);
+
+  // Draws the instances that survived the last cull() with a bound graphics pipeline.
+  // Index and vertex buffers must be bound as well.
+  void drawIndexedIndirectCount(vk::CommandBuffer cmd_buf) const;
+
+private:
+  std::uint32_t maxInstances;
+  bool occlusionCulling;
+
+  ShaderProgramId programId;
+  ComputePipeline pipeline;
+  Sampler depthPyramidSampler;
+
+  Buffer instances;
+  Buffer drawCommands;
+  Buffer drawCount;
+  GpuSharedResource<Buffer> cullParams;
+};
+
+} // namespace etna
+
+#endif // ETNA_GPU_CULLING_HPP_INCLUDED
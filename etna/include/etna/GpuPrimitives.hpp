@@ -0,0 +1,135 @@
+#pragma once
+#ifndef ETNA_GPU_PRIMITIVES_HPP_INCLUDED
+#define ETNA_GPU_PRIMITIVES_HPP_INCLUDED
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+
+
+namespace etna
+{
+
+enum class ReduceOp : std::uint32_t
+{
+  eAdd,
+  eMin,
+  eMax,
+};
+
+/**
+ * Common data-parallel algorithms over arrays of uint32_t in storage buffers:
+ * prefix scans, reduction, stream compaction and radix sort. All operations
+ * only record commands, so they can be used both in per-frame command buffers
+ * and with OneShotCmdMgr, and take care of their own barriers.
+ * Subgroup arithmetic is used when the device supports it in compute shaders,
+ * shared memory otherwise.
+ * NOTE: must be used outside of RenderTargetState scopes.
+ */
+class GpuPrimitives
+{
+public:
+  struct CreateInfo
+  {
+    // Largest amount of elements a single operation may process,
+    // determines the sizes of the scratch buffers.
+    std::uint32_t maxElements;
+
+    // Use the shared memory versions of the shaders even when subgroups are supported
+    bool disableSubgroups = false;
+
+    // Name of the scratch buffers for debugging tools
+    std::string_view name = "GpuPrimitives";
+  };
+
+  explicit GpuPrimitives(CreateInfo info);
+
+  GpuPrimitives(const GpuPrimitives&) = delete;
+  GpuPrimitives& operator=(const GpuPrimitives&) = delete;
+  GpuPrimitives(GpuPrimitives&&) = delete;
+  GpuPrimitives& operator=(GpuPrimitives&&) = delete;
+
+  bool usesSubgroups() const { return subgroups; }
+
+  // dst[i] = src[0] + ... + src[i - 1]. src and dst may be the same buffer.
+  void exclusiveScan(
+    vk::CommandBuffer cmd_buf, const Buffer& src, const Buffer& dst, std::uint32_t count);
+
+  // dst[i] = src[0] + ... + src[i]. src and dst may be the same buffer.
+  void inclusiveScan(
+    vk::CommandBuffer cmd_buf, const Buffer& src, const Buffer& dst, std::uint32_t count);
+
+  // Writes the sum, minimum or maximum of the elements into the first element of result.
+  // The result buffer must be created with the transfer dst usage.
+  void reduce(
+    vk::CommandBuffer cmd_buf,
+    const Buffer& src,
+    const Buffer& result,
+    std::uint32_t count,
+    ReduceOp op = ReduceOp::eAdd);
+
+  // Copies the values with non-zero flags to the start of dst preserving their order,
+  // and writes the amount of them into the first element of dst_count.
+  void compact(
+    vk::CommandBuffer cmd_buf,
+    const Buffer& values,
+    const Buffer& flags,
+    const Buffer& dst,
+    const Buffer& dst_count,
+    std::uint32_t count);
+
+  // Stable in-place sort of the pairs by keys, e.g. of particle indices by depth.
+  // Sorting by floats is possible after flipping them into order-preserving uints.
+  void sortPairs(
+    vk::CommandBuffer cmd_buf, const Buffer& keys, const Buffer& values, std::uint32_t count);
+
+private:
+  struct Kernel
+  {
+    std::string programName;
+    ComputePipeline pipeline;
+  };
+  Kernel createKernel(const char* name) const;
+
+  void dispatch(
+    vk::CommandBuffer cmd_buf,
+    const Kernel& kernel,
+    std::initializer_list<const Buffer*> buffers,
+    std::span<const std::byte> push_constants,
+    std::uint32_t group_count);
+
+  void scan(
+    vk::CommandBuffer cmd_buf,
+    const Buffer& src,
+    const Buffer& dst,
+    std::uint32_t count,
+    bool inclusive,
+    bool predicate,
+    std::size_t level = 0);
+
+  std::uint32_t maxElements;
+  bool subgroups;
+
+  Kernel scanKernel;
+  Kernel reduceKernel;
+  Kernel compactKernel;
+  Kernel radixSortKernel;
+
+  // Per level of the scan hierarchy, sums of the blocks of the previous level
+  std::vector<Buffer> blockSums;
+  Buffer compactOffsets;
+  Buffer sortKeys;
+  Buffer sortValues;
+  Buffer sortHistogram;
+};
+
+} // namespace etna
+
+#endif // ETNA_GPU_PRIMITIVES_HPP_INCLUDED
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef ETNA_GPU_PTR_HPP_INCLUDED
+#define ETNA_GPU_PTR_HPP_INCLUDED
+
+#include <cstddef>
+
+#include <etna/Vulkan.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Device address of an array of T in a buffer, see Buffer::getGpuPtr.
+ * Has the same layout as a GL_EXT_buffer_reference pointer, so it can be
+ * put as is into push constants or buffers read by shaders, e.g.
+ *   layout(buffer_reference, std430) readonly buffer Transforms { mat4 transforms[]; };
+ *   layout(push_constant) uniform Params { Transforms transforms; } params;
+ * T only documents the type pointed to on the CPU side and is never dereferenced.
+ * NOTE: requires OptionalFeatures::bufferDeviceAddress.
+ */
+template <class T>
+struct GpuPtr
+{
+  vk::DeviceAddress address = 0;
+
+  // Pointer arithmetic is in elements, just like with regular pointers
+  GpuPtr operator+(std::size_t count) const { return GpuPtr{address + count * sizeof(T)}; }
+  GpuPtr& operator+=(std::size_t count) { return *this = *this + count; }
+
+  explicit operator bool() const { return address != 0; }
+
+  bool operator==(const GpuPtr&) const = default;
+};
+
+static_assert(sizeof(GpuPtr<float>) == sizeof(vk::DeviceAddress));
+
+} // namespace etna
+
+#endif // ETNA_GPU_PTR_HPP_INCLUDED
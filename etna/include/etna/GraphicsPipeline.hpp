@@ -2,6 +2,8 @@
 #ifndef ETNA_GRAPHICS_PIPELINE_HPP_INCLUDED
 #define ETNA_GRAPHICS_PIPELINE_HPP_INCLUDED
 
+#include <optional>
+
 #include <etna/Vulkan.hpp>
 #include <etna/VertexInput.hpp>
 #include <etna/PipelineBase.hpp>
@@ -12,6 +14,21 @@ namespace etna
 
 class PipelineManager;
 
+// Tells which attachments of a render target fragment shaders read as input
+// attachments with VK_KHR_dynamic_rendering_local_read. The input_attachment_index
+// decoration of a subpassInput in GLSL refers to indices in this mapping.
+// The same mapping must be used for the pipeline and the render target it draws into.
+struct InputAttachmentIndexMapping
+{
+  // input_attachment_index of every color attachment, vk::AttachmentUnused
+  // for those that are not read. Must have an element for each color attachment.
+  std::vector<uint32_t> colorAttachmentInputIndices = {};
+  // input_attachment_index of the depth/stencil attachment, nullopt means
+  // that it is read with a subpassInput that has no input_attachment_index.
+  std::optional<uint32_t> depthInputAttachmentIndex = std::nullopt;
+  std::optional<uint32_t> stencilInputAttachmentIndex = std::nullopt;
+};
+
 class GraphicsPipeline : public PipelineBase
 {
   friend class PipelineManager;
@@ -109,8 +126,16 @@ public:
       std::vector<vk::Format> colorAttachmentFormats = {};
       vk::Format depthAttachmentFormat = vk::Format::eUndefined;
       vk::Format stencilAttachmentFormat = vk::Format::eUndefined;
+      // Must match RenderTargetState::CreateInfo::viewMask of the render
+      // targets this pipeline is used with, 0 means no multiview.
+      uint32_t viewMask = 0;
     } fragmentShaderOutput;
 
+    // Only needed for fragment shaders that read attachments of the render target
+    // they draw into, see RenderTargetState::CreateInfo::localRead. Without
+    // a mapping, color attachment i is read with input_attachment_index i.
+    std::optional<InputAttachmentIndexMapping> inputAttachmentIndices = std::nullopt;
+
     std::vector<vk::DynamicState> dynamicStates = {
       vk::DynamicState::eViewport,
       vk::DynamicState::eScissor,
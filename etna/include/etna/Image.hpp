@@ -12,6 +12,8 @@
 namespace etna
 {
 
+class GlobalContext;
+
 class Image
 {
 public:
@@ -109,9 +111,14 @@ public:
     std::optional<vk::ImageAspectFlags> aspectMask = std::nullopt;
 
     // The way we interpret the image: 1/2/3D, cube, array, etc.
-    // By default views it as 1/2/3D automatically based on the image itself.
+    // By default views it as 1/2/3D automatically based on the image itself,
+    // or as a 1/2D array when more than one layer is viewed.
     std::optional<vk::ImageViewType> type = std::nullopt;
 
+    // Mips below this LOD are never accessed through the view, e.g. because their
+    // contents are still being streamed in. Requires OptionalFeatures::imageViewMinLod.
+    float minLod = 0.0f;
+
     bool operator==(const ViewParams& b) const = default;
   };
   vk::ImageView getView(ViewParams params) const;
@@ -120,13 +127,17 @@ public:
   ImageBinding genBinding(
     vk::Sampler sampler,
     vk::ImageLayout layout,
-    ViewParams params = {0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers, {}, {}}) const;
+    ViewParams params = {0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers, {}, {}, 0.0f})
+    const;
 
   // Returns the "all" aspects combination of flags based on the image's real format
   vk::ImageAspectFlags getAspectMaskByFormat() const;
 
   vk::Extent3D getExtent() const { return extent; }
   vk::Format getFormat() const { return format; }
+  uint32_t getMipLevelCount() const { return mipLevels; }
+  uint32_t getLayerCount() const { return layers; }
+  vk::SampleCountFlagBits getSampleCount() const { return samples; }
 
 private:
   struct ViewParamsHasher
@@ -148,6 +159,8 @@ private:
     }
   };
   mutable std::unordered_map<ViewParams, vk::UniqueImageView, ViewParamsHasher> views;
+  // Views are created lazily, with the device of the context the image was created in
+  GlobalContext* context{};
   VmaAllocator allocator{};
 
   VmaAllocation allocation{};
@@ -156,6 +169,9 @@ private:
   vk::Format format;
   std::string name;
   vk::Extent3D extent;
+  uint32_t mipLevels{};
+  uint32_t layers{};
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
 };
 
 } // namespace etna
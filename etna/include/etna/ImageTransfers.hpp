@@ -0,0 +1,57 @@
+#pragma once
+#ifndef ETNA_IMAGE_TRANSFERS_HPP_INCLUDED
+#define ETNA_IMAGE_TRANSFERS_HPP_INCLUDED
+
+#include <span>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+
+
+namespace etna
+{
+
+// Aspect masks of the subresources that are left empty are filled in
+// with all aspects of the formats of the images.
+struct ImageCopyRequest
+{
+  const Image& src;
+  const Image& dst;
+  vk::ImageCopy2 region;
+};
+
+struct ImageBlitRequest
+{
+  const Image& src;
+  const Image& dst;
+  vk::ImageBlit2 region;
+};
+
+/**
+ * \brief Records many copies between images at once, e.g. when packing an atlas
+ * or assembling a texture array. Requests with the same source and destination
+ * become a single copyImage2 with many regions, and the transitions of all images
+ * are flushed together. A request that reads the results of a previous one, or
+ * overwrites its source, starts a new batch of transitions and commands, so the
+ * requests behave as if they were recorded in the given order.
+ * \note Destination regions written by the same batch must not overlap. Copies
+ * within a single image are supported, in the general layout.
+ *
+ * \param cmd_buf The command buffer being recorded, outside of a render pass.
+ * \param requests The copies to make, images need transfer src/dst usages.
+ */
+void copy_images(vk::CommandBuffer cmd_buf, std::span<const ImageCopyRequest> requests);
+
+// Offsets of buffer to image copies must be multiples of the texel block size of the
+// format, and of 4 for depth/stencil ones. 3, 6 and 12 byte formats need lcm of both.
+vk::DeviceSize get_buffer_image_copy_alignment(vk::Format format);
+
+// Same as copy_images, but with blitImage2, which can scale and convert formats
+void blit_images(
+  vk::CommandBuffer cmd_buf,
+  std::span<const ImageBlitRequest> requests,
+  vk::Filter filter = vk::Filter::eLinear);
+
+} // namespace etna
+
+#endif // ETNA_IMAGE_TRANSFERS_HPP_INCLUDED
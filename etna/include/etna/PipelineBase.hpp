@@ -2,6 +2,9 @@
 #ifndef ETNA_PIPELINE_BASE_HPP_INCLUDED
 #define ETNA_PIPELINE_BASE_HPP_INCLUDED
 
+#include <cstdint>
+#include <type_traits>
+
 #include <etna/Vulkan.hpp>
 #include <etna/Forward.hpp>
 
@@ -14,6 +17,21 @@ class PipelineBase
 public:
   vk::PipelineLayout getVkPipelineLayout() const;
   vk::Pipeline getVkPipeline() const;
+  ShaderProgramId getShaderProgram() const { return shaderProgramId; }
+
+  // Records a push of a struct mirroring a push_constant block, e.g. one made of GpuPtr
+  // to pass buffers to shaders without descriptors. The pipeline must be bound.
+  template <class T>
+  void pushConstants(
+    vk::CommandBuffer cmd_buf,
+    vk::ShaderStageFlags stages,
+    const T& data,
+    std::uint32_t offset = 0) const
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "Push constants are copied bytewise!");
+    cmd_buf.pushConstants(
+      getVkPipelineLayout(), stages, offset, static_cast<std::uint32_t>(sizeof(T)), &data);
+  }
 
   PipelineBase(const PipelineBase&) = delete;
   PipelineBase& operator=(const PipelineBase&) = delete;
@@ -2,9 +2,13 @@
 #ifndef ETNA_PIPELINE_MANAGER_HPP_INCLUDED
 #define ETNA_PIPELINE_MANAGER_HPP_INCLUDED
 
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <etna/Vulkan.hpp>
+#include <etna/detail/RcuCell.hpp>
 #include <etna/PipelineBase.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <etna/ComputePipeline.hpp>
@@ -15,6 +19,8 @@ namespace etna
 
 struct ShaderProgramManager;
 
+// Pipelines can be created from several threads at once and are looked up
+// lock-free when bound. recreate must not overlap with any other use of the manager.
 class PipelineManager
 {
   friend class PipelineBase;
@@ -31,6 +37,8 @@ public:
   // TODO: createRaytracePipeline, createMeshletPipeline
 
   void recreate();
+  // Frees the snapshots replaced long enough ago, called by begin_frame
+  void collectRetiredSnapshots();
 
 private:
   void destroyPipeline(PipelineId id);
@@ -42,7 +50,7 @@ private:
   ShaderProgramManager& shaderManager;
 
 
-  std::underlying_type_t<PipelineId> pipelineIdCounter{0};
+  std::atomic<std::underlying_type_t<PipelineId>> pipelineIdCounter{0};
 
   struct PipelineParameters
   {
@@ -55,9 +63,14 @@ private:
     ShaderProgramId shaderProgram;
     ComputePipeline::CreateInfo info;
   };
+  void publish(PipelineId id, vk::UniquePipeline pipeline);
+
+  // Guards everything below but the snapshot of handles, which is indexed by ids
+  std::mutex mutex;
   std::unordered_map<PipelineId, vk::UniquePipeline> pipelines;
   std::unordered_multimap<PipelineId, ComputeParameters> computePipelineParameters;
   std::unordered_multimap<PipelineId, PipelineParameters> graphicsPipelineParameters;
+  detail::RcuCell<std::vector<vk::Pipeline>> vkPipelines;
 };
 
 } // namespace etna
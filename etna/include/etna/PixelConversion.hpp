@@ -0,0 +1,54 @@
+#pragma once
+#ifndef ETNA_PIXEL_CONVERSION_HPP_INCLUDED
+#define ETNA_PIXEL_CONVERSION_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include <etna/Vulkan.hpp>
+
+
+namespace etna
+{
+
+// Pixel layouts as they usually come out of image loaders
+enum class SourcePixelFormat : std::uint32_t
+{
+  eRgb8,
+  eRgba8,
+  eRgb16,
+  eRgba16,
+  eRgb32f,
+  eRgba32f,
+};
+
+struct PixelSource
+{
+  SourcePixelFormat format;
+
+  // Whether the color channels of 8 and 16 bit pixels are sRGB encoded,
+  // float pixels and alpha are always linear.
+  bool srgb = false;
+};
+
+std::size_t get_source_pixel_size(SourcePixelFormat format);
+
+/**
+ * Whether convert_pixels can produce pixels of the given format. Supported are
+ * RGBA formats with 8 bit unorm or sRGB, 16 bit unorm, 16 and 32 bit float
+ * channels. Missing alpha is filled with ones, and channels are converted between
+ * sRGB and linear encodings whenever the source and destination ones differ.
+ */
+bool can_convert_pixels(vk::Format dst_format);
+
+// Converts pixel_count pixels, using SSSE3/AVX2/F16C kernels when the CPU has them
+void convert_pixels(
+  PixelSource source,
+  vk::Format dst_format,
+  const std::byte* src,
+  std::byte* dst,
+  std::size_t pixel_count);
+
+} // namespace etna
+
+#endif // ETNA_PIXEL_CONVERSION_HPP_INCLUDED
@@ -16,15 +16,26 @@
 
 // Actually profiles both CPU and GPU. Feel free to sprinkle all over your code.
 // This is a scoped macro, so a profiling region ends at the end of a scope.
+// Contexts without a GPU profiler, e.g. compute only ones, only profile the CPU.
 #define ETNA_PROFILE_GPU(cmdBuf, regionName)                                                       \
   ZoneScopedN(#regionName);                                                                        \
-  TracyVkZone(                                                                                     \
-    reinterpret_cast<TracyVkCtx>(etna::get_context().getTracyContext()), (cmdBuf), #regionName)
+  TracyVkNamedZone(                                                                                \
+    reinterpret_cast<TracyVkCtx>(etna::get_context().getTracyContext()),                           \
+    ___tracy_gpu_zone,                                                                             \
+    (cmdBuf),                                                                                      \
+    #regionName,                                                                                   \
+    etna::get_context().getTracyContext() != nullptr)
 
 // Must be called at least every frame.
 // If you have a TON of profiling events, must be called more frequently.
 #define ETNA_READ_BACK_GPU_PROFILING(cmdBuf)                                                       \
-  TracyVkCollect(reinterpret_cast<TracyVkCtx>(etna::get_context().getTracyContext()), (cmdBuf))
+  do                                                                                               \
+  {                                                                                                \
+    if (void* etnaTracyCtx = etna::get_context().getTracyContext(); etnaTracyCtx != nullptr)       \
+    {                                                                                              \
+      TracyVkCollect(reinterpret_cast<TracyVkCtx>(etnaTracyCtx), (cmdBuf));                        \
+    }                                                                                              \
+  } while (false)
 
 #if __GNUC__ && !__clang__
 #pragma GCC diagnostic pop
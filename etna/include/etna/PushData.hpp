@@ -0,0 +1,77 @@
+#pragma once
+#ifndef ETNA_PUSH_DATA_HPP_INCLUDED
+#define ETNA_PUSH_DATA_HPP_INCLUDED
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/PipelineBase.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Passes per-draw/dispatch structs of any size to shaders as cheaply as possible.
+ * The shader decides how it receives the data:
+ * - if its push_constant block is at least as big as the struct, the struct is
+ *   pushed directly, just like with PipelineBase::pushConstants;
+ * - otherwise the struct is written into a per-frame ring buffer and only its
+ *   address is pushed, which the shader declares as the first member of the block:
+ *     layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer Data
+ *     { mat4 bones[64]; };
+ *     layout(push_constant) uniform Params { Data data; } params;
+ * So shaders can outgrow maxPushConstantsSize without changes to the CPU side.
+ * Spilled data lives until the frame is done on the GPU, just like descriptor sets.
+ * NOTE: spilling requires OptionalFeatures::bufferDeviceAddress.
+ */
+class PushData
+{
+public:
+  struct CreateInfo
+  {
+    // Bytes available for spilled data per frame
+    vk::DeviceSize ringSize = 4 << 20;
+
+    // Name of the ring buffers for debugging tools
+    std::string_view name = "PushData";
+  };
+
+  explicit PushData(CreateInfo info);
+
+  PushData(const PushData&) = delete;
+  PushData& operator=(const PushData&) = delete;
+  PushData(PushData&&) = delete;
+  PushData& operator=(PushData&&) = delete;
+
+  // The pipeline must be bound
+  template <class T>
+  void push(vk::CommandBuffer cmd_buf, const PipelineBase& pipeline, const T& data)
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "Push data is copied bytewise!");
+    pushBytes(cmd_buf, pipeline, std::as_bytes(std::span{&data, 1}));
+  }
+
+  void pushBytes(
+    vk::CommandBuffer cmd_buf, const PipelineBase& pipeline, std::span<const std::byte> data);
+
+private:
+  struct Ring
+  {
+    Buffer buffer;
+    vk::DeviceSize used = 0;
+    std::uint64_t lastBatch = ~std::uint64_t{0};
+  };
+
+  vk::DeviceSize ringSize;
+  GpuSharedResource<Ring> rings;
+};
+
+} // namespace etna
+
+#endif // ETNA_PUSH_DATA_HPP_INCLUDED
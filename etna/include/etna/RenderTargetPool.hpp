@@ -0,0 +1,118 @@
+#pragma once
+#ifndef ETNA_RENDER_TARGET_POOL_HPP_INCLUDED
+#define ETNA_RENDER_TARGET_POOL_HPP_INCLUDED
+
+#include <unordered_map>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/GpuWorkCount.hpp>
+
+#include <vk_mem_alloc.h>
+
+
+namespace etna
+{
+
+/**
+ * Recycles images with identical creation parameters instead of allocating new ones
+ * every time, which is handy for post-processing chains and window resizes.
+ * A released image can only be acquired again after the GPU is guaranteed to be
+ * done with it, i.e. after a frames-in-flight grace period.
+ * NOTE: recycled images keep the debug name they were created with, and
+ * their contents should be considered garbage.
+ */
+class RenderTargetPool
+{
+public:
+  struct Dependencies
+  {
+    const GpuWorkCount& workCount;
+    vk::Device device;
+    VmaAllocator allocator;
+  };
+
+  explicit RenderTargetPool(const Dependencies& deps);
+
+  RenderTargetPool(const RenderTargetPool&) = delete;
+  RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+  RenderTargetPool(RenderTargetPool&&) = delete;
+  RenderTargetPool& operator=(RenderTargetPool&&) = delete;
+
+  // Returns an idle image created with the same info (ignoring the name), or a new one.
+  Image acquire(const Image::CreateInfo& info);
+
+  // Puts an image previously acquired from this pool back into it.
+  // It is fine to still have GPU work that uses the image in flight.
+  void release(Image image);
+
+  // Destroys idle images that were not reused during the last `max_idle_batches` batches.
+  void trim(std::uint64_t max_idle_batches);
+
+  // Destroys all idle images that the GPU is done with.
+  void clear() { trim(0); }
+
+  struct Stats
+  {
+    // Acquisitions that were served by recycling an idle image
+    std::uint64_t hits = 0;
+    // Acquisitions that had to allocate a new image
+    std::uint64_t misses = 0;
+    // Images acquired from the pool and not yet released
+    std::size_t acquiredImages = 0;
+    // Images waiting in the pool to be reused
+    std::size_t idleImages = 0;
+    // Memory held by idle images
+    vk::DeviceSize idleBytes = 0;
+  };
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  struct Key
+  {
+    vk::Extent3D extent;
+    vk::Format format;
+    vk::ImageUsageFlags imageUsage;
+    VmaMemoryUsage memoryUsage;
+    VmaAllocationCreateFlags allocationCreate;
+    vk::ImageTiling tiling;
+    std::size_t layers;
+    std::size_t mipLevels;
+    vk::SampleCountFlagBits samples;
+    vk::ImageType type;
+    vk::ImageCreateFlags flags;
+
+    explicit Key(const Image::CreateInfo& info);
+    bool operator==(const Key&) const = default;
+  };
+
+  struct KeyHash
+  {
+    std::size_t operator()(const Key& key) const;
+  };
+
+  struct IdleImage
+  {
+    Image image;
+    std::uint64_t releaseBatch;
+    vk::DeviceSize size;
+  };
+
+  bool isSafeToReuse(const IdleImage& idle_image) const;
+
+private:
+  const GpuWorkCount& workCount;
+  vk::Device device;
+  VmaAllocator allocator;
+
+  std::unordered_map<Key, std::vector<IdleImage>, KeyHash> idleImages;
+  std::unordered_map<vk::Image, Key> acquiredImages;
+
+  Stats stats;
+};
+
+} // namespace etna
+
+#endif // ETNA_RENDER_TARGET_POOL_HPP_INCLUDED
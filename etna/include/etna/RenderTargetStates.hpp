@@ -2,10 +2,12 @@
 #ifndef ETNA_STATES_HPP_INCLUDED
 #define ETNA_STATES_HPP_INCLUDED
 
+#include <span>
 #include <vector>
 
 #include <etna/Vulkan.hpp>
 #include <etna/Image.hpp>
+#include <etna/GraphicsPipeline.hpp>
 #include <etna/BarrierBehavoir.hpp>
 
 namespace etna
@@ -14,7 +16,16 @@ namespace etna
 class RenderTargetState
 {
   vk::CommandBuffer commandBuffer;
-  static bool inScope;
+  bool localRead = false;
+
+  // Everything secondary command buffers need to inherit from this scope
+  bool secondaryContents = false;
+  vk::Rect2D renderArea = {};
+  uint32_t viewMask = 0;
+  std::vector<vk::Format> colorFormats;
+  vk::Format depthFormat = vk::Format::eUndefined;
+  vk::Format stencilFormat = vk::Format::eUndefined;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
 
 public:
   struct AttachmentParams
@@ -27,6 +38,31 @@ public:
     vk::ClearColorValue clearColorValue = std::array<float, 4>({0.0f, 0.0f, 0.0f, 1.0f});
     vk::ClearDepthStencilValue clearDepthStencilValue = {1.0f, 0};
 
+    // Array layers of the image that the view covers. Barriers for this attachment
+    // only touch these layers, so the rest of an array image can be used for something
+    // else while we render into a part of it, e.g. with multiview or layered rendering.
+    // Use fromView to fill these automatically.
+    uint32_t baseLayer = 0;
+    uint32_t layerCount = vk::RemainingArrayLayers;
+
+    // Format and sample count of the view. Only needed for scopes recorded into
+    // secondary command buffers, as those must know them in advance.
+    vk::Format format = vk::Format::eUndefined;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+    // Lets etna relax loadOp and storeOp where that can't change the result, which
+    // saves a lot of memory traffic, especially on tiled GPUs. eLoad becomes eDontCare
+    // when state tracking knows the previous contents to be undefined (e.g. a freshly
+    // created image or a just acquired swapchain image), and eStore becomes eDontCare
+    // when the attachment is declared to be used for the last time with lastUse.
+    // Loads are only relaxed when etna generates barriers for this scope,
+    // otherwise the tracked state can't be trusted.
+    bool inferOps = false;
+
+    // Nothing reads this attachment after the current scope, e.g. it is a depth
+    // buffer only used for depth testing. Only has an effect together with inferOps.
+    bool lastUse = false;
+
     // By default, the render target can work with multisample images and pipelines,
     // but not produce a final single-sample result.
     // These fields below are for the final MSAA image.
@@ -35,15 +71,70 @@ public:
     vk::ImageView resolveImageView = {};
     std::optional<vk::ImageAspectFlags> resolveImageAspect{};
     vk::ResolveModeFlagBits resolveMode = vk::ResolveModeFlagBits::eNone;
+
+    // Fills the image, the view, the layer range, the format and the sample count
+    // from a view of an etna image, other parameters are left default.
+    static AttachmentParams fromView(const Image& image, Image::ViewParams params = {});
   };
 
+  struct CreateInfo
+  {
+    vk::Rect2D rect = {};
+    std::vector<AttachmentParams> colorAttachments = {};
+    AttachmentParams depthAttachment = {};
+    AttachmentParams stencilAttachment = {};
+
+    // Bitmask of views to render with VK_KHR_multiview, 0 means multiview is off.
+    // Every draw is broadcast to all views, view i being rendered into layer i of
+    // every attachment, and shaders can use gl_ViewIndex to tell views apart.
+    // Attachment views must be array views with enough layers, and pipelines used
+    // inside the scope must be created with the same view mask.
+    uint32_t viewMask = 0;
+
+    // Amount of layers to render when multiview is off. Shaders choose the layer
+    // that a primitive goes to by writing gl_Layer, which allows rendering e.g. all
+    // faces of a cubemap or all slices of a voxel grid in a single pass.
+    // 0 means the smallest layer count among attachments that specify one,
+    // which is 1 unless layered attachments are used.
+    uint32_t layerCount = 0;
+
+    // Puts all attachments into the local read layout with VK_KHR_dynamic_rendering_local_read,
+    // so that fragment shaders can read them as input attachments (subpassInput in GLSL)
+    // while the scope is active. This allows fusing e.g. a G-buffer pass and a lighting
+    // pass into a single scope, which lets tiled GPUs keep the G-buffer in tile memory.
+    // Input attachment descriptors must use vk::ImageLayout::eRenderingLocalReadKHR,
+    // and writes must be made visible to reads with localReadBarrier.
+    bool localRead = false;
+
+    // Draws of the scope are recorded into secondary command buffers instead of
+    // the primary one, which allows spreading the recording of a big pass among
+    // several threads. Start every secondary buffer with beginSecondary and then
+    // run them in the desired order with execute. Not compatible with localRead yet.
+    bool recordInSecondaryBuffers = false;
+
+    BarrierBehavoir behavoir = BarrierBehavoir::eDefault;
+  };
+
+  RenderTargetState(vk::CommandBuffer cmd_buff, const CreateInfo& info);
+
   RenderTargetState(
     vk::CommandBuffer cmd_buff,
     vk::Rect2D rect,
     const std::vector<AttachmentParams>& color_attachments,
     AttachmentParams depth_attachment,
     AttachmentParams stencil_attachment,
-    BarrierBehavoir behavoir = BarrierBehavoir::eDefault);
+    BarrierBehavoir behavoir = BarrierBehavoir::eDefault)
+    : RenderTargetState(
+        cmd_buff,
+        CreateInfo{
+          .rect = rect,
+          .colorAttachments = color_attachments,
+          .depthAttachment = depth_attachment,
+          .stencilAttachment = stencil_attachment,
+          .behavoir = behavoir,
+        })
+  {
+  }
 
   // We can't use the default argument for stencil_attachment due to gcc bug 88165
   // See https://gcc.gnu.org/bugzilla/show_bug.cgi?id=88165
@@ -57,6 +148,28 @@ public:
   {
   }
 
+  RenderTargetState(const RenderTargetState&) = delete;
+  RenderTargetState& operator=(const RenderTargetState&) = delete;
+  RenderTargetState(RenderTargetState&&) = delete;
+  RenderTargetState& operator=(RenderTargetState&&) = delete;
+
+  // Begins recording of a secondary command buffer that continues this scope, e.g. one
+  // acquired from SecondaryCmdMgr. Viewport and scissor are set to the render area.
+  // Safe to call from any thread, as long as the scope is alive.
+  void beginSecondary(vk::CommandBuffer secondary) const;
+
+  // Executes finished secondary command buffers inside of the scope, in order.
+  void execute(std::span<const vk::CommandBuffer> secondaries);
+
+  // Makes attachment writes of previous draws visible to input attachment reads
+  // of the following ones. The dependency is by region, so a fragment may only read
+  // the pixel it is shading. Only allowed in scopes with localRead.
+  void localReadBarrier();
+
+  // Changes the input attachment indices that the following draws read attachments with.
+  // Must match GraphicsPipeline::CreateInfo::inputAttachmentIndices of the pipelines used.
+  void setInputAttachmentIndices(const InputAttachmentIndexMapping& mapping);
+
   ~RenderTargetState();
 };
 
@@ -0,0 +1,166 @@
+#pragma once
+#ifndef ETNA_RESIDENCY_MANAGER_HPP_INCLUDED
+#define ETNA_RESIDENCY_MANAGER_HPP_INCLUDED
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GpuWorkCount.hpp>
+
+#include <vk_mem_alloc.h>
+
+
+namespace etna
+{
+
+/**
+ * Keeps streamable images and buffers within a device memory budget. Managed
+ * resources are owned by the manager, which records when they were last used:
+ * by create_descriptor_set and RenderTargetState automatically, or by markUsed.
+ * Once per frame, update evicts the least recently used ones until the device
+ * local heaps fit into the budget: images lose their most detailed mip, buffers
+ * move into host memory. Resources used by frames still in flight are never
+ * evicted, and the replaced ones are destroyed only after the GPU is done with
+ * the frame that copied them.
+ * NOTE: evicted resources get new handles, so they must be looked up with
+ * getImage/getBuffer every frame and must not be used by StaticCommandBuffer.
+ */
+class ResidencyManager
+{
+public:
+  struct Dependencies
+  {
+    const GpuWorkCount& workCount;
+    vk::Device device;
+    VmaAllocator allocator;
+  };
+
+  struct CreateInfo
+  {
+    // Device local memory that all allocations, including unmanaged ones, may take.
+    // 0 means budgetFraction of the budget that VMA reports for device local heaps.
+    vk::DeviceSize budget = 0;
+    float budgetFraction = 0.8f;
+
+    // Images are never evicted below this amount of mips
+    std::uint32_t minImageMips = 1;
+  };
+
+  enum class ImageId : std::uint32_t
+  {
+    eInvalid = ~0u
+  };
+  enum class BufferId : std::uint32_t
+  {
+    eInvalid = ~0u
+  };
+
+  ResidencyManager(const Dependencies& deps, CreateInfo info);
+  ~ResidencyManager();
+
+  ResidencyManager(const ResidencyManager&) = delete;
+  ResidencyManager& operator=(const ResidencyManager&) = delete;
+  ResidencyManager(ResidencyManager&&) = delete;
+  ResidencyManager& operator=(ResidencyManager&&) = delete;
+
+  // Images are evicted by copying their smaller mips into a new image,
+  // so they need both transfer src and dst usages.
+  ImageId addImage(const Image::CreateInfo& info);
+  // Buffers are evicted by copying them, so they need both transfer src and dst usages.
+  BufferId addBuffer(const Buffer::CreateInfo& info);
+
+  // The resource is destroyed once the GPU is done with it
+  void remove(ImageId id);
+  void remove(BufferId id);
+
+  Image& getImage(ImageId id);
+  Buffer& getBuffer(BufferId id);
+
+  // How many of the most detailed mips of the image were evicted,
+  // i.e. which mip of the original image is mip 0 of getImage now.
+  std::uint32_t getEvictedMips(ImageId id) const;
+  bool isEvictedToHost(BufferId id) const;
+
+  // Called automatically for resources bound to descriptor sets and render targets
+  void markUsed(vk::Image image);
+  void markUsed(vk::Buffer buffer);
+
+  // Evicts resources until the budget is met, recording the copies into cmd_buf.
+  // Should be called once per frame, before the managed resources are used.
+  void update(vk::CommandBuffer cmd_buf);
+
+  struct Stats
+  {
+    // Device local memory taken by managed resources
+    vk::DeviceSize residentBytes = 0;
+    // Sum of the budgets and usages of device local heaps as of the last update
+    vk::DeviceSize heapBudget = 0;
+    vk::DeviceSize heapUsage = 0;
+    // Part of heapUsage taken by replaced resources, which is freed once the GPU
+    // is done with them. It doesn't count towards the budget.
+    vk::DeviceSize retiredBytes = 0;
+    std::uint64_t evictedImageMips = 0;
+    std::uint64_t evictedBuffers = 0;
+  };
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  struct ManagedImage
+  {
+    Image image;
+    Image::CreateInfo info;
+    std::string name;
+    std::uint32_t evictedMips = 0;
+    std::uint64_t lastUsedBatch = 0;
+    vk::DeviceSize size = 0;
+  };
+  struct ManagedBuffer
+  {
+    Buffer buffer;
+    Buffer::CreateInfo info;
+    std::string name;
+    bool onHost = false;
+    std::uint64_t lastUsedBatch = 0;
+    vk::DeviceSize size = 0;
+  };
+  // Replaced resources waiting for the GPU to be done with them
+  struct Retired
+  {
+    Image image;
+    Buffer buffer;
+    std::uint64_t retireBatch;
+    // Device local memory that is freed along with the resource
+    vk::DeviceSize deviceBytes;
+  };
+
+  bool isInFlight(std::uint64_t last_used_batch) const;
+  void retire(Image image, vk::DeviceSize device_bytes);
+  void retire(Buffer buffer, vk::DeviceSize device_bytes);
+  vk::DeviceSize evictImage(vk::CommandBuffer cmd_buf, ManagedImage& managed);
+  vk::DeviceSize evictBuffer(vk::CommandBuffer cmd_buf, ManagedBuffer& managed);
+
+  const GpuWorkCount& workCount;
+  vk::Device device;
+  VmaAllocator allocator;
+  CreateInfo info;
+
+  // Removed resources leave holes, so that ids stay stable
+  std::vector<std::optional<ManagedImage>> images;
+  std::vector<std::optional<ManagedBuffer>> buffers;
+  std::unordered_map<vk::Image, std::uint32_t> imageIds;
+  std::unordered_map<vk::Buffer, std::uint32_t> bufferIds;
+  std::vector<Retired> retired;
+
+  Stats stats;
+};
+
+} // namespace etna
+
+#endif // ETNA_RESIDENCY_MANAGER_HPP_INCLUDED
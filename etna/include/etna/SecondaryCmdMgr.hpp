@@ -0,0 +1,67 @@
+#pragma once
+#ifndef ETNA_SECONDARY_CMD_MGR_HPP_INCLUDED
+#define ETNA_SECONDARY_CMD_MGR_HPP_INCLUDED
+
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuWorkCount.hpp>
+#include <etna/GpuSharedResource.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Provides secondary command buffers for recording work from several threads,
+ * e.g. draws of a RenderTargetState scope with recordInSecondaryBuffers.
+ * Every thread gets its own command pools, one per frame in flight, as command
+ * pools can't be used from several threads at once. Buffers handed out during
+ * a frame are recycled once the GPU is done with that frame, which is guaranteed
+ * by PerFrameCmdMgr::acquireNext waiting for it.
+ */
+class SecondaryCmdMgr
+{
+public:
+  struct Dependencies
+  {
+    const GpuWorkCount& workCount;
+    vk::Device device;
+
+    std::uint32_t queueFamily;
+    std::size_t threadCount;
+  };
+
+  explicit SecondaryCmdMgr(const Dependencies& deps);
+
+  SecondaryCmdMgr(const SecondaryCmdMgr&) = delete;
+  SecondaryCmdMgr& operator=(const SecondaryCmdMgr&) = delete;
+  SecondaryCmdMgr(SecondaryCmdMgr&&) = delete;
+  SecondaryCmdMgr& operator=(SecondaryCmdMgr&&) = delete;
+
+  /**
+   * Returns a fresh secondary command buffer for the current frame. Can be called
+   * concurrently as long as every thread uses its own thread_index, which must be
+   * less than the thread count the manager was created with.
+   */
+  vk::CommandBuffer acquire(std::size_t thread_index);
+
+private:
+  struct ThreadPool
+  {
+    vk::UniqueCommandPool pool;
+    std::vector<vk::UniqueCommandBuffer> buffers;
+    std::size_t buffersUsed = 0;
+    std::uint64_t lastBatch = 0;
+  };
+
+  const GpuWorkCount& workCount;
+  vk::Device device;
+
+  GpuSharedResource<std::vector<ThreadPool>> pools;
+};
+
+} // namespace etna
+
+
+#endif // ETNA_SECONDARY_CMD_MGR_HPP_INCLUDED
@@ -7,19 +7,65 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include <filesystem>
+#include <span>
+#include <string_view>
 
 #include <etna/Vulkan.hpp>
 #include <etna/Forward.hpp>
 #include <etna/DescriptorSetLayout.hpp>
+#include <etna/detail/RcuCell.hpp>
 
 
 namespace etna
 {
 
+class GlobalContext;
+
+// Parts of a program's descriptor set layouts that can't be deduced from SPIR-V reflection
+struct ShaderProgramLayoutOptions
+{
+  // Samplers baked into descriptor set layouts. Descriptor writes for such bindings
+  // don't need a sampler, and drivers are free to embed it into the shader code,
+  // which is cheaper for commonly used samplers, e.g. linear clamp-to-edge ones.
+  // NOTE: the sampler must outlive the program.
+  struct ImmutableSampler
+  {
+    uint32_t set;
+    uint32_t binding;
+    vk::Sampler sampler;
+  };
+  std::vector<ImmutableSampler> immutableSamplers;
+
+  // Uniform blocks to be turned into inline uniform blocks, whose contents live in
+  // the descriptor set itself and are written with InlineBinding, which saves a buffer
+  // and an indirection for small constants, e.g. material parameters.
+  // NOTE: requires OptionalFeatures::inlineUniformBlock, and blocks must not be bigger
+  // than maxInlineUniformBlockSize of the device, which is only guaranteed to be 256 bytes.
+  struct InlineUniformBlock
+  {
+    uint32_t set;
+    uint32_t binding;
+  };
+  std::vector<InlineUniformBlock> inlineUniformBlocks;
+};
+
+// SPIR-V that is compiled into the executable instead of being read from a file
+struct EmbeddedShader
+{
+  // Identifies the shader in place of a file path, e.g. in error messages
+  std::string_view name;
+  std::span<const uint32_t> code;
+};
+
 struct ShaderModule
 {
-  ShaderModule(vk::Device device, std::filesystem::path shader_path);
+  // Embedded code is used instead of reading the file at shader_path, also on reloads
+  ShaderModule(
+    vk::Device device,
+    std::filesystem::path shader_path,
+    std::span<const uint32_t> embedded_code = {});
 
   void reload(vk::Device device);
 
@@ -34,6 +80,7 @@ struct ShaderModule
 
 private:
   std::filesystem::path path{};
+  std::span<const uint32_t> embeddedCode{};
   std::string entryPoint{};
   vk::ShaderStageFlagBits stage;
 
@@ -68,13 +115,25 @@ private:
   friend ShaderProgramManager;
 };
 
+// Programs are looked up lock-free from any thread, loading takes a lock.
+// Reloading and clearing must not overlap with any other use of the manager.
 struct ShaderProgramManager
 {
-  ShaderProgramManager() {}
+  explicit ShaderProgramManager(GlobalContext& ctx)
+    : context{ctx}
+  {
+  }
   ~ShaderProgramManager() { clear(); }
 
   ShaderProgramId loadProgram(
-    const char* name, std::span<std::filesystem::path const> shaders_path);
+    const char* name,
+    std::span<std::filesystem::path const> shaders_path,
+    ShaderProgramLayoutOptions layout_options = {});
+  // The code must outlive the manager, e.g. be a static array
+  ShaderProgramId loadEmbeddedProgram(
+    const char* name,
+    std::span<const EmbeddedShader> shaders,
+    ShaderProgramLayoutOptions layout_options = {});
   ShaderProgramId tryGetProgram(const char* name) const;
   ShaderProgramId getProgram(const char* name) const;
 
@@ -90,6 +149,8 @@ struct ShaderProgramManager
 
   void reloadPrograms();
   void clear();
+  // Frees the snapshots replaced long enough ago, called by begin_frame
+  void collectRetiredSnapshots();
 
   vk::PipelineLayout getProgramLayout(ShaderProgramId id) const
   {
@@ -99,7 +160,7 @@ struct ShaderProgramManager
 
   DescriptorLayoutId getDescriptorLayoutId(ShaderProgramId id, uint32_t set) const
   {
-    auto& prog = *programs.at(static_cast<std::underlying_type_t<ShaderProgramId>>(id));
+    auto& prog = getProgInternal(id);
     if (set >= MAX_PROGRAM_DESCRIPTORS || !prog.usedDescriptors.test(set))
       ETNA_PANIC("ShaderProgram {} invalid descriptor set #{}", prog.name, set);
     return prog.descriptorIds[set];
@@ -124,19 +185,26 @@ private:
   std::unordered_map<std::filesystem::path, uint32_t, PathHash> shaderModuleNames;
   std::vector<std::unique_ptr<ShaderModule>> shaderModules;
 
-  uint32_t registerModule(std::filesystem::path path);
+  uint32_t registerModule(
+    std::filesystem::path path, std::span<const uint32_t> embedded_code = {});
+  // Must be called with the mutex locked
+  ShaderProgramId addProgram(
+    const char* name, std::vector<uint32_t> module_ids, ShaderProgramLayoutOptions layout_options);
   const ShaderModule& getModule(uint32_t id) const { return *shaderModules.at(id); }
 
   struct ShaderProgramInternal
   {
-    ShaderProgramInternal(std::string in_name, std::vector<uint32_t>&& mod)
+    ShaderProgramInternal(
+      std::string in_name, std::vector<uint32_t>&& mod, ShaderProgramLayoutOptions&& options)
       : name(std::move(in_name))
       , moduleIds{std::move(mod)}
+      , layoutOptions{std::move(options)}
     {
     }
 
     std::string name;
     std::vector<uint32_t> moduleIds;
+    ShaderProgramLayoutOptions layoutOptions;
 
     std::bitset<MAX_PROGRAM_DESCRIPTORS> usedDescriptors;
     std::array<DescriptorLayoutId, MAX_PROGRAM_DESCRIPTORS> descriptorIds;
@@ -147,12 +215,24 @@ private:
     void reload(ShaderProgramManager& manager);
   };
 
-  std::unordered_map<std::string, ShaderProgramId> programNames;
+  // Owned by the writer side, readers only see the programs published in the snapshot
   std::vector<std::unique_ptr<ShaderProgramInternal>> programs;
 
+  struct Snapshot
+  {
+    std::unordered_map<std::string, ShaderProgramId> names;
+    std::vector<const ShaderProgramInternal*> programs;
+  };
+  detail::RcuCell<Snapshot> snapshot;
+  // Guards programs and shader modules
+  mutable std::mutex mutex;
+
+  // Programs are bound to the device and the layout cache of this context
+  GlobalContext& context;
+
   const ShaderProgramInternal& getProgInternal(ShaderProgramId id) const
   {
-    return *programs.at(static_cast<std::underlying_type_t<ShaderProgramId>>(id));
+    return *snapshot.read()->programs.at(static_cast<std::underlying_type_t<ShaderProgramId>>(id));
   }
 
   friend ShaderProgramInfo;
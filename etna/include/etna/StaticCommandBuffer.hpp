@@ -0,0 +1,125 @@
+#pragma once
+#ifndef ETNA_STATIC_COMMAND_BUFFER_HPP_INCLUDED
+#define ETNA_STATIC_COMMAND_BUFFER_HPP_INCLUDED
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/GpuWorkCount.hpp>
+
+
+namespace etna
+{
+
+class StaticRecordingRetireList;
+
+/**
+ * A secondary command buffer that is recorded once and executed every frame,
+ * for passes that don't change between frames, e.g. a shadow map of static
+ * geometry or a fixed post-processing chain. While recording, set_state and
+ * create_descriptor_set work as usual: barriers between the recorded commands
+ * are recorded into the buffer, while the states in which resources are first
+ * used are remembered and transitioned to on the primary buffer before every
+ * execution. Descriptor sets created while recording live as long as it does.
+ * The commands are re-recorded only after invalidate(), e.g. when some of the
+ * resources they use were recreated. Dropped commands are handed to the retire
+ * list of the context, so neither invalidating nor destroying the buffer waits
+ * for the GPU.
+ * NOTE: PushData, profiling zones and RenderTargetState::recordInSecondaryBuffers
+ * rely on per-frame state and must not be used while recording.
+ */
+class StaticCommandBuffer
+{
+public:
+  struct Dependencies
+  {
+    const GpuWorkCount& workCount;
+    StaticRecordingRetireList& retireList;
+    vk::Device device;
+
+    std::uint32_t queueFamily;
+    bool inlineUniformBlocks;
+  };
+
+  explicit StaticCommandBuffer(const Dependencies& deps);
+  ~StaticCommandBuffer();
+
+  StaticCommandBuffer(const StaticCommandBuffer&) = delete;
+  StaticCommandBuffer& operator=(const StaticCommandBuffer&) = delete;
+  StaticCommandBuffer(StaticCommandBuffer&&) = delete;
+  StaticCommandBuffer& operator=(StaticCommandBuffer&&) = delete;
+
+  // Whether the commands have to be recorded before the next execute
+  bool needsRecording() const { return current == nullptr; }
+
+  // Drops the recorded commands, the GPU may still be executing them for a few frames
+  void invalidate();
+
+  // Starts recording into a fresh command buffer, dropping the previous commands
+  vk::CommandBuffer beginRecording();
+  void endRecording();
+
+  // Records the commands with record(cmd_buf) unless they are recorded already
+  template <class F>
+  void recordIfNeeded(F&& record)
+  {
+    if (!needsRecording())
+      return;
+    record(beginRecording());
+    endRecording();
+  }
+
+  // Transitions the used resources into the expected states and executes the commands
+  void execute(vk::CommandBuffer cmd_buf);
+
+private:
+  friend class StaticRecordingRetireList;
+  struct Recording;
+
+  void retireCurrent();
+
+  const GpuWorkCount& workCount;
+  StaticRecordingRetireList& retireList;
+  vk::Device device;
+  std::uint32_t queueFamily;
+  bool inlineUniformBlocks;
+
+  std::unique_ptr<Recording> current;
+  bool recording = false;
+};
+
+/**
+ * Recordings of static command buffers that the GPU might still be executing,
+ * owned by the context. A recording is destroyed once the frames that executed
+ * it last are done, which is checked on every retire and in begin_frame.
+ */
+class StaticRecordingRetireList
+{
+public:
+  explicit StaticRecordingRetireList(const GpuWorkCount& work_count);
+  ~StaticRecordingRetireList();
+
+  StaticRecordingRetireList(const StaticRecordingRetireList&) = delete;
+  StaticRecordingRetireList& operator=(const StaticRecordingRetireList&) = delete;
+
+  // Destroys the recordings the GPU is done with
+  void collect();
+
+private:
+  friend class StaticCommandBuffer;
+
+  void retire(std::unique_ptr<StaticCommandBuffer::Recording> recording);
+  void collectLocked();
+
+  const GpuWorkCount& workCount;
+
+  // Static command buffers may be destroyed on any thread
+  std::mutex mutex;
+  std::vector<std::unique_ptr<StaticCommandBuffer::Recording>> retired;
+};
+
+} // namespace etna
+
+#endif // ETNA_STATIC_COMMAND_BUFFER_HPP_INCLUDED
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef ETNA_TEXTURE_CACHE_HPP_INCLUDED
+#define ETNA_TEXTURE_CACHE_HPP_INCLUDED
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+namespace etna
+{
+
+// Description of a GPU-ready texture payload
+struct TextureDesc
+{
+  vk::Format format;
+  vk::Extent3D extent;
+  std::uint32_t mipLevels = 1;
+  std::uint32_t layers = 1;
+
+  bool operator==(const TextureDesc& other) const = default;
+};
+
+/**
+ * A cached texture payload mapped into memory. Subresources are stored mip by
+ * mip, every mip layer by layer, with tightly packed rows starting at offsets
+ * aligned for buffer to image copies, so the payload can be copied into a staging
+ * buffer as a whole. See BlockingTransferHelper::uploadImage.
+ */
+class MappedTexture
+{
+public:
+  struct Subresource
+  {
+    std::uint32_t mipLevel;
+    std::uint32_t layer;
+    vk::Extent3D extent;
+    // Relative to the start of the payload
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  MappedTexture(const MappedTexture&) = delete;
+  MappedTexture& operator=(const MappedTexture&) = delete;
+  MappedTexture(MappedTexture&& other) noexcept;
+  MappedTexture& operator=(MappedTexture&& other) noexcept;
+  ~MappedTexture();
+
+  const TextureDesc& getDesc() const { return desc; }
+  const std::vector<Subresource>& getSubresources() const { return subresources; }
+  std::span<const std::byte> getPayload() const { return payload; }
+  std::span<const std::byte> getData(const Subresource& subresource) const
+  {
+    return payload.subspan(subresource.offset, subresource.size);
+  }
+
+private:
+  friend class TextureCache;
+  MappedTexture(void* mapping, std::size_t mapping_size);
+
+  void* mapping = nullptr;
+  std::size_t mappingSize = 0;
+
+  TextureDesc desc{};
+  std::vector<Subresource> subresources;
+  std::span<const std::byte> payload;
+};
+
+/**
+ * Content-addressed on-disk cache of textures that were decoded, converted and
+ * mip-mapped already, so that warm starts only have to map the files and copy
+ * them into staging memory. Entries are keyed by a hash of the source file and
+ * one of the processing parameters, hence changing either of them simply misses
+ * the cache. Stale or corrupted files are treated as misses as well.
+ */
+class TextureCache
+{
+public:
+  struct CreateInfo
+  {
+    std::filesystem::path directory;
+  };
+
+  struct Key
+  {
+    std::uint64_t sourceHash;
+    std::uint64_t paramsHash;
+
+    bool operator==(const Key& other) const = default;
+  };
+
+  explicit TextureCache(CreateInfo info);
+
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+  TextureCache(TextureCache&&) = delete;
+  TextureCache& operator=(TextureCache&&) = delete;
+
+  static std::uint64_t hashBytes(std::span<const std::byte> bytes);
+
+  // Params must be a plain struct without padding, e.g. of the target format and mip count
+  template <class Params>
+    requires std::has_unique_object_representations_v<Params>
+  static Key makeKey(std::span<const std::byte> source, const Params& params)
+  {
+    return Key{
+      .sourceHash = hashBytes(source),
+      .paramsHash = hashBytes(std::as_bytes(std::span{&params, 1})),
+    };
+  }
+
+  std::optional<MappedTexture> load(const Key& key) const;
+
+  // Subresources must be given in the order described by MappedTexture, with
+  // tightly packed rows. The file is written atomically, so concurrently running
+  // instances of the application never see partially written entries.
+  void store(
+    const Key& key,
+    const TextureDesc& desc,
+    std::span<const std::span<const std::byte>> subresources) const;
+
+  // Sizes and offsets of the subresources of a texture in a cached payload
+  static std::vector<MappedTexture::Subresource> layoutSubresources(const TextureDesc& desc);
+
+private:
+  std::filesystem::path getPath(const Key& key) const;
+
+  std::filesystem::path directory;
+};
+
+} // namespace etna
+
+#endif // ETNA_TEXTURE_CACHE_HPP_INCLUDED
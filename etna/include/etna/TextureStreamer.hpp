@@ -0,0 +1,129 @@
+#pragma once
+#ifndef ETNA_TEXTURE_STREAMER_HPP_INCLUDED
+#define ETNA_TEXTURE_STREAMER_HPP_INCLUDED
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GpuSharedResource.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+
+namespace etna
+{
+
+class MappedTexture;
+
+/**
+ * Streams textures in progressively, from the smallest mips to the largest ones.
+ * When a texture is added, its full mip chain is allocated, but only the smallest
+ * mips are uploaded right away, so it can be sampled after a few milliseconds.
+ * The rest is copied by update a few rows at a time, within a per-frame byte
+ * budget, and the views returned by genBinding are clamped to the mips that
+ * have arrived so far. Hence quality converges over the next frames while level
+ * loads stay short and VRAM doesn't spike with staging memory.
+ * NOTE: only 2D textures (including arrays and cubes) can be streamed.
+ */
+class TextureStreamer
+{
+public:
+  struct CreateInfo
+  {
+    // Bytes of texel data copied by every update call at most
+    vk::DeviceSize bytesPerFrame = 8 << 20;
+  };
+
+  enum class TextureId : std::uint32_t
+  {
+    eInvalid = ~0u
+  };
+
+  // Returns tightly packed texels of a subresource. Called every time the subresource
+  // is streamed, possibly over several frames, so the data must stay the same and
+  // must stay alive until isStreamed returns true or the texture is removed.
+  using SubresourceSource =
+    std::function<std::span<const std::byte>(std::uint32_t mip, std::uint32_t layer)>;
+
+  struct TextureInfo
+  {
+    // Transfer dst and sampled usages are added automatically
+    Image::CreateInfo image;
+    SubresourceSource source;
+
+    // Amount of the smallest mips that add uploads before returning
+    std::uint32_t initialMips = 1;
+  };
+
+  explicit TextureStreamer(CreateInfo info);
+
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+  TextureStreamer(TextureStreamer&&) = delete;
+  TextureStreamer& operator=(TextureStreamer&&) = delete;
+
+  TextureId add(OneShotCmdMgr& cmd_mgr, TextureInfo info);
+
+  // Streams a texture loaded from a TextureCache, which is kept mapped until
+  // it is streamed completely.
+  TextureId add(
+    OneShotCmdMgr& cmd_mgr,
+    MappedTexture texture,
+    std::string_view name,
+    std::uint32_t initial_mips = 1);
+
+  // The texture is destroyed once the GPU is done with it
+  void remove(TextureId id);
+
+  const Image& getImage(TextureId id) const;
+
+  // The most detailed mip that may be sampled, it only ever decreases
+  std::uint32_t getFirstResidentMip(TextureId id) const;
+  bool isStreamed(TextureId id) const { return getFirstResidentMip(id) == 0; }
+
+  // Binds a view that only exposes resident mips: through the view's min LOD when
+  // the device supports it, otherwise by starting the view at the first resident mip.
+  ImageBinding genBinding(TextureId id, vk::Sampler sampler) const;
+
+  // Records copies of the next chunks of texel data into cmd_buf. Should be called
+  // once per frame, before the descriptor sets of the textures are created.
+  void update(vk::CommandBuffer cmd_buf);
+
+private:
+  struct Texture
+  {
+    Image image;
+    std::string name;
+    SubresourceSource source;
+    std::uint32_t firstResidentMip;
+
+    // Progress of streaming mip firstResidentMip - 1
+    std::uint32_t nextLayer = 0;
+    std::uint32_t nextBlockRow = 0;
+  };
+  struct Retired
+  {
+    Image image;
+    std::uint64_t retireBatch;
+  };
+
+  Texture& getTexture(TextureId id);
+  const Texture& getTexture(TextureId id) const;
+
+  vk::DeviceSize bytesPerFrame;
+  GpuSharedResource<Buffer> staging;
+
+  // Removed textures leave holes, so that ids stay stable
+  std::vector<std::optional<Texture>> textures;
+  std::vector<Retired> retired;
+};
+
+} // namespace etna
+
+#endif // ETNA_TEXTURE_STREAMER_HPP_INCLUDED
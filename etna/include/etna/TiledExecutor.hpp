@@ -0,0 +1,140 @@
+#pragma once
+#ifndef ETNA_TILED_EXECUTOR_HPP_INCLUDED
+#define ETNA_TILED_EXECUTOR_HPP_INCLUDED
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GpuWorkCount.hpp>
+#include <etna/DescriptorSet.hpp>
+
+
+namespace etna
+{
+
+/**
+ * Runs compute work over images that don't fit into device memory, tile by tile.
+ * Every tile is uploaded along with a halo of neighbouring pixels, processed by
+ * a dispatch that the caller records, and read back into the output image as soon
+ * as its fence signals. Several tiles are in flight at once, each in its own slot,
+ * so the CPU work on some tiles overlaps with the GPU work on others. The upload of
+ * a tile and the readback of the previous tile of its slot are copied by worker
+ * threads while the calling thread records the commands, so the throughput is
+ * bounded by the slowest stage rather than by their sum. With a
+ * compute only context, slots are spread over all of its compute queues, so the
+ * transfers and dispatches of different tiles overlap on the GPU as well.
+ * NOTE: the queues must not be used by other threads while run is working.
+ */
+class TiledExecutor
+{
+public:
+  struct CreateInfo
+  {
+    // Formats must be uncompressed, images on the CPU are tightly packed pixels of them
+    vk::Format inputFormat;
+    vk::Format outputFormat;
+
+    // Size of the output region computed by a single dispatch
+    vk::Extent2D tileExtent;
+    // Pixels around every tile that the dispatch reads, e.g. the radius of a filter
+    std::uint32_t halo = 0;
+
+    // Tiles that are uploaded, processed and read back at once, at most
+    // MAX_FRAMES_INFLIGHT, as every tile in flight is a batch of work.
+    std::uint32_t tilesInFlight = 3;
+
+    // Transfer usages are added automatically
+    vk::ImageUsageFlags inputUsage = vk::ImageUsageFlagBits::eStorage;
+    vk::ImageUsageFlags outputUsage = vk::ImageUsageFlagBits::eStorage;
+  };
+
+  struct Tile
+  {
+    std::uint32_t index;
+    // Region of the whole image that the dispatch has to write into output
+    vk::Offset2D offset;
+    vk::Extent2D extent;
+    // Region of the whole image in input, which is the tile with its halo clamped
+    // to the borders of the image. Its top left pixel is pixel (0, 0) of input.
+    vk::Offset2D inputOffset;
+    vk::Extent2D inputExtent;
+
+    const Image& input;
+    // The tile is read back from the top left corner of output
+    const Image& output;
+  };
+
+  // Binds a pipeline and dispatches it for the tile. Descriptor sets have
+  // to be created with createDescriptorSet of the executor.
+  using RecordTile = std::function<void(vk::CommandBuffer cmd_buf, const Tile& tile)>;
+
+  struct InputImage
+  {
+    std::span<const std::byte> pixels;
+    vk::Extent2D extent;
+  };
+
+  explicit TiledExecutor(CreateInfo info);
+
+  TiledExecutor(const TiledExecutor&) = delete;
+  TiledExecutor& operator=(const TiledExecutor&) = delete;
+  TiledExecutor(TiledExecutor&&) = delete;
+  TiledExecutor& operator=(TiledExecutor&&) = delete;
+
+  // Processes the whole image, blocks until the last tile is written into output,
+  // which has the same extent as the input.
+  void run(const InputImage& input, std::span<std::byte> output, const RecordTile& record);
+
+  // The context's descriptor pool is only recycled by frames, which batch jobs don't
+  // have, so sets for the dispatches are recycled along with the slots of the tiles.
+  DescriptorSet createDescriptorSet(
+    DescriptorLayoutId layout, vk::CommandBuffer cmd_buf, std::vector<Binding> bindings);
+
+private:
+  struct Slot
+  {
+    vk::Queue queue;
+    vk::UniqueCommandPool pool;
+    vk::CommandBuffer cmdBuf;
+    vk::UniqueFence fence;
+
+    Buffer upload;
+    Image input;
+    Image output;
+    Buffer readback;
+
+    // The tile that is being processed in the slot, if any
+    std::optional<vk::Rect2D> pending;
+    // Copy of the finished tile out of readback, done before the slot is reused
+    std::future<void> readbackCopy;
+  };
+
+  void submitTile(
+    Slot& slot,
+    const InputImage& input,
+    const vk::Rect2D& tile,
+    std::uint32_t index,
+    const RecordTile& record);
+  void finishTile(Slot& slot, std::span<std::byte> output, std::uint32_t image_width);
+
+  vk::Device device;
+  CreateInfo info;
+  std::size_t inputPixelSize;
+  std::size_t outputPixelSize;
+
+  // Every tile is a batch, so the descriptor pool recycles the sets of finished slots
+  GpuWorkCount workCount;
+  DynamicDescriptorPool descriptorPool;
+  std::vector<Slot> slots;
+};
+
+} // namespace etna
+
+#endif // ETNA_TILED_EXECUTOR_HPP_INCLUDED
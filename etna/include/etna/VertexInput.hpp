@@ -69,6 +69,10 @@ struct VertexShaderInputDescription
     // byte stream description should be used for this variable.
     // Default is identity i -> i mapping.
     std::vector<uint32_t> attributeMapping = byteStreamDescription.identityAttributeMapping();
+
+    // Location of the variable that `attributeMapping[0]` feeds. Locations have to
+    // be unique among all bindings, so every binding but the first one needs this.
+    uint32_t firstLocation = 0;
   };
 
   // Note that the `binding` annotation value that you specified in GLSL
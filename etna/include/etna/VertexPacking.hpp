@@ -0,0 +1,80 @@
+#pragma once
+#ifndef ETNA_VERTEX_PACKING_HPP_INCLUDED
+#define ETNA_VERTEX_PACKING_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <etna/VertexInput.hpp>
+
+
+namespace etna
+{
+
+enum class PositionEncoding : std::uint32_t
+{
+  // R32G32B32_SFLOAT, lossless
+  eFloat,
+  // R16G16B16A16_SFLOAT relative to the center of the mesh bounds
+  eHalf,
+  // R16G16B16A16_SNORM normalized to the mesh bounds, uniform precision over the mesh
+  eSnorm16,
+};
+
+// Attributes of a mesh as they usually come out of model loaders
+struct MeshAttributes
+{
+  std::span<const std::array<float, 3>> positions;
+  // Optional, must have as many elements as positions when present.
+  // Normals must be normalized.
+  std::span<const std::array<float, 3>> normals;
+  std::span<const std::array<float, 2>> texCoords;
+};
+
+// Decoded value is encoded * scale + offset, component-wise. Both are
+// vec4s, so the parameters can be put into push constants or UBOs as is.
+struct AttributeDecodeParams
+{
+  std::array<float, 4> scale = {1.0f, 1.0f, 1.0f, 1.0f};
+  std::array<float, 4> offset = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+/**
+ * A mesh with quantized attributes, split into two vertex streams. The hot one
+ * only contains positions, so depth and shadow passes fetch a fraction of the
+ * bytes, while the cold one contains the rest of the attributes:
+ *  - normals are octahedral encoded into R16G16_SNORM, decoded in the shader as
+ *    n = vec3(e, 1 - |e.x| - |e.y|); if (n.z < 0) n.xy = (1 - |n.yx|) * sign(n.xy);
+ *    followed by normalize(n), where sign of zero is treated as positive;
+ *  - texture coordinates are normalized to their bounds and stored as R16G16_UNORM,
+ *    so coordinates of tiled textures outside of [0, 1] are supported.
+ * Shader locations are position, normal and texCoord in that order, missing ones
+ * are skipped. Positions and texture coordinates are decoded with the parameters.
+ */
+struct PackedMesh
+{
+  std::uint32_t vertexCount = 0;
+
+  std::vector<std::byte> positionStream;
+  VertexByteStreamFormatDescription positionFormat;
+  AttributeDecodeParams positionDecode;
+
+  // Empty when the mesh has neither normals nor texture coordinates
+  std::vector<std::byte> attributeStream;
+  VertexByteStreamFormatDescription attributeFormat;
+  AttributeDecodeParams texCoordDecode;
+
+  // Vertex input with positions at binding 0 and the cold stream at binding 1.
+  // Depth only input skips the cold stream, so its buffer doesn't have to be bound.
+  VertexShaderInputDescription getVertexInput(bool depth_only = false) const;
+};
+
+PackedMesh pack_mesh(
+  const MeshAttributes& mesh, PositionEncoding position_encoding = PositionEncoding::eSnorm16);
+
+} // namespace etna
+
+#endif // ETNA_VERTEX_PACKING_HPP_INCLUDED
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef ETNA_DETAIL_RCU_CELL_INCLUDED
+#define ETNA_DETAIL_RCU_CELL_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <etna/EtnaConfig.hpp>
+
+
+namespace etna::detail
+{
+
+/**
+ * Holds an immutable snapshot of T that can be read without locks while a writer
+ * publishes new versions, read-copy-update style. A read is a single acquire load,
+ * and readers must not keep the snapshot past the call that read it. Replaced
+ * versions are freed by collect, which the owner calls at the start of every frame,
+ * once MAX_FRAMES_INFLIGHT frames have started since, or by reclaim, which the owner
+ * calls when no reader can be running, e.g. on shader reloads.
+ * NOTE: writers, including collect and reclaim, have to be serialized by the owner.
+ */
+template <class T>
+class RcuCell
+{
+public:
+  RcuCell()
+    : RcuCell(T{})
+  {
+  }
+
+  explicit RcuCell(T initial) { publish(std::move(initial)); }
+
+  RcuCell(const RcuCell&) = delete;
+  RcuCell& operator=(const RcuCell&) = delete;
+
+  RcuCell(RcuCell&&) = delete;
+  RcuCell& operator=(RcuCell&&) = delete;
+
+  const T* read() const noexcept { return current.load(std::memory_order_acquire); }
+
+  // For writers only, as versions are freed by them
+  const T& latest() const noexcept { return *owned; }
+
+  void publish(T next)
+  {
+    auto replaced = std::exchange(owned, std::make_unique<const T>(std::move(next)));
+    current.store(owned.get(), std::memory_order_release);
+    if (replaced != nullptr)
+      retired.push_back(Retired{.version = std::move(replaced), .frame = frame});
+  }
+
+  void collect()
+  {
+    ++frame;
+    std::erase_if(retired, [this](const Retired& old) {
+      return old.frame + MAX_FRAMES_INFLIGHT <= frame;
+    });
+  }
+
+  void reclaim() { retired.clear(); }
+
+private:
+  struct Retired
+  {
+    std::unique_ptr<const T> version;
+    std::uint64_t frame;
+  };
+
+  std::atomic<const T*> current{nullptr};
+  std::unique_ptr<const T> owned;
+  std::vector<Retired> retired;
+  // Frames started since the cell was created, as seen by collect
+  std::uint64_t frame = 0;
+};
+
+} // namespace etna::detail
+
+#endif // ETNA_DETAIL_RCU_CELL_INCLUDED
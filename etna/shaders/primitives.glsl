@@ -0,0 +1,164 @@
+// Work group wide building blocks of the GPU primitives, see source/GpuPrimitives.cpp.
+// When compiled with ETNA_USE_SUBGROUPS, subgroup arithmetic does most of the work,
+// otherwise everything goes through shared memory.
+// NOTE: the subgroup versions expect invocations to be assigned to subgroups in the
+// order of gl_LocalInvocationIndex, which is what all known implementations do.
+
+#ifdef ETNA_USE_SUBGROUPS
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+#define GROUP_SIZE 256u
+#define ITEMS_PER_THREAD 4u
+#define BLOCK_SIZE (GROUP_SIZE * ITEMS_PER_THREAD)
+
+layout(local_size_x = 256) in;
+
+const uint OP_ADD = 0;
+const uint OP_MIN = 1;
+const uint OP_MAX = 2;
+
+uint identity_of(uint op)
+{
+  return op == OP_MIN ? 0xFFFFFFFFu : 0u;
+}
+
+uint apply_op(uint op, uint a, uint b)
+{
+  if (op == OP_MIN)
+    return min(a, b);
+  if (op == OP_MAX)
+    return max(a, b);
+  return a + b;
+}
+
+#ifdef ETNA_USE_SUBGROUPS
+
+// A work group has at most GROUP_SIZE subgroups
+shared uint subgroupTotals[GROUP_SIZE];
+shared uvec4 subgroupTotals4[GROUP_SIZE];
+
+// Returns the sum of the values of the previous invocations of the work group
+uint group_exclusive_add(uint value, out uint total)
+{
+  const uint subgroupPrefix = subgroupExclusiveAdd(value);
+  const uint subgroupTotal = subgroupAdd(value);
+  if (subgroupElect())
+    subgroupTotals[gl_SubgroupID] = subgroupTotal;
+  barrier();
+
+  uint offset = 0u;
+  total = 0u;
+  for (uint i = 0u; i < gl_NumSubgroups; ++i)
+  {
+    if (i == gl_SubgroupID)
+      offset = total;
+    total += subgroupTotals[i];
+  }
+  barrier();
+  return offset + subgroupPrefix;
+}
+
+uvec4 group_exclusive_add4(uvec4 value, out uvec4 total)
+{
+  const uvec4 subgroupPrefix = subgroupExclusiveAdd(value);
+  const uvec4 subgroupTotal = subgroupAdd(value);
+  if (subgroupElect())
+    subgroupTotals4[gl_SubgroupID] = subgroupTotal;
+  barrier();
+
+  uvec4 offset = uvec4(0u);
+  total = uvec4(0u);
+  for (uint i = 0u; i < gl_NumSubgroups; ++i)
+  {
+    if (i == gl_SubgroupID)
+      offset = total;
+    total += subgroupTotals4[i];
+  }
+  barrier();
+  return offset + subgroupPrefix;
+}
+
+uint subgroup_reduce(uint op, uint value)
+{
+  if (op == OP_MIN)
+    return subgroupMin(value);
+  if (op == OP_MAX)
+    return subgroupMax(value);
+  return subgroupAdd(value);
+}
+
+uint group_reduce(uint op, uint value)
+{
+  const uint reduced = subgroup_reduce(op, value);
+  if (subgroupElect())
+    subgroupTotals[gl_SubgroupID] = reduced;
+  barrier();
+
+  uint result = subgroupTotals[0];
+  for (uint i = 1u; i < gl_NumSubgroups; ++i)
+    result = apply_op(op, result, subgroupTotals[i]);
+  barrier();
+  return result;
+}
+
+#else
+
+shared uint scratch[GROUP_SIZE];
+shared uvec4 scratch4[GROUP_SIZE];
+
+// Hillis-Steele scan: log2(GROUP_SIZE) steps over shared memory
+uint group_exclusive_add(uint value, out uint total)
+{
+  const uint index = gl_LocalInvocationIndex;
+  scratch[index] = value;
+  for (uint offset = 1u; offset < GROUP_SIZE; offset <<= 1u)
+  {
+    barrier();
+    const uint other = index >= offset ? scratch[index - offset] : 0u;
+    barrier();
+    scratch[index] += other;
+  }
+  barrier();
+  total = scratch[GROUP_SIZE - 1u];
+  const uint inclusive = scratch[index];
+  barrier();
+  return inclusive - value;
+}
+
+uvec4 group_exclusive_add4(uvec4 value, out uvec4 total)
+{
+  const uint index = gl_LocalInvocationIndex;
+  scratch4[index] = value;
+  for (uint offset = 1u; offset < GROUP_SIZE; offset <<= 1u)
+  {
+    barrier();
+    const uvec4 other = index >= offset ? scratch4[index - offset] : uvec4(0u);
+    barrier();
+    scratch4[index] += other;
+  }
+  barrier();
+  total = scratch4[GROUP_SIZE - 1u];
+  const uvec4 inclusive = scratch4[index];
+  barrier();
+  return inclusive - value;
+}
+
+uint group_reduce(uint op, uint value)
+{
+  const uint index = gl_LocalInvocationIndex;
+  scratch[index] = value;
+  for (uint stride = GROUP_SIZE / 2u; stride > 0u; stride >>= 1u)
+  {
+    barrier();
+    if (index < stride)
+      scratch[index] = apply_op(op, scratch[index], scratch[index + stride]);
+  }
+  barrier();
+  const uint result = scratch[0];
+  barrier();
+  return result;
+}
+
+#endif
@@ -5,6 +5,8 @@
 
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
+#include <etna/TextureCache.hpp>
+#include "StagingCopier.hpp"
 
 
 namespace etna
@@ -20,10 +22,15 @@ BlockingTransferHelper::BlockingTransferHelper(CreateInfo info)
         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
       .name = "BlockingTransferHelper::stagingBuffer",
     })}
+  , ownCopier{
+      info.copyThreadCount != 0 ? std::make_unique<StagingCopier>(info.copyThreadCount) : nullptr}
+  , copier{ownCopier != nullptr ? ownCopier.get() : &get_context().getStagingCopier()}
 {
   stagingBuffer.map();
 }
 
+BlockingTransferHelper::~BlockingTransferHelper() = default;
+
 void BlockingTransferHelper::uploadBuffer(
   OneShotCmdMgr& cmd_mgr, Buffer& dst, std::uint32_t offset, std::span<std::byte const> src)
 {
@@ -35,7 +42,7 @@ void BlockingTransferHelper::uploadBuffer(
     const vk::DeviceSize batchSize =
       std::min(static_cast<vk::DeviceSize>(src.size() - currPos), stagingSize);
 
-    std::memcpy(stagingBuffer.data(), src.data() + currPos, batchSize);
+    copier->copy(stagingBuffer.data(), src.data() + currPos, batchSize);
 
     auto cmdBuf = cmd_mgr.start();
 
@@ -104,20 +111,140 @@ void BlockingTransferHelper::uploadImage(
   uint32_t mip_level,
   uint32_t layer,
   std::span<std::byte const> src)
+{
+  uploadImageRows(cmd_mgr, dst, mip_level, layer, src, std::nullopt);
+}
+
+void BlockingTransferHelper::uploadImage(
+  OneShotCmdMgr& cmd_mgr,
+  Image& dst,
+  uint32_t mip_level,
+  uint32_t layer,
+  std::span<std::byte const> src,
+  PixelSource source)
+{
+  ETNA_VERIFYF(
+    can_convert_pixels(dst.getFormat()),
+    "Can't convert pixels into the {} format!",
+    vk::to_string(dst.getFormat()));
+  uploadImageRows(cmd_mgr, dst, mip_level, layer, src, source);
+}
+
+void BlockingTransferHelper::uploadImage(
+  OneShotCmdMgr& cmd_mgr, Image& dst, const MappedTexture& texture)
+{
+  const auto& desc = texture.getDesc();
+  ETNA_VERIFYF(
+    desc.format == dst.getFormat() && desc.extent == dst.getExtent() &&
+      desc.mipLevels <= dst.getMipLevelCount() && desc.layers <= dst.getLayerCount(),
+    "The cached texture doesn't match the image it's uploaded into!");
+
+  const auto& subresources = texture.getSubresources();
+  std::vector<vk::BufferImageCopy2> copies;
+  std::size_t first = 0;
+  while (first < subresources.size())
+  {
+    // As many consecutive subresources as fit, they are already laid out for copying
+    const vk::DeviceSize batchBegin = subresources[first].offset;
+    std::size_t last = first;
+    while (last < subresources.size() &&
+           subresources[last].offset + subresources[last].size - batchBegin <= stagingSize)
+      ++last;
+    ETNA_VERIFYF(
+      last > first,
+      "Unable to fit a single subresource into the staging buffer! Buffer size is {} bytes, "
+      "but the subresource is {} bytes!",
+      stagingSize,
+      subresources[first].size);
+
+    const vk::DeviceSize batchSize =
+      subresources[last - 1].offset + subresources[last - 1].size - batchBegin;
+    copier->copy(stagingBuffer.data(), texture.getPayload().data() + batchBegin, batchSize);
+
+    copies.clear();
+    for (std::size_t i = first; i < last; ++i)
+      copies.push_back(vk::BufferImageCopy2{
+        .bufferOffset = subresources[i].offset - batchBegin,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+          vk::ImageSubresourceLayers{
+            .aspectMask = dst.getAspectMaskByFormat(),
+            .mipLevel = subresources[i].mipLevel,
+            .baseArrayLayer = subresources[i].layer,
+            .layerCount = 1,
+          },
+        .imageOffset = vk::Offset3D{0, 0, 0},
+        .imageExtent = subresources[i].extent,
+      });
+
+    auto cmdBuf = cmd_mgr.start();
+
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    {
+      if (first == 0)
+      {
+        etna::set_state(
+          cmdBuf,
+          dst.get(),
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferWrite,
+          vk::ImageLayout::eTransferDstOptimal,
+          dst.getAspectMaskByFormat());
+        etna::flush_barriers(cmdBuf);
+      }
+
+      cmdBuf.copyBufferToImage2(vk::CopyBufferToImageInfo2{
+        .srcBuffer = stagingBuffer.get(),
+        .dstImage = dst.get(),
+        .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+        .regionCount = static_cast<std::uint32_t>(copies.size()),
+        .pRegions = copies.data(),
+      });
+
+      if (last == subresources.size())
+      {
+        etna::set_state(
+          cmdBuf,
+          dst.get(),
+          {},
+          {},
+          vk::ImageLayout::eShaderReadOnlyOptimal,
+          dst.getAspectMaskByFormat());
+        etna::flush_barriers(cmdBuf);
+      }
+    }
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+    cmd_mgr.submitAndWait(std::move(cmdBuf));
+    first = last;
+  }
+}
+
+void BlockingTransferHelper::uploadImageRows(
+  OneShotCmdMgr& cmd_mgr,
+  Image& dst,
+  uint32_t mip_level,
+  uint32_t layer,
+  std::span<std::byte const> src,
+  std::optional<PixelSource> source)
 {
   auto [w, h, d] = dst.getExtent();
 
   const std::size_t bytesPerPixel = vk::blockSize(dst.getFormat());
+  const std::size_t srcBytesPerPixel =
+    source.has_value() ? get_source_pixel_size(source->format) : bytesPerPixel;
 
   ETNA_ASSERTF(d == 1, "3D image uploads are not implemented yet!");
 
   ETNA_ASSERTF(
-    w * h * bytesPerPixel == src.size(),
+    w * h * srcBytesPerPixel == src.size(),
     "Image size mismatch between CPU and GPU! Expected {} bytes, but got {}!",
-    w * h * bytesPerPixel,
+    w * h * srcBytesPerPixel,
     src.size());
 
   const std::size_t bytesPerLine = w * bytesPerPixel;
+  const std::size_t srcBytesPerLine = w * srcBytesPerPixel;
   const std::size_t linesPerUpload = stagingSize / bytesPerLine;
   ETNA_ASSERTF(
     linesPerUpload > 0,
@@ -129,10 +256,19 @@ void BlockingTransferHelper::uploadImage(
   for (std::size_t uploadedLines = 0; uploadedLines < h; uploadedLines += linesPerUpload)
   {
     const std::size_t linesThisUpload = std::min(linesPerUpload, h - uploadedLines);
-    std::memcpy(
-      stagingBuffer.data(),
-      src.data() + uploadedLines * bytesPerLine,
-      linesThisUpload * bytesPerLine);
+    // Converting straight into the mapped staging memory spares an intermediate copy
+    if (source.has_value())
+      convert_pixels(
+        *source,
+        dst.getFormat(),
+        src.data() + uploadedLines * srcBytesPerLine,
+        stagingBuffer.data(),
+        linesThisUpload * w);
+    else
+      copier->copy(
+        stagingBuffer.data(),
+        src.data() + uploadedLines * bytesPerLine,
+        linesThisUpload * bytesPerLine);
 
     auto cmdBuf = cmd_mgr.start();
 
@@ -1,14 +1,17 @@
 #include <etna/Buffer.hpp>
 
 #include <etna/BindingItems.hpp>
+#include <etna/GlobalContext.hpp>
 #include "DebugUtils.hpp"
+#include "StateTracking.hpp"
 
 
 namespace etna
 {
 
 Buffer::Buffer(VmaAllocator alloc, CreateInfo info)
-  : allocator{alloc}
+  : context{&get_context()}
+  , allocator{alloc}
 {
   vk::BufferCreateInfo bufInfo{
     .size = info.size,
@@ -42,15 +45,26 @@ Buffer::Buffer(VmaAllocator alloc, CreateInfo info)
     "Error {} occurred while trying to allocate an etna::Buffer!",
     vk::to_string(static_cast<vk::Result>(retcode)));
   buffer = vk::Buffer(buf);
-  etna::set_debug_name(buffer, info.name.data());
+
+  VmaAllocatorInfo allocatorInfo;
+  vmaGetAllocatorInfo(allocator, &allocatorInfo);
+  etna::set_debug_name(vk::Device(allocatorInfo.device), buffer, info.name.data());
+
+  if (info.bufferUsage & vk::BufferUsageFlagBits::eShaderDeviceAddress)
+  {
+    const vk::BufferDeviceAddressInfo addressInfo{.buffer = buffer};
+    deviceAddress = vk::Device(allocatorInfo.device).getBufferAddress(addressInfo);
+  }
 }
 
 void Buffer::swap(Buffer& other)
 {
+  std::swap(context, other.context);
   std::swap(allocator, other.allocator);
   std::swap(allocation, other.allocation);
   std::swap(buffer, other.buffer);
   std::swap(mapped, other.mapped);
+  std::swap(deviceAddress, other.deviceAddress);
 }
 
 Buffer::Buffer(Buffer&& other) noexcept
@@ -82,10 +96,12 @@ void Buffer::reset()
   if (mapped != nullptr)
     unmap();
 
+  context->getResourceTracker().forget(buffer);
   vmaDestroyBuffer(allocator, VkBuffer(buffer), allocation);
   allocator = {};
   allocation = {};
   buffer = vk::Buffer{};
+  deviceAddress = {};
 }
 
 std::byte* Buffer::map()
@@ -110,9 +126,27 @@ void Buffer::unmap()
   mapped = nullptr;
 }
 
+void Buffer::invalidate(vk::DeviceSize offset, vk::DeviceSize size)
+{
+  auto retcode = vmaInvalidateAllocation(allocator, allocation, offset, size);
+  ETNA_VERIFYF(
+    retcode == VK_SUCCESS,
+    "Error {} occurred while trying to invalidate an etna::Buffer!",
+    vk::to_string(static_cast<vk::Result>(retcode)));
+}
+
 BufferBinding Buffer::genBinding(vk::DeviceSize offset, vk::DeviceSize range) const
 {
   return BufferBinding{*this, vk::DescriptorBufferInfo{get(), offset, range}};
 }
 
+vk::DeviceAddress Buffer::getDeviceAddress() const
+{
+  ETNA_VERIFYF(
+    deviceAddress != 0,
+    "Buffer {} was not created with the eShaderDeviceAddress usage!",
+    static_cast<void*>(VkBuffer(buffer)));
+  return deviceAddress;
+}
+
 } // namespace etna
@@ -0,0 +1,38 @@
+#include "BuiltinShaders.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <etna/GlobalContext.hpp>
+
+
+namespace etna
+{
+
+ShaderProgramId get_builtin_program(const char* name, std::initializer_list<const char*> files)
+{
+  auto& shaderManager = get_context().getShaderManager();
+  if (auto id = shaderManager.tryGetProgram(name); id != ShaderProgramId::Invalid)
+    return id;
+
+  const auto builtinShaders = get_builtin_shaders();
+  std::vector<EmbeddedShader> shaders;
+  shaders.reserve(files.size());
+  for (const char* file : files)
+  {
+    auto it = std::find_if(
+      builtinShaders.begin(), builtinShaders.end(), [file](const EmbeddedShader& shader) {
+        return shader.name == file;
+      });
+    ETNA_VERIFYF(
+      it != builtinShaders.end(),
+      "Builtin shader {} of program {} is missing, etna has to be built with glslc to use it!",
+      file,
+      name);
+    shaders.push_back(*it);
+  }
+
+  return shaderManager.loadEmbeddedProgram(name, shaders);
+}
+
+} // namespace etna
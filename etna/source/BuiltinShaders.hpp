@@ -0,0 +1,24 @@
+#pragma once
+#ifndef ETNA_BUILTIN_SHADERS_HPP_INCLUDED
+#define ETNA_BUILTIN_SHADERS_HPP_INCLUDED
+
+#include <initializer_list>
+#include <span>
+
+#include <etna/ShaderProgram.hpp>
+
+
+namespace etna
+{
+
+// SPIR-V of the shaders shipped with etna (see etna/shaders), which is embedded
+// into the library at build time. Empty if etna was built without glslc.
+std::span<const EmbeddedShader> get_builtin_shaders();
+
+// Returns the program made of builtin shaders, loading it on first use. Files
+// are named after the compiled shaders, e.g. "cull_frustum.comp.spv".
+ShaderProgramId get_builtin_program(const char* name, std::initializer_list<const char*> files);
+
+} // namespace etna
+
+#endif // ETNA_BUILTIN_SHADERS_HPP_INCLUDED
@@ -3,8 +3,6 @@
 #include <bit>
 #include <type_traits>
 
-#include "etna/GlobalContext.hpp"
-
 
 namespace etna
 {
@@ -13,7 +11,8 @@ namespace etna
 // but it is considered to be abandoned in favour of VK_EXT_debug_utils.
 #ifdef ETNA_SET_VULKAN_DEBUG_NAMES
 template <class T>
-static void set_debug_name_base(T object, vk::ObjectType object_type, const char* name)
+static void set_debug_name_base(
+  vk::Device device, T object, vk::ObjectType object_type, const char* name)
 {
   const auto nativeHandle = static_cast<typename std::remove_cvref_t<T>::NativeType>(object);
   // The NativeType for a vulkan object can either be a uint64_t,
@@ -23,7 +22,7 @@ static void set_debug_name_base(T object, vk::ObjectType object_type, const char
     .objectHandle = std::bit_cast<uint64_t>(nativeHandle),
     .pObjectName = name,
   };
-  auto retcode = etna::get_context().getDevice().setDebugUtilsObjectNameEXT(&debugNameInfo);
+  auto retcode = device.setDebugUtilsObjectNameEXT(&debugNameInfo);
   ETNA_VERIFYF(
     retcode == vk::Result::eSuccess,
     "Error {} occurred while trying to set a debug name!",
@@ -31,29 +30,29 @@ static void set_debug_name_base(T object, vk::ObjectType object_type, const char
 }
 #else
 template <class T>
-static void set_debug_name_base(T, vk::ObjectType, const char*)
+static void set_debug_name_base(vk::Device, T, vk::ObjectType, const char*)
 {
 }
 #endif
 
-void set_debug_name(vk::Image image, const char* name)
+void set_debug_name(vk::Device device, vk::Image image, const char* name)
 {
-  set_debug_name_base(image, vk::ObjectType::eImage, name);
+  set_debug_name_base(device, image, vk::ObjectType::eImage, name);
 }
 
-void set_debug_name(vk::ImageView image_view, const char* name)
+void set_debug_name(vk::Device device, vk::ImageView image_view, const char* name)
 {
-  set_debug_name_base(image_view, vk::ObjectType::eImageView, name);
+  set_debug_name_base(device, image_view, vk::ObjectType::eImageView, name);
 }
 
-void set_debug_name(vk::Buffer buffer, const char* name)
+void set_debug_name(vk::Device device, vk::Buffer buffer, const char* name)
 {
-  set_debug_name_base(buffer, vk::ObjectType::eBuffer, name);
+  set_debug_name_base(device, buffer, vk::ObjectType::eBuffer, name);
 }
 
-void set_debug_name(vk::Sampler sampler, const char* name)
+void set_debug_name(vk::Device device, vk::Sampler sampler, const char* name)
 {
-  set_debug_name_base(sampler, vk::ObjectType::eSampler, name);
+  set_debug_name_base(device, sampler, vk::ObjectType::eSampler, name);
 }
 
 } // namespace etna
@@ -7,10 +7,10 @@
 namespace etna
 {
 
-void set_debug_name(vk::Image image, const char* name);
-void set_debug_name(vk::ImageView image_view, const char* name);
-void set_debug_name(vk::Buffer buffer, const char* name);
-void set_debug_name(vk::Sampler sampler, const char* name);
+void set_debug_name(vk::Device device, vk::Image image, const char* name);
+void set_debug_name(vk::Device device, vk::ImageView image_view, const char* name);
+void set_debug_name(vk::Device device, vk::Buffer buffer, const char* name);
+void set_debug_name(vk::Device device, vk::Sampler sampler, const char* name);
 
 } // namespace etna
 
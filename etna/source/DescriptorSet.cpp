@@ -1,6 +1,8 @@
 #include <etna/GlobalContext.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <vector>
 
 #include <etna/DescriptorSet.hpp>
@@ -12,7 +14,9 @@ namespace etna
 
 bool DescriptorSet::isValid() const
 {
-  return get_context().getDescriptorPool().isSetValid(*this);
+  if (workCount == nullptr)
+    return get_context().getDescriptorPool().isSetValid(*this);
+  return set && generation + workCount->multiBufferingCount() > workCount->batchIndex();
 }
 
 /*Todo: Add struct with parameters*/
@@ -23,51 +27,62 @@ static constexpr uint32_t NUM_RW_TEXTURES = 512;
 static constexpr uint32_t NUM_BUFFERS = 2048;
 static constexpr uint32_t NUM_RW_BUFFERS = 512;
 static constexpr uint32_t NUM_SAMPLERS = 128;  
+static constexpr uint32_t NUM_INPUT_ATTACHMENTS = 128;
+static constexpr uint32_t NUM_INLINE_UNIFORM_BLOCKS = 512;
+static constexpr uint32_t NUM_INLINE_UNIFORM_BYTES = 64 * 1024;
 
-static constexpr std::array<vk::DescriptorPoolSize, 6> DEFAULT_POOL_SIZES{
+static constexpr std::array<vk::DescriptorPoolSize, 7> DEFAULT_POOL_SIZES{
   vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer, NUM_BUFFERS},
   vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, NUM_RW_BUFFERS},
   vk::DescriptorPoolSize{vk::DescriptorType::eSampler, NUM_SAMPLERS},
   vk::DescriptorPoolSize{vk::DescriptorType::eSampledImage, NUM_RW_TEXTURES},
   vk::DescriptorPoolSize{vk::DescriptorType::eStorageImage, NUM_RW_TEXTURES},
-  vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, NUM_TEXTURES}};
+  vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, NUM_TEXTURES},
+  vk::DescriptorPoolSize{vk::DescriptorType::eInputAttachment, NUM_INPUT_ATTACHMENTS}};
 
-DynamicDescriptorPool::DynamicDescriptorPool(vk::Device dev, const GpuWorkCount& work_count)
-  : vkDevice{dev}
-  , workCount{work_count}
-  , pools{work_count, [dev](std::size_t) {
-            vk::DescriptorPoolCreateInfo info{
-              .flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
-              .maxSets = NUM_DESCRIPTORS,
-              .poolSizeCount = static_cast<std::uint32_t>(DEFAULT_POOL_SIZES.size()),
-              .pPoolSizes = DEFAULT_POOL_SIZES.data(),
-            };
-            return unwrap_vk_result(dev.createDescriptorPoolUnique(info));
-          }}
-{
-}
-
-void DynamicDescriptorPool::beginFrame()
+// The default sizes are scaled down proportionally for pools with fewer sets
+static vk::UniqueDescriptorPool create_pool(
+  vk::Device device, bool inline_uniform_blocks, std::uint32_t max_sets = NUM_DESCRIPTORS)
 {
-  vkDevice.resetDescriptorPool(pools.get().get());
-}
+  const auto scale = [max_sets](std::uint32_t count) {
+    return std::max(count * max_sets / NUM_DESCRIPTORS, 1u);
+  };
 
-void DynamicDescriptorPool::destroyAllocatedSets()
-{
-  pools.iterate([this](auto& pool) { vkDevice.resetDescriptorPool(pool.get()); });
+  std::vector<vk::DescriptorPoolSize> poolSizes;
+  poolSizes.reserve(DEFAULT_POOL_SIZES.size() + 1);
+  for (const auto& size : DEFAULT_POOL_SIZES)
+    poolSizes.push_back(
+      vk::DescriptorPoolSize{.type = size.type, .descriptorCount = scale(size.descriptorCount)});
+  // The descriptor count of inline uniform blocks is in bytes
+  if (inline_uniform_blocks)
+    poolSizes.push_back(vk::DescriptorPoolSize{
+      vk::DescriptorType::eInlineUniformBlock, scale(NUM_INLINE_UNIFORM_BYTES)});
+
+  vk::DescriptorPoolInlineUniformBlockCreateInfo inlineInfo{
+    .maxInlineUniformBlockBindings = scale(NUM_INLINE_UNIFORM_BLOCKS),
+  };
+  vk::DescriptorPoolCreateInfo info{
+    .pNext = inline_uniform_blocks ? &inlineInfo : nullptr,
+    .flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+    .maxSets = max_sets,
+    .poolSizeCount = static_cast<std::uint32_t>(poolSizes.size()),
+    .pPoolSizes = poolSizes.data(),
+  };
+  return unwrap_vk_result(device.createDescriptorPoolUnique(info));
 }
 
-DescriptorSet DynamicDescriptorPool::allocateSet(
+static vk::Result allocate_vk_set(
+  vk::Device device,
+  vk::DescriptorPool pool,
   DescriptorLayoutId layout_id,
-  std::vector<Binding> bindings,
-  vk::CommandBuffer command_buffer,
-  BarrierBehavoir behavoir)
+  const std::vector<Binding>& bindings,
+  vk::DescriptorSet& vk_set)
 {
   auto& dslCache = get_context().getDescriptorSetLayouts();
   auto setLayouts = {dslCache.getVkLayout(layout_id)};
 
   vk::DescriptorSetAllocateInfo info{};
-  info.setDescriptorPool(pools.get().get());
+  info.setDescriptorPool(pool);
   info.setSetLayouts(setLayouts);
 
   std::vector<uint32_t> counts = {};
@@ -79,10 +94,115 @@ DescriptorSet DynamicDescriptorPool::allocateSet(
     info.setPNext(&countInfo);
   }
 
+  return device.allocateDescriptorSets(&info, &vk_set);
+}
+
+static std::atomic<std::uint64_t> gNextPoolInstance{1};
+
+DynamicDescriptorPool::DynamicDescriptorPool(
+  vk::Device dev, const GpuWorkCount& work_count, bool inline_uniform_blocks)
+  : vkDevice{dev}
+  , workCount{work_count}
+  , inlineUniformBlocks{inline_uniform_blocks}
+  , instanceId{gNextPoolInstance.fetch_add(1, std::memory_order_relaxed)}
+{
+}
+
+DynamicDescriptorPool::ThreadPools& DynamicDescriptorPool::getThreadPools()
+{
+  // Threads mostly allocate from the same pool over and over, so the last lookup is cached
+  thread_local std::uint64_t cachedInstance = 0;
+  thread_local ThreadPools* cachedPools = nullptr;
+  if (cachedInstance == instanceId)
+    return *cachedPools;
+
+  std::lock_guard lock{mutex};
+  auto& pools = threadPools[std::this_thread::get_id()];
+  if (pools == nullptr)
+    pools = std::make_unique<ThreadPools>(workCount, [this](std::size_t) {
+      return FramePool{.pool = create_pool(vkDevice, inlineUniformBlocks), .lastBatch = 0};
+    });
+  cachedInstance = instanceId;
+  cachedPools = pools.get();
+  return *pools;
+}
+
+void DynamicDescriptorPool::destroyAllocatedSets()
+{
+  std::lock_guard lock{mutex};
+  for (auto& [thread, pools] : threadPools)
+    pools->iterate([this](FramePool& frame) { vkDevice.resetDescriptorPool(frame.pool.get()); });
+}
+
+DescriptorSet DynamicDescriptorPool::allocateSet(
+  DescriptorLayoutId layout_id,
+  std::vector<Binding> bindings,
+  vk::CommandBuffer command_buffer,
+  BarrierBehavoir behavoir)
+{
+  // First use of this pool in a new frame, the GPU is done with
+  // all sets allocated from it frames-in-flight batches ago.
+  auto& frame = getThreadPools().get();
+  if (frame.lastBatch != workCount.batchIndex())
+  {
+    vkDevice.resetDescriptorPool(frame.pool.get());
+    frame.lastBatch = workCount.batchIndex();
+  }
+
   vk::DescriptorSet vkSet{};
-  ETNA_VERIFY(vkDevice.allocateDescriptorSets(&info, &vkSet) == vk::Result::eSuccess);
-  return DescriptorSet{
+  ETNA_VERIFY(
+    allocate_vk_set(vkDevice, frame.pool.get(), layout_id, bindings, vkSet) ==
+    vk::Result::eSuccess);
+  DescriptorSet result{
     workCount.batchIndex(), layout_id, vkSet, std::move(bindings), command_buffer, behavoir};
+  result.workCount = &workCount;
+  return result;
+}
+
+static constexpr uint32_t MIN_RECORDING_POOL_SETS = 16;
+
+// Results after which a bigger pool may succeed
+static bool is_pool_exhausted(vk::Result result)
+{
+  return result == vk::Result::eErrorOutOfPoolMemory ||
+    result == vk::Result::eErrorFragmentedPool;
+}
+
+RecordingDescriptorPool::RecordingDescriptorPool(
+  vk::Device dev, const GpuWorkCount& work_count, bool inline_uniform_blocks)
+  : vkDevice{dev}
+  , workCount{work_count}
+  , inlineUniformBlocks{inline_uniform_blocks}
+{
+}
+
+DescriptorSet RecordingDescriptorPool::allocateSet(
+  DescriptorLayoutId layout_id,
+  std::vector<Binding> bindings,
+  vk::CommandBuffer command_buffer,
+  BarrierBehavoir behavoir)
+{
+  vk::DescriptorSet vkSet{};
+  vk::Result allocResult = pools.empty()
+    ? vk::Result::eErrorOutOfPoolMemory
+    : allocate_vk_set(vkDevice, pools.back().get(), layout_id, bindings, vkSet);
+  while (is_pool_exhausted(allocResult))
+  {
+    ETNA_VERIFYF(
+      poolCapacity < NUM_DESCRIPTORS,
+      "Descriptor set with layout {} doesn't fit into an empty descriptor pool!",
+      layout_id);
+    poolCapacity = std::clamp(poolCapacity * 2, MIN_RECORDING_POOL_SETS, NUM_DESCRIPTORS);
+    pools.push_back(create_pool(vkDevice, inlineUniformBlocks, poolCapacity));
+    allocResult = allocate_vk_set(vkDevice, pools.back().get(), layout_id, bindings, vkSet);
+  }
+  // Running out of host or device memory isn't fixed by another pool
+  ETNA_CHECK_VK_RESULT(allocResult);
+
+  DescriptorSet result{
+    workCount.batchIndex(), layout_id, vkSet, std::move(bindings), command_buffer, behavoir};
+  result.workCount = &workCount;
+  return result;
 }
 
 static bool is_image_resource(vk::DescriptorType ds_type)
@@ -93,11 +213,13 @@ static bool is_image_resource(vk::DescriptorType ds_type)
   case vk::DescriptorType::eStorageBuffer:
   case vk::DescriptorType::eUniformBufferDynamic:
   case vk::DescriptorType::eStorageBufferDynamic:
+  case vk::DescriptorType::eInlineUniformBlock:
     return false;
   case vk::DescriptorType::eCombinedImageSampler:
   case vk::DescriptorType::eSampledImage:
   case vk::DescriptorType::eStorageImage:
   case vk::DescriptorType::eSampler:
+  case vk::DescriptorType::eInputAttachment:
     return true;
   default:
     break;
@@ -125,6 +247,30 @@ static void validate_descriptor_write(const DescriptorSet& dst)
       ETNA_PANIC("Descriptor write error: descriptor set doesn't have {} slot", binding.binding);
 
     const auto& bindingInfo = layoutInfo.getBinding(binding.binding);
+
+    const bool isInlineRequired =
+      bindingInfo.descriptorType == vk::DescriptorType::eInlineUniformBlock;
+    const bool isInlineBinding = std::get_if<InlineBinding>(&binding.resources) != nullptr;
+    if (isInlineRequired != isInlineBinding)
+      ETNA_PANIC(
+        "Descriptor write error: slot {} {} an inline uniform block",
+        binding.binding,
+        (isInlineRequired ? "is" : "is not"));
+    if (isInlineBinding)
+    {
+      if (
+        binding.arrayElem % 4 != 0 || binding.size % 4 != 0 ||
+        binding.arrayElem + binding.size > bindingInfo.descriptorCount)
+        ETNA_PANIC(
+          "Descriptor write error: bytes [{}, {}) don't fit inline uniform block {} of {} bytes "
+          "or aren't aligned to 4",
+          binding.arrayElem,
+          binding.arrayElem + binding.size,
+          binding.binding,
+          bindingInfo.descriptorCount);
+      continue;
+    }
+
     bool isImageRequired = is_image_resource(bindingInfo.descriptorType);
     bool isImageBinding = std::get_if<std::vector<ImageBinding>>(&binding.resources) != nullptr;
     if (isImageRequired != isImageBinding)
@@ -160,13 +306,16 @@ void write_set(const DescriptorSet& dst)
 
   uint32_t numBufferInfo = 0;
   uint32_t numImageInfo = 0;
+  uint32_t numInlineInfo = 0;
 
   const auto& layoutInfo = get_context().getDescriptorSetLayouts().getLayoutInfo(dst.getLayoutId());
 
   for (auto& binding : dst.getBindings())
   {
     const auto& bindingInfo = layoutInfo.getBinding(binding.binding);
-    if (is_image_resource(bindingInfo.descriptorType))
+    if (bindingInfo.descriptorType == vk::DescriptorType::eInlineUniformBlock)
+      numInlineInfo++;
+    else if (is_image_resource(bindingInfo.descriptorType))
       numImageInfo  += binding.size;
     else
       numBufferInfo += binding.size;
@@ -174,14 +323,23 @@ void write_set(const DescriptorSet& dst)
 
   std::vector<vk::DescriptorImageInfo> imageInfos;
   std::vector<vk::DescriptorBufferInfo> bufferInfos;
+  std::vector<vk::WriteDescriptorSetInlineUniformBlock> inlineInfos;
   imageInfos.resize(numImageInfo);
   bufferInfos.resize(numBufferInfo);
+  inlineInfos.resize(numInlineInfo);
   numImageInfo = 0;
   numBufferInfo = 0;
+  numInlineInfo = 0;
 
   for (const auto& binding : dst.getBindings())
   {
     const auto& bindingInfo = layoutInfo.getBinding(binding.binding);
+    const bool hasImmutableSampler = layoutInfo.hasImmutableSampler(binding.binding);
+
+    // Immutable samplers live in the layout itself, writing them is not allowed
+    if (hasImmutableSampler && bindingInfo.descriptorType == vk::DescriptorType::eSampler)
+      continue;
+
     vk::WriteDescriptorSet write{};
     write.setDstSet(dst.getVkSet())
       .setDescriptorCount(binding.size)
@@ -189,12 +347,21 @@ void write_set(const DescriptorSet& dst)
       .setDstArrayElement(binding.arrayElem)
       .setDescriptorType(bindingInfo.descriptorType);
 
-    if (is_image_resource(bindingInfo.descriptorType))
+    if (const auto* inlineData = std::get_if<InlineBinding>(&binding.resources))
+    {
+      auto& inlineInfo = inlineInfos[numInlineInfo++];
+      inlineInfo.setDataSize(static_cast<uint32_t>(inlineData->bytes.size()))
+        .setPData(inlineData->bytes.data());
+      write.setPNext(&inlineInfo);
+    }
+    else if (is_image_resource(bindingInfo.descriptorType))
     {
       write.setPImageInfo(imageInfos.data() + numImageInfo);
       const auto& imgs = std::get<std::vector<ImageBinding>>(binding.resources);
       for (const auto& img : imgs) {
         imageInfos[numImageInfo] = img.descriptor_info;
+        if (hasImmutableSampler)
+          imageInfos[numImageInfo].sampler = vk::Sampler{};
         numImageInfo++;
       }
     }
@@ -247,16 +414,26 @@ constexpr static vk::PipelineStageFlags2 shader_stage_to_pipeline_stage(
 
 constexpr static vk::AccessFlags2 descriptor_type_to_access_flag(vk::DescriptorType descriptor_type)
 {
-  constexpr uint32_t MAPPING_LENGTH = 3;
+  constexpr uint32_t MAPPING_LENGTH = 8;
   constexpr std::array<vk::DescriptorType, MAPPING_LENGTH> DESCRIPTOR_TYPES = {
     vk::DescriptorType::eSampledImage,
     vk::DescriptorType::eStorageImage,
     vk::DescriptorType::eCombinedImageSampler,
+    vk::DescriptorType::eInputAttachment,
+    vk::DescriptorType::eUniformBuffer,
+    vk::DescriptorType::eUniformBufferDynamic,
+    vk::DescriptorType::eStorageBuffer,
+    vk::DescriptorType::eStorageBufferDynamic,
   };
   constexpr std::array<vk::AccessFlags2, MAPPING_LENGTH> ACCESS_FLAGS = {
     vk::AccessFlagBits2::eShaderSampledRead,
     vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
     vk::AccessFlagBits2::eShaderSampledRead,
+    vk::AccessFlagBits2::eInputAttachmentRead,
+    vk::AccessFlagBits2::eUniformRead,
+    vk::AccessFlagBits2::eUniformRead,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
   };
   for (uint32_t i = 0; i < MAPPING_LENGTH; ++i)
   {
@@ -271,10 +448,28 @@ void DescriptorSet::processBarriers() const
   auto& layoutInfo = get_context().getDescriptorSetLayouts().getLayoutInfo(layoutId);
   for (auto& binding : bindings)
   {
-    if (std::get_if<std::vector<ImageBinding>>(&binding.resources) == nullptr)
-      continue; // Add processing for buffer here if you need.
-
     auto& bindingInfo = layoutInfo.getBinding(binding.binding);
+
+    // Inline uniform blocks live in the set itself, there's nothing to synchronize
+    if (std::holds_alternative<InlineBinding>(binding.resources))
+      continue;
+
+    if (const auto* buffers = std::get_if<std::vector<BufferBinding>>(&binding.resources))
+    {
+      for (const auto& bufData : *buffers)
+        etna::set_state(
+          command_buffer,
+          bufData.buffer.get(),
+          shader_stage_to_pipeline_stage(bindingInfo.stageFlags),
+          descriptor_type_to_access_flag(bindingInfo.descriptorType));
+      continue;
+    }
+
+    // Input attachments are read while being rendered into,
+    // their state is set up by RenderTargetState with localRead.
+    if (bindingInfo.descriptorType == vk::DescriptorType::eInputAttachment)
+      continue;
+
     //FIXME: at(0)
     const ImageBinding& imgData = std::get<std::vector<ImageBinding>>(binding.resources).at(0);
     etna::set_state(
@@ -1,5 +1,8 @@
 #include <etna/DescriptorSetLayout.hpp>
 
+#include <algorithm>
+#include <bit>
+
 #include <spirv_reflect.h>
 
 #include <etna/Assert.hpp>
@@ -52,6 +55,48 @@ void DescriptorSetInfo::clear()
   usedBindings.reset();
   for (auto& binding : bindings)
     binding = vk::DescriptorSetLayoutBinding{};
+  for (auto& sampler : immutableSamplers)
+    sampler = vk::Sampler{};
+  uniformBlockSizes.fill(0);
+}
+
+void DescriptorSetInfo::setImmutableSampler(uint32_t binding, vk::Sampler sampler)
+{
+  if (!isBindingUsed(binding))
+    ETNA_PANIC("DescriptorSetInfo: immutable sampler for unused binding {}", binding);
+
+  const auto type = bindings[binding].descriptorType;
+  if (type != vk::DescriptorType::eSampler && type != vk::DescriptorType::eCombinedImageSampler)
+    ETNA_PANIC(
+      "DescriptorSetInfo: binding {} of type {} can't have an immutable sampler",
+      binding,
+      vk::to_string(type));
+
+  if (bindings[binding].descriptorCount == 0)
+    ETNA_PANIC(
+      "DescriptorSetInfo: variable-sized binding {} can't have an immutable sampler", binding);
+
+  immutableSamplers[binding] = sampler;
+}
+
+void DescriptorSetInfo::setInlineUniformBlock(uint32_t binding)
+{
+  if (!isBindingUsed(binding))
+    ETNA_PANIC("DescriptorSetInfo: inline uniform block for unused binding {}", binding);
+
+  auto& apiBinding = bindings[binding];
+  if (
+    apiBinding.descriptorType != vk::DescriptorType::eUniformBuffer ||
+    apiBinding.descriptorCount != 1)
+    ETNA_PANIC(
+      "DescriptorSetInfo: binding {} of type {} can't be an inline uniform block, "
+      "only non-array uniform buffers can",
+      binding,
+      vk::to_string(apiBinding.descriptorType));
+
+  // The descriptor count of an inline uniform block is its size in bytes
+  apiBinding.descriptorType = vk::DescriptorType::eInlineUniformBlock;
+  apiBinding.descriptorCount = (uniformBlockSizes[binding] + 3) / 4 * 4;
 }
 
 void DescriptorSetInfo::parseShader(
@@ -74,6 +119,10 @@ void DescriptorSetInfo::parseShader(
     apiBinding.pImmutableSamplers = nullptr;
     apiBinding.binding = spvBinding.binding;
     addResource(apiBinding);
+
+    if (apiBinding.descriptorType == vk::DescriptorType::eUniformBuffer)
+      uniformBlockSizes[apiBinding.binding] =
+        std::max(uniformBlockSizes[apiBinding.binding], spvBinding.block.padded_size);
   }
 }
 
@@ -84,6 +133,14 @@ void DescriptorSetInfo::merge(const DescriptorSetInfo& info)
     if (!info.usedBindings.test(binding))
       continue;
     addResource(info.bindings[binding]);
+    uniformBlockSizes[binding] =
+      std::max(uniformBlockSizes[binding], info.uniformBlockSizes[binding]);
+
+    if (!info.immutableSamplers[binding])
+      continue;
+    if (immutableSamplers[binding] && immutableSamplers[binding] != info.immutableSamplers[binding])
+      ETNA_PANIC("DescriptorSetInfo: different immutable samplers at index {}", binding);
+    immutableSamplers[binding] = info.immutableSamplers[binding];
   }
 }
 
@@ -98,6 +155,8 @@ bool DescriptorSetInfo::operator==(const DescriptorSetInfo& rhs) const
   {
     if (bindings[i] != rhs.bindings[i])
       return false;
+    if (immutableSamplers[i] != rhs.immutableSamplers[i])
+      return false;
   }
 
   return true;
@@ -105,6 +164,16 @@ bool DescriptorSetInfo::operator==(const DescriptorSetInfo& rhs) const
 
 vk::DescriptorSetLayout DescriptorSetInfo::createVkLayout(vk::Device device) const
 {
+  // Vulkan wants an array of samplers for every element of the binding, but we
+  // only store one, so it gets replicated here. Reserved upfront so that
+  // pointers into it stay valid.
+  std::size_t immutableSamplerCount = 0;
+  for (uint32_t i = 0; i < maxUsedBinding; i++)
+    if (usedBindings.test(i) && immutableSamplers[i])
+      immutableSamplerCount += bindings[i].descriptorCount;
+  std::vector<vk::Sampler> samplerStorage;
+  samplerStorage.reserve(immutableSamplerCount);
+
   std::vector<vk::DescriptorSetLayoutBinding> apiBindings;
   std::vector<vk::DescriptorBindingFlags> bindingFlags;
   for (uint32_t i = 0; i < maxUsedBinding; i++)
@@ -112,6 +181,12 @@ vk::DescriptorSetLayout DescriptorSetInfo::createVkLayout(vk::Device device) con
     if (!usedBindings.test(i))
       continue;
     apiBindings.push_back(bindings[i]);
+    if (immutableSamplers[i])
+    {
+      apiBindings.back().pImmutableSamplers = samplerStorage.data() + samplerStorage.size();
+      samplerStorage.insert(
+        samplerStorage.end(), bindings[i].descriptorCount, immutableSamplers[i]);
+    }
     if(bindings[i].descriptorCount == 0) 
       apiBindings.back().descriptorCount = 255;
     bindingFlags.push_back(bindings[i].descriptorCount != 0 ? vk::DescriptorBindingFlags{} : vk::DescriptorBindingFlagBits::eVariableDescriptorCount);
@@ -148,6 +223,7 @@ std::size_t DescriptorSetLayoutHash::operator()(const DescriptorSetInfo& res) co
     hash_combine(hash, static_cast<uint32_t>(res.bindings[i].descriptorType));
     hash_combine(hash, res.bindings[i].descriptorCount);
     hash_combine(hash, static_cast<uint32_t>(res.bindings[i].stageFlags));
+    hash_combine(hash, std::bit_cast<uint64_t>(static_cast<VkSampler>(res.immutableSamplers[i])));
   }
 
   return hash;
@@ -162,27 +238,41 @@ DescriptorLayoutId DescriptorSetLayoutCache::registerLayout(
 std::pair<DescriptorLayoutId, vk::DescriptorSetLayout> DescriptorSetLayoutCache::get(
   vk::Device device, const DescriptorSetInfo& info)
 {
+  std::lock_guard lock{mutex};
+  const Snapshot& current = snapshot.latest();
   auto it = map.find(info);
   if (it != map.end())
-    return {it->second, vkLayouts[it->second]};
+    return {it->second, current.vkLayouts[it->second]};
+
+  DescriptorLayoutId id = static_cast<DescriptorLayoutId>(current.infos.size());
+  it = map.emplace(info, id).first;
 
-  DescriptorLayoutId id = static_cast<DescriptorLayoutId>(descriptors.size());
-  map.insert({info, id});
-  descriptors.push_back(info);
-  vkLayouts.push_back(info.createVkLayout(device));
-  return {id, vkLayouts[id]};
+  Snapshot next = current;
+  next.infos.push_back(&it->first);
+  next.vkLayouts.push_back(info.createVkLayout(device));
+  const vk::DescriptorSetLayout layout = next.vkLayouts.back();
+  snapshot.publish(std::move(next));
+  return {id, layout};
+}
+
+void DescriptorSetLayoutCache::collectRetiredSnapshots()
+{
+  std::lock_guard lock{mutex};
+  snapshot.collect();
 }
 
 void DescriptorSetLayoutCache::clear(vk::Device device)
 {
-  for (auto layout : vkLayouts)
+  std::lock_guard lock{mutex};
+  for (auto layout : snapshot.latest().vkLayouts)
   {
     device.destroyDescriptorSetLayout(layout);
   }
 
+  // Old snapshots point into the map, so they have to go first
+  snapshot.publish(Snapshot{});
+  snapshot.reclaim();
   map.clear();
-  descriptors.clear();
-  vkLayouts.clear();
 }
 
 } // namespace etna
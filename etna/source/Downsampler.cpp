@@ -0,0 +1,231 @@
+#include <etna/Downsampler.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include "BuiltinShaders.hpp"
+
+
+namespace etna
+{
+
+// Must be kept in sync with shaders/downsample.comp
+static constexpr std::uint32_t MAX_MIPS = 12;
+static constexpr std::uint32_t TILE_SIZE = 64;
+static constexpr std::uint32_t MIPS_PER_TILE = 6;
+
+// Mirrors the Params push constant block of downsample.comp
+struct DownsampleParams
+{
+  std::uint32_t srcWidth;
+  std::uint32_t srcHeight;
+  std::uint32_t mipCount;
+  std::uint32_t reduction;
+  std::uint32_t workGroupCount;
+};
+static_assert(sizeof(DownsampleParams) == 20);
+
+// Storage image writes need the format to be known at compile time,
+// so every supported format has a variant of the shader.
+static const char* get_program_name(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eR32Sfloat:
+    return "downsample_r32f";
+  case vk::Format::eR16G16B16A16Sfloat:
+    return "downsample_rgba16f";
+  case vk::Format::eR8G8B8A8Unorm:
+    return "downsample_rgba8";
+  case vk::Format::eB10G11R11UfloatPack32:
+    return "downsample_r11f_g11f_b10f";
+  default:
+    ETNA_PANIC("Downsampling into images of format {} is not supported!", vk::to_string(format));
+  }
+}
+
+static std::uint32_t div_ceil(std::uint32_t a, std::uint32_t b)
+{
+  return (a + b - 1) / b;
+}
+
+Downsampler::Downsampler()
+  : sampler{Sampler::CreateInfo{
+      .filter = vk::Filter::eNearest,
+      .addressMode = vk::SamplerAddressMode::eClampToEdge,
+      .name = "Downsampler::sampler",
+    }}
+  , counter{get_context().createBuffer(Buffer::CreateInfo{
+      .size = sizeof(std::uint32_t),
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = "Downsampler::counter",
+    })}
+{
+}
+
+const ComputePipeline& Downsampler::getPipeline(vk::Format format)
+{
+  auto it = pipelines.find(format);
+  if (it != pipelines.end())
+    return it->second;
+
+  const char* name = get_program_name(format);
+  const std::string file = std::string(name) + ".comp.spv";
+  get_builtin_program(name, {file.c_str()});
+  auto pipeline = get_context().getPipelineManager().createComputePipeline(name, {});
+  return pipelines.emplace(format, std::move(pipeline)).first->second;
+}
+
+void Downsampler::generateMips(
+  vk::CommandBuffer cmd_buf, const Image& image, DownsampleReduction reduction)
+{
+  ETNA_PROFILE_GPU(cmd_buf, Downsampler::generateMips);
+
+  if (image.getMipLevelCount() < 2)
+    return;
+
+  // Mip 0 is read while the rest are written, and the state is tracked
+  // for the whole image, so the general layout is the only option.
+  etna::set_state(
+    cmd_buf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderSampledRead | vk::AccessFlagBits2::eShaderStorageRead |
+      vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    image.getAspectMaskByFormat(),
+    ForceSetState::eTrue);
+
+  dispatch(cmd_buf, image, vk::ImageLayout::eGeneral, image, 1, reduction);
+}
+
+void Downsampler::downsample(
+  vk::CommandBuffer cmd_buf, const Image& src, const Image& dst, DownsampleReduction reduction)
+{
+  ETNA_PROFILE_GPU(cmd_buf, Downsampler::downsample);
+
+  const auto srcExtent = src.getExtent();
+  const auto dstExtent = dst.getExtent();
+  ETNA_VERIFYF(
+    dstExtent.width == std::max(srcExtent.width / 2, 1u) &&
+      dstExtent.height == std::max(srcExtent.height / 2, 1u),
+    "Downsampling a {}x{} image requires the destination to be half as big, got {}x{}!",
+    srcExtent.width,
+    srcExtent.height,
+    dstExtent.width,
+    dstExtent.height);
+
+  etna::set_state(
+    cmd_buf,
+    src.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    src.getAspectMaskByFormat());
+  etna::set_state(
+    cmd_buf,
+    dst.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::ImageLayout::eGeneral,
+    dst.getAspectMaskByFormat(),
+    ForceSetState::eTrue);
+
+  dispatch(cmd_buf, src, vk::ImageLayout::eShaderReadOnlyOptimal, dst, 0, reduction);
+}
+
+void Downsampler::dispatch(
+  vk::CommandBuffer cmd_buf,
+  const Image& src,
+  vk::ImageLayout src_layout,
+  const Image& dst,
+  std::uint32_t first_dst_mip,
+  DownsampleReduction reduction)
+{
+  const auto srcExtent = src.getExtent();
+  const std::uint32_t mipCount = dst.getMipLevelCount() - first_dst_mip;
+  ETNA_VERIFYF(
+    mipCount <= MAX_MIPS,
+    "Can't downsample into {} mips, at most {} are supported!",
+    mipCount,
+    MAX_MIPS);
+  ETNA_VERIFYF(
+    mipCount <= MIPS_PER_TILE ||
+      (srcExtent.width <= TILE_SIZE << MIPS_PER_TILE &&
+       srcExtent.height <= TILE_SIZE << MIPS_PER_TILE),
+    "Can't downsample a {}x{} image into more than {} mips!",
+    srcExtent.width,
+    srcExtent.height,
+    MIPS_PER_TILE);
+
+  const auto& pipeline = getPipeline(dst.getFormat());
+
+  if (!counterInitialized)
+  {
+    etna::set_state(
+      cmd_buf,
+      counter.get(),
+      vk::PipelineStageFlagBits2::eClear,
+      vk::AccessFlagBits2::eTransferWrite);
+    etna::flush_barriers(cmd_buf);
+    cmd_buf.fillBuffer(counter.get(), 0, sizeof(std::uint32_t), 0);
+    counterInitialized = true;
+  }
+  // The last work group of the previous dispatch resets the counter
+  etna::set_state(
+    cmd_buf,
+    counter.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    ForceSetState::eTrue);
+  etna::flush_barriers(cmd_buf);
+
+  // Only depth is sampled out of depth/stencil images
+  Image::ViewParams srcView{.baseMip = 0, .levelCount = 1};
+  if (src.getAspectMaskByFormat() & vk::ImageAspectFlagBits::eDepth)
+    srcView.aspectMask = vk::ImageAspectFlagBits::eDepth;
+
+  // Every element of the array must be valid, so unused ones repeat the last mip
+  std::vector<ImageBinding> dstMips;
+  dstMips.reserve(MAX_MIPS);
+  for (std::uint32_t i = 0; i < MAX_MIPS; ++i)
+    dstMips.push_back(dst.genBinding(
+      {},
+      vk::ImageLayout::eGeneral,
+      {.baseMip = first_dst_mip + std::min(i, mipCount - 1), .levelCount = 1}));
+
+  // States were set above, as the image may be both read and written
+  auto set = etna::create_descriptor_set(
+    get_shader_program(get_program_name(dst.getFormat())).getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      Binding{0, src.genBinding(sampler.get(), src_layout, srcView)},
+      Binding{1, std::move(dstMips)},
+      Binding{2, counter.genBinding()},
+    },
+    BarrierBehavoir::eSuppressBarriers);
+
+  const std::uint32_t groupsX = div_ceil(srcExtent.width, TILE_SIZE);
+  const std::uint32_t groupsY = div_ceil(srcExtent.height, TILE_SIZE);
+  const DownsampleParams params{
+    .srcWidth = srcExtent.width,
+    .srcHeight = srcExtent.height,
+    .mipCount = mipCount,
+    .reduction = static_cast<std::uint32_t>(reduction),
+    .workGroupCount = groupsX * groupsY,
+  };
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  pipeline.pushConstants(cmd_buf, vk::ShaderStageFlagBits::eCompute, params);
+  cmd_buf.dispatch(groupsX, groupsY, 1);
+}
+
+} // namespace etna
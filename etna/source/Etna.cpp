@@ -1,11 +1,13 @@
 #include <etna/Etna.hpp>
 
 #include <memory>
+#include <utility>
 #include <vulkan/vulkan_enums.hpp>
 #include <vulkan/vulkan_format_traits.hpp>
 
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
+#include <etna/StaticCommandBuffer.hpp>
 #include <vulkan/vulkan_structs.hpp>
 #include "StateTracking.hpp"
 #include "etna/Image.hpp"
@@ -16,9 +18,13 @@ namespace etna
 {
 
 static std::unique_ptr<GlobalContext> gContext{};
+// Overrides the default context on the current thread, see ContextScope
+static thread_local GlobalContext* gCurrentContext = nullptr;
 
 GlobalContext& get_context()
 {
+  if (gCurrentContext != nullptr)
+    return *gCurrentContext;
   ETNA_VERIFYF(gContext, "Tried to use Etna before initializing it!");
   return *gContext;
 }
@@ -35,37 +41,67 @@ void initialize(const InitParams& params)
 
 void shutdown()
 {
-  gContext->getDescriptorSetLayouts().clear(gContext->getDevice());
   gContext.reset(nullptr);
 }
 
+std::unique_ptr<GlobalContext> create_context(const InitParams& params)
+{
+  return std::unique_ptr<GlobalContext>(new GlobalContext(params));
+}
+
+ContextScope::ContextScope(GlobalContext& context)
+  : previous{std::exchange(gCurrentContext, &context)}
+{
+}
+
+ContextScope::~ContextScope()
+{
+  gCurrentContext = previous;
+}
+
 ShaderProgramId create_program(
-  const char* name, std::initializer_list<std::filesystem::path> shaders_path)
+  const char* name,
+  std::initializer_list<std::filesystem::path> shaders_path,
+  ShaderProgramLayoutOptions layout_options)
 {
-  return gContext->getShaderManager().loadProgram(name, shaders_path);
+  return get_context().getShaderManager().loadProgram(
+    name, shaders_path, std::move(layout_options));
 }
 
 ShaderProgramId get_program_id(const char* name)
 {
-  return gContext->getShaderManager().tryGetProgram(name);
+  return get_context().getShaderManager().tryGetProgram(name);
 }
 
 void reload_shaders()
 {
-  gContext->getDescriptorSetLayouts().clear(gContext->getDevice());
-  gContext->getShaderManager().reloadPrograms();
-  gContext->getPipelineManager().recreate();
-  gContext->getDescriptorPool().destroyAllocatedSets();
+  get_context().getDescriptorSetLayouts().clear(get_context().getDevice());
+  get_context().getShaderManager().reloadPrograms();
+  get_context().getPipelineManager().recreate();
+  get_context().getDescriptorPool().destroyAllocatedSets();
 }
 
 ShaderProgramInfo get_shader_program(ShaderProgramId id)
 {
-  return gContext->getShaderManager().getProgramInfo(id);
+  return get_context().getShaderManager().getProgramInfo(id);
 }
 
 ShaderProgramInfo get_shader_program(const char* name)
 {
-  return gContext->getShaderManager().getProgramInfo(name);
+  return get_context().getShaderManager().getProgramInfo(name);
+}
+
+static void mark_bindings_used(ResidencyManager& residency, const std::vector<Binding>& bindings)
+{
+  for (const auto& binding : bindings)
+  {
+    if (auto* images = std::get_if<std::vector<ImageBinding>>(&binding.resources))
+      for (const auto& image : *images)
+        residency.markUsed(image.image.get());
+    else if (auto* buffers = std::get_if<std::vector<BufferBinding>>(&binding.resources))
+      for (const auto& buffer : *buffers)
+        residency.markUsed(buffer.buffer.get());
+  }
 }
 
 DescriptorSet create_descriptor_set(
@@ -74,7 +110,13 @@ DescriptorSet create_descriptor_set(
   std::vector<Binding> bindings,
   BarrierBehavoir behavoir)
 {
-  auto set = gContext->getDescriptorPool().allocateSet(layout, bindings, command_buffer, behavoir);
+  // Sets used by a StaticCommandBuffer must live as long as its recording
+  auto* capture = get_context().getResourceTracker().findCapture(command_buffer);
+  if (auto* residency = get_context().getResidencyManager())
+    mark_bindings_used(*residency, bindings);
+  auto set = capture != nullptr && capture->descriptorPool != nullptr
+    ? capture->descriptorPool->allocateSet(layout, bindings, command_buffer, behavoir)
+    : get_context().getDescriptorPool().allocateSet(layout, bindings, command_buffer, behavoir);
   write_set(set);
   return set;
 }
@@ -83,7 +125,7 @@ Image create_image_from_bytes(Image::CreateInfo info, vk::CommandBuffer cmd_buf,
 {
   const auto blockSize = vk::blockSize(info.format);
   const auto imageSize = blockSize * info.extent.width * info.extent.height * info.extent.depth;
-  etna::Buffer stagingBuf = gContext->createBuffer(etna::Buffer::CreateInfo{
+  etna::Buffer stagingBuf = get_context().createBuffer(etna::Buffer::CreateInfo{
     .size = imageSize,
     .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
     .memoryUsage = VMA_MEMORY_USAGE_AUTO,
@@ -101,7 +143,7 @@ Image create_image_from_bytes(Image::CreateInfo info, vk::CommandBuffer cmd_buf,
   }));
 
   info.imageUsage |= vk::ImageUsageFlagBits::eTransferDst;
-  auto image = gContext->createImage(info);
+  auto image = get_context().createImage(info);
   etna::set_state(
     cmd_buf,
     image.get(),
@@ -136,8 +178,8 @@ Image create_image_from_bytes(Image::CreateInfo info, vk::CommandBuffer cmd_buf,
     .pCommandBuffers = &cmd_buf,
   };
 
-  ETNA_CHECK_VK_RESULT(gContext->getQueue().submit(1, &submitInfo, {}));
-  ETNA_CHECK_VK_RESULT(gContext->getQueue().waitIdle());
+  ETNA_CHECK_VK_RESULT(get_context().getQueue().submit(1, &submitInfo, {}));
+  ETNA_CHECK_VK_RESULT(get_context().getQueue().waitIdle());
 
   stagingBuf.reset();
 
@@ -146,13 +188,18 @@ Image create_image_from_bytes(Image::CreateInfo info, vk::CommandBuffer cmd_buf,
 
 void begin_frame()
 {
-  // TODO: this is brittle. Maybe GpuWorkCount should have frame start calllbacks?
-  gContext->getDescriptorPool().beginFrame();
+  // Descriptor pools are recycled lazily by their threads, while recordings of
+  // destroyed static command buffers have nobody else to free them
+  get_context().getStaticRecordingRetireList().collect();
+  // Lookups of the previous frames are done, so snapshots they could see can go
+  get_context().getShaderManager().collectRetiredSnapshots();
+  get_context().getDescriptorSetLayouts().collectRetiredSnapshots();
+  get_context().getPipelineManager().collectRetiredSnapshots();
 }
 
 void end_frame()
 {
-  gContext->getMainWorkCount().submit();
+  get_context().getMainWorkCount().submit();
 }
 
 void set_state(
@@ -168,6 +215,17 @@ void set_state(
     com_buffer, image, pipeline_stage_flags, access_flags, layout, aspect_flags, force);
 }
 
+void set_state(
+  vk::CommandBuffer com_buffer,
+  vk::Buffer buffer,
+  vk::PipelineStageFlags2 pipeline_stage_flags,
+  vk::AccessFlags2 access_flags,
+  ForceSetState force)
+{
+  etna::get_context().getResourceTracker().setBufferState(
+    com_buffer, buffer, pipeline_stage_flags, access_flags, force);
+}
+
 void finish_frame(vk::CommandBuffer com_buffer)
 {
   etna::get_context().getResourceTracker().flushBarriers(com_buffer);
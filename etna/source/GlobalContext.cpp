@@ -1,5 +1,7 @@
 #include <etna/GlobalContext.hpp>
 
+#include <algorithm>
+#include <optional>
 #include <unordered_set>
 #include <spdlog/fmt/ranges.h>
 #include <tracy/TracyVulkan.hpp>
@@ -15,7 +17,11 @@
 #include <etna/Window.hpp>
 #include <etna/PerFrameCmdMgr.hpp>
 #include <etna/OneShotCmdMgr.hpp>
+#include <etna/SecondaryCmdMgr.hpp>
+#include <etna/StaticCommandBuffer.hpp>
+#include <etna/RenderTargetPool.hpp>
 
+#include "StagingCopier.hpp"
 #include "StateTracking.hpp"
 
 
@@ -88,6 +94,8 @@ static bool check_physical_device_supports_extensions(
 struct OptionalExtensionsFound
 {
   bool hasVkExtCalibratedTimestamps = false;
+  bool hasVkKhrDynamicRenderingLocalRead = false;
+  bool hasVkExtImageViewMinLod = false;
 };
 
 static OptionalExtensionsFound collect_optional_extensions_to_use(vk::PhysicalDevice pdevice)
@@ -103,6 +111,113 @@ static OptionalExtensionsFound collect_optional_extensions_to_use(vk::PhysicalDe
       safe_view_of_array(ext.extensionName) ==
       std::string_view(vk::KHRCalibratedTimestampsExtensionName))
       result.hasVkExtCalibratedTimestamps = true;
+    else if (
+      safe_view_of_array(ext.extensionName) ==
+      std::string_view(vk::KHRDynamicRenderingLocalReadExtensionName))
+      result.hasVkKhrDynamicRenderingLocalRead = true;
+    else if (
+      safe_view_of_array(ext.extensionName) ==
+      std::string_view(vk::EXTImageViewMinLodExtensionName))
+      result.hasVkExtImageViewMinLod = true;
+  }
+
+  return result;
+}
+
+// Vulkan forbids enabling features both through PhysicalDeviceVulkan12Features and
+// through the structs of extensions that were promoted to Vulkan 1.2.
+static bool chain_has_promoted_vulkan12_features(const void* chain)
+{
+  constexpr std::array PROMOTED_TYPES{
+    vk::StructureType::ePhysicalDevice8BitStorageFeatures,
+    vk::StructureType::ePhysicalDeviceShaderAtomicInt64Features,
+    vk::StructureType::ePhysicalDeviceShaderFloat16Int8Features,
+    vk::StructureType::ePhysicalDeviceDescriptorIndexingFeatures,
+    vk::StructureType::ePhysicalDeviceScalarBlockLayoutFeatures,
+    vk::StructureType::ePhysicalDeviceImagelessFramebufferFeatures,
+    vk::StructureType::ePhysicalDeviceUniformBufferStandardLayoutFeatures,
+    vk::StructureType::ePhysicalDeviceShaderSubgroupExtendedTypesFeatures,
+    vk::StructureType::ePhysicalDeviceSeparateDepthStencilLayoutsFeatures,
+    vk::StructureType::ePhysicalDeviceHostQueryResetFeatures,
+    vk::StructureType::ePhysicalDeviceTimelineSemaphoreFeatures,
+    vk::StructureType::ePhysicalDeviceBufferDeviceAddressFeatures,
+    vk::StructureType::ePhysicalDeviceVulkanMemoryModelFeatures,
+  };
+  for (auto it = static_cast<const vk::BaseInStructure*>(chain); it != nullptr; it = it->pNext)
+    if (std::find(PROMOTED_TYPES.begin(), PROMOTED_TYPES.end(), it->sType) != PROMOTED_TYPES.end())
+      return true;
+  return false;
+}
+
+static const vk::PhysicalDeviceVulkan12Features* find_vulkan12_features(const void* chain)
+{
+  for (auto it = static_cast<const vk::BaseInStructure*>(chain); it != nullptr; it = it->pNext)
+    if (it->sType == vk::StructureType::ePhysicalDeviceVulkan12Features)
+      return reinterpret_cast<const vk::PhysicalDeviceVulkan12Features*>(it);
+  return nullptr;
+}
+
+static GlobalContext::OptionalFeatures collect_optional_features_to_use(
+  vk::PhysicalDevice pdevice,
+  const OptionalExtensionsFound& optional_exts,
+  const InitParams& params)
+{
+  const auto features = pdevice.getFeatures2<
+    vk::PhysicalDeviceFeatures2,
+    vk::PhysicalDeviceMultiviewFeatures,
+    vk::PhysicalDeviceVulkan12Features,
+    vk::PhysicalDeviceInlineUniformBlockFeatures>();
+
+  GlobalContext::OptionalFeatures result;
+  result.multiview = features.get<vk::PhysicalDeviceMultiviewFeatures>().multiview == vk::True;
+  result.inlineUniformBlock =
+    features.get<vk::PhysicalDeviceInlineUniformBlockFeatures>().inlineUniformBlock == vk::True;
+
+  // Vulkan 1.2 features are enabled by etna unless the application manages them itself
+  if (const auto* appFeatures12 = find_vulkan12_features(params.features.pNext))
+  {
+    result.drawIndirectCount = appFeatures12->drawIndirectCount == vk::True;
+    result.bufferDeviceAddress = appFeatures12->bufferDeviceAddress == vk::True;
+  }
+  else if (chain_has_promoted_vulkan12_features(params.features.pNext))
+  {
+    spdlog::warn(
+      "Optional Vulkan 1.2 features are disabled, as the application enables some of them "
+      "with separate structures. Use vk::PhysicalDeviceVulkan12Features instead.");
+  }
+  else
+  {
+    const auto& supported12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+    result.drawIndirectCount = supported12.drawIndirectCount == vk::True;
+    result.bufferDeviceAddress = supported12.bufferDeviceAddress == vk::True;
+    result.ownsVulkan12Features = true;
+  }
+
+  // Feature structs of extensions may only be queried when the extension is supported
+  if (optional_exts.hasVkKhrDynamicRenderingLocalRead)
+  {
+    const auto localReadFeatures = pdevice.getFeatures2<
+      vk::PhysicalDeviceFeatures2,
+      vk::PhysicalDeviceDynamicRenderingLocalReadFeaturesKHR>();
+    result.dynamicRenderingLocalRead =
+      localReadFeatures.get<vk::PhysicalDeviceDynamicRenderingLocalReadFeaturesKHR>()
+        .dynamicRenderingLocalRead == vk::True;
+  }
+  if (optional_exts.hasVkExtImageViewMinLod)
+  {
+    const auto minLodFeatures = pdevice.getFeatures2<
+      vk::PhysicalDeviceFeatures2,
+      vk::PhysicalDeviceImageViewMinLodFeaturesEXT>();
+    result.imageViewMinLod =
+      minLodFeatures.get<vk::PhysicalDeviceImageViewMinLodFeaturesEXT>().minLod == vk::True;
+  }
+
+  // Only useful for rendering, so compute only devices don't pay for enabling them
+  if (params.profile == ContextProfile::eComputeOnly)
+  {
+    result.multiview = false;
+    result.dynamicRenderingLocalRead = false;
+    result.drawIndirectCount = false;
   }
 
   return result;
@@ -200,36 +315,100 @@ static uint32_t get_queue_family_index(vk::PhysicalDevice pdevice, vk::QueueFlag
   ETNA_PANIC("Could not find a queue family that supports all requested flags!");
 }
 
+// Families without graphics support are preferred, as they usually run compute work
+// asynchronously to the graphics queues that other applications submit to.
+static uint32_t get_compute_queue_family_index(vk::PhysicalDevice pdevice)
+{
+  std::vector queueFamilies = pdevice.getQueueFamilyProperties();
+
+  std::optional<uint32_t> result;
+  for (uint32_t i = 0; i < queueFamilies.size(); ++i)
+  {
+    const auto& props = queueFamilies[i];
+    if (props.queueCount == 0 || !(props.queueFlags & vk::QueueFlagBits::eCompute))
+      continue;
+
+    if (!(props.queueFlags & vk::QueueFlagBits::eGraphics))
+      return i;
+    if (!result.has_value())
+      result = i;
+  }
+
+  ETNA_VERIFYF(result.has_value(), "Could not find a queue family that supports compute!");
+  return *result;
+}
+
 static vk::UniqueDevice create_logical_device(
   vk::PhysicalDevice pdevice,
   uint32_t universal_queue_family,
+  uint32_t queue_count,
   const InitParams& params,
-  const OptionalExtensionsFound& optional_exts)
+  const OptionalExtensionsFound& optional_exts,
+  const GlobalContext::OptionalFeatures& optional_features)
 {
-  const float defaultQueuePriority{0.0f};
+  const std::vector<float> queuePriorities(queue_count, 0.0f);
 
-  // For now we use a single universal queue for everything.
+  // For now we use a single universal queue for everything, except for compute only
+  // contexts, which may have several queues of the same family.
   // Also, it's up to the framework to decide what queues it needs and supports.
 
   const std::array queueInfos{
     vk::DeviceQueueCreateInfo{
       .queueFamilyIndex = universal_queue_family,
-      .queueCount = 1,
-      .pQueuePriorities = &defaultQueuePriority,
+      .queueCount = queue_count,
+      .pQueuePriorities = queuePriorities.data(),
     },
   };
+  const bool computeOnly = params.profile == ContextProfile::eComputeOnly;
 
-  vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeature{
+  vk::PhysicalDeviceVulkan12Features features12{
     // Evil const cast due to C not having const
     .pNext = const_cast<vk::PhysicalDeviceFeatures2*>(&params.features), // NOLINT
+    .drawIndirectCount = optional_features.drawIndirectCount ? vk::True : vk::False,
+    .bufferDeviceAddress = optional_features.bufferDeviceAddress ? vk::True : vk::False,
+  };
+
+  void* baseFeatures = optional_features.ownsVulkan12Features
+    ? static_cast<void*>(&features12)
+    // Evil const cast due to C not having const
+    : static_cast<void*>(const_cast<vk::PhysicalDeviceFeatures2*>(&params.features)); // NOLINT
+
+  vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeature{
+    .pNext = baseFeatures,
     .dynamicRendering = vk::True,
   };
 
-  vk::PhysicalDeviceSynchronization2Features sync2Feature{
+  vk::PhysicalDeviceDynamicRenderingLocalReadFeaturesKHR localReadFeature{
     .pNext = &dynamicRenderingFeature,
+    .dynamicRenderingLocalRead = vk::True,
+  };
+
+  vk::PhysicalDeviceMultiviewFeatures multiviewFeature{
+    .pNext = optional_features.dynamicRenderingLocalRead
+      ? static_cast<void*>(&localReadFeature)
+      : static_cast<void*>(&dynamicRenderingFeature),
+    .multiview = optional_features.multiview ? vk::True : vk::False,
+  };
+
+  // Compute only devices skip all of the rendering features
+  void* sharedFeatures = computeOnly ? baseFeatures : static_cast<void*>(&multiviewFeature);
+
+  vk::PhysicalDeviceImageViewMinLodFeaturesEXT minLodFeature{
+    .pNext = sharedFeatures,
+    .minLod = vk::True,
+  };
+
+  vk::PhysicalDeviceSynchronization2Features sync2Feature{
+    .pNext = optional_features.imageViewMinLod ? static_cast<void*>(&minLodFeature)
+                                               : sharedFeatures,
     .synchronization2 = vk::True,
   };
 
+  vk::PhysicalDeviceInlineUniformBlockFeatures inlineUniformBlockFeature{
+    .pNext = &sync2Feature,
+    .inlineUniformBlock = vk::True,
+  };
+
   std::vector<char const*> deviceExtensions(
     params.deviceExtensions.begin(), params.deviceExtensions.end());
 
@@ -238,10 +417,21 @@ static vk::UniqueDevice create_logical_device(
     deviceExtensions.push_back(vk::KHRCalibratedTimestampsExtensionName);
   }
 
+  if (optional_features.dynamicRenderingLocalRead)
+  {
+    deviceExtensions.push_back(vk::KHRDynamicRenderingLocalReadExtensionName);
+  }
+
+  if (optional_features.imageViewMinLod)
+  {
+    deviceExtensions.push_back(vk::EXTImageViewMinLodExtensionName);
+  }
+
   // NOTE: These extensions are needed on MoltenVK to be set explicitly due to
   // it not fully supporting Vulkan 1.3 yet.
 #if defined(__APPLE__)
-  deviceExtensions.push_back(vk::KHRDynamicRenderingExtensionName);
+  if (!computeOnly)
+    deviceExtensions.push_back(vk::KHRDynamicRenderingExtensionName);
   deviceExtensions.push_back(vk::KHRSynchronization2ExtensionName);
   deviceExtensions.push_back(vk::KHRCopyCommands2ExtensionName);
 
@@ -255,7 +445,9 @@ static vk::UniqueDevice create_logical_device(
   // PhysicalDeviceFeatures2 structure while the actual
   // pEnabledFeatures has to be nullptr.
   vk::DeviceCreateInfo creatInfo{
-    .pNext = &sync2Feature,
+    .pNext = optional_features.inlineUniformBlock
+      ? static_cast<void*>(&inlineUniformBlockFeature)
+      : static_cast<void*>(&sync2Feature),
     .queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size()),
     .pQueueCreateInfos = queueInfos.data(),
     .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
@@ -295,8 +487,12 @@ static VkBool32 debugCallback(
 }
 #endif
 
+// Device level functions loaded for one device must not be called with another one
+static std::size_t gLiveContexts = 0;
+
 GlobalContext::GlobalContext(const InitParams& params)
   : mainWorkStream{params.numFramesInFlight}
+  , computeOnly{params.profile == ContextProfile::eComputeOnly}
   , tracyCtx{nullptr, +[](void* ctx) {
                (void)ctx;
                TracyVkDestroy(reinterpret_cast<TracyVkCtx>(ctx));
@@ -341,14 +537,38 @@ GlobalContext::GlobalContext(const InitParams& params)
   vkPhysDevice = pick_physical_device(vkInstance.get(), params);
 
   const auto optionalExts = collect_optional_extensions_to_use(vkPhysDevice);
+  optionalFeatures = collect_optional_features_to_use(vkPhysDevice, optionalExts, params);
 
-  constexpr auto UNIVERSAL_QUEUE_FLAGS =
-    vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer;
-  universalQueueFamilyIdx = get_queue_family_index(vkPhysDevice, UNIVERSAL_QUEUE_FLAGS);
-  vkDevice = create_logical_device(vkPhysDevice, universalQueueFamilyIdx, params, optionalExts);
-  VULKAN_HPP_DEFAULT_DISPATCHER.init(vkDevice.get());
+  uint32_t queueCount = 1;
+  if (computeOnly)
+  {
+    universalQueueFamilyIdx = get_compute_queue_family_index(vkPhysDevice);
+    const uint32_t available =
+      vkPhysDevice.getQueueFamilyProperties()[universalQueueFamilyIdx].queueCount;
+    ETNA_VERIFYF(params.computeQueueCount > 0, "At least one compute queue is required!");
+    queueCount = std::min(params.computeQueueCount, available);
+    if (queueCount < params.computeQueueCount)
+      spdlog::warn(
+        "Requested {} compute queues, but the queue family only has {}",
+        params.computeQueueCount,
+        available);
+  }
+  else
+  {
+    constexpr auto UNIVERSAL_QUEUE_FLAGS =
+      vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer;
+    universalQueueFamilyIdx = get_queue_family_index(vkPhysDevice, UNIVERSAL_QUEUE_FLAGS);
+  }
+  vkDevice = create_logical_device(
+    vkPhysDevice, universalQueueFamilyIdx, queueCount, params, optionalExts, optionalFeatures);
+  // With several contexts, device level functions go through the loader's trampolines,
+  // which were loaded along with the instance ones and dispatch on the device handle.
+  if (++gLiveContexts == 1)
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(vkDevice.get());
 
-  universalQueue = vkDevice->getQueue(universalQueueFamilyIdx, 0);
+  for (uint32_t i = 0; i < queueCount; ++i)
+    computeQueues.push_back(vkDevice->getQueue(universalQueueFamilyIdx, i));
+  universalQueue = computeQueues.front();
 
   {
     VmaVulkanFunctions functions{};
@@ -356,7 +576,9 @@ GlobalContext::GlobalContext(const InitParams& params)
     functions.vkGetDeviceProcAddr = VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr;
 
     VmaAllocatorCreateInfo allocInfo{
-      .flags = {},
+      .flags = optionalFeatures.bufferDeviceAddress
+        ? VmaAllocatorCreateFlags{VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT}
+        : VmaAllocatorCreateFlags{},
       .physicalDevice = vkPhysDevice,
       .device = vkDevice.get(),
 
@@ -378,49 +600,57 @@ GlobalContext::GlobalContext(const InitParams& params)
   }
 
   descriptorSetLayouts = std::make_unique<DescriptorSetLayoutCache>();
-  shaderPrograms = std::make_unique<ShaderProgramManager>();
+  shaderPrograms = std::make_unique<ShaderProgramManager>(*this);
   pipelineManager = std::make_unique<PipelineManager>(vkDevice.get(), *shaderPrograms);
-  descriptorPool = std::make_unique<DynamicDescriptorPool>(vkDevice.get(), mainWorkStream);
+  descriptorPool = std::make_unique<DynamicDescriptorPool>(
+    vkDevice.get(), mainWorkStream, optionalFeatures.inlineUniformBlock);
   resourceTracking = std::make_unique<ResourceStates>();
-
-  auto tempPool =
-    etna::unwrap_vk_result(vkDevice->createCommandPoolUnique(vk::CommandPoolCreateInfo{
-      .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-      .queueFamilyIndex = universalQueueFamilyIdx,
-    }));
-  auto buf = std::move(
-    etna::unwrap_vk_result(vkDevice->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
-      .commandPool = tempPool.get(),
-      .level = vk::CommandBufferLevel::ePrimary,
-      .commandBufferCount = 1,
-    }))[0]);
+  staticRecordings = std::make_unique<StaticRecordingRetireList>(mainWorkStream);
+  stagingCopier = std::make_unique<StagingCopier>(0);
 
   // Workaround for issues in Tracy =(
 #ifdef TRACY_ENABLE
-  // TODO: support TracyVkContextHostCalibrated
-  if (optionalExts.hasVkExtCalibratedTimestamps)
-  {
-    auto ctx = TracyVkContextCalibrated(
-      vkInstance.get(),
-      vkPhysDevice,
-      vkDevice.get(),
-      universalQueue,
-      buf.get(),
-      VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr,
-      VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr);
-    tracyCtx.reset(ctx);
-  }
-  else
+  // Compute only contexts are mostly used for short batch jobs, where the
+  // timestamp calibration would take longer than the work being profiled
+  if (!computeOnly)
   {
-    auto ctx = TracyVkContext(
-      vkInstance.get(),
-      vkPhysDevice,
-      vkDevice.get(),
-      universalQueue,
-      buf.get(),
-      VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr,
-      VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr);
-    tracyCtx.reset(ctx);
+    auto tempPool =
+      etna::unwrap_vk_result(vkDevice->createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+        .queueFamilyIndex = universalQueueFamilyIdx,
+      }));
+    auto buf = std::move(
+      etna::unwrap_vk_result(vkDevice->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool = tempPool.get(),
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+      }))[0]);
+
+    // TODO: support TracyVkContextHostCalibrated
+    if (optionalExts.hasVkExtCalibratedTimestamps)
+    {
+      auto ctx = TracyVkContextCalibrated(
+        vkInstance.get(),
+        vkPhysDevice,
+        vkDevice.get(),
+        universalQueue,
+        buf.get(),
+        VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr,
+        VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr);
+      tracyCtx.reset(ctx);
+    }
+    else
+    {
+      auto ctx = TracyVkContext(
+        vkInstance.get(),
+        vkPhysDevice,
+        vkDevice.get(),
+        universalQueue,
+        buf.get(),
+        VULKAN_HPP_DEFAULT_DISPATCHER.vkGetInstanceProcAddr,
+        VULKAN_HPP_DEFAULT_DISPATCHER.vkGetDeviceProcAddr);
+      tracyCtx.reset(ctx);
+    }
   }
 #endif
 }
@@ -432,11 +662,17 @@ Image GlobalContext::createImage(const Image::CreateInfo& info)
 
 Buffer GlobalContext::createBuffer(const Buffer::CreateInfo& info)
 {
+  ETNA_VERIFYF(
+    optionalFeatures.bufferDeviceAddress ||
+      !(info.bufferUsage & vk::BufferUsageFlagBits::eShaderDeviceAddress),
+    "Buffer {} requests a device address, but the bufferDeviceAddress feature is disabled!",
+    info.name);
   return Buffer(vmaAllocator.get(), info);
 }
 
 std::unique_ptr<Window> GlobalContext::createWindow(Window::CreateInfo info)
 {
+  ETNA_VERIFYF(!computeOnly, "Compute only contexts can't present to windows!");
   Window::Dependencies deps{
     .workCount = mainWorkStream,
     .physicalDevice = vkPhysDevice,
@@ -465,6 +701,42 @@ std::unique_ptr<OneShotCmdMgr> GlobalContext::createOneShotCmdMgr()
   return std::make_unique<OneShotCmdMgr>(deps);
 }
 
+std::unique_ptr<SecondaryCmdMgr> GlobalContext::createSecondaryCmdMgr(std::size_t thread_count)
+{
+  SecondaryCmdMgr::Dependencies deps{
+    .workCount = mainWorkStream,
+    .device = vkDevice.get(),
+    .queueFamily = universalQueueFamilyIdx,
+    .threadCount = thread_count};
+  return std::make_unique<SecondaryCmdMgr>(deps);
+}
+
+std::unique_ptr<StaticCommandBuffer> GlobalContext::createStaticCommandBuffer()
+{
+  StaticCommandBuffer::Dependencies deps{
+    .workCount = mainWorkStream,
+    .retireList = *staticRecordings,
+    .device = vkDevice.get(),
+    .queueFamily = universalQueueFamilyIdx,
+    .inlineUniformBlocks = optionalFeatures.inlineUniformBlock};
+  return std::make_unique<StaticCommandBuffer>(deps);
+}
+
+std::unique_ptr<RenderTargetPool> GlobalContext::createRenderTargetPool()
+{
+  RenderTargetPool::Dependencies deps{
+    .workCount = mainWorkStream, .device = vkDevice.get(), .allocator = vmaAllocator.get()};
+  return std::make_unique<RenderTargetPool>(deps);
+}
+
+std::unique_ptr<ResidencyManager> GlobalContext::createResidencyManager(
+  ResidencyManager::CreateInfo info)
+{
+  ResidencyManager::Dependencies deps{
+    .workCount = mainWorkStream, .device = vkDevice.get(), .allocator = vmaAllocator.get()};
+  return std::make_unique<ResidencyManager>(deps, info);
+}
+
 ShaderProgramManager& GlobalContext::getShaderManager()
 {
   return *shaderPrograms;
@@ -490,7 +762,21 @@ ResourceStates& GlobalContext::getResourceTracker()
   return *resourceTracking;
 }
 
-GlobalContext::~GlobalContext() = default;
+StaticRecordingRetireList& GlobalContext::getStaticRecordingRetireList()
+{
+  return *staticRecordings;
+}
+
+StagingCopier& GlobalContext::getStagingCopier()
+{
+  return *stagingCopier;
+}
+
+GlobalContext::~GlobalContext()
+{
+  descriptorSetLayouts->clear(vkDevice.get());
+  --gLiveContexts;
+}
 
 
 bool GlobalContext::shouldGenerateBarriersWhen(BarrierBehavoir behavoir) const
@@ -0,0 +1,199 @@
+#include <etna/GpuCulling.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include "BuiltinShaders.hpp"
+
+
+namespace etna
+{
+
+static constexpr std::uint32_t CULL_GROUP_SIZE = 64;
+
+// Mirrors the CullParams uniform block of cull_instances.comp (std140)
+struct CullParamsData
+{
+  std::array<float, 16> viewProj;
+  std::array<std::array<float, 4>, 6> frustumPlanes;
+  std::array<float, 2> depthPyramidSize;
+  std::uint32_t instanceCount;
+  std::uint32_t depthPyramidMipCount;
+};
+static_assert(sizeof(CullParamsData) == 176);
+
+// Gribb-Hartmann plane extraction for [0, 1] clip space depth
+static std::array<std::array<float, 4>, 6> extract_frustum_planes(
+  const std::array<float, 16>& view_proj)
+{
+  auto row = [&view_proj](std::size_t i) {
+    return std::array<float, 4>{
+      view_proj[i], view_proj[4 + i], view_proj[8 + i], view_proj[12 + i]};
+  };
+  auto combine = [](std::array<float, 4> a, std::array<float, 4> b, float sign) {
+    std::array<float, 4> result{};
+    for (std::size_t i = 0; i < 4; ++i)
+      result[i] = a[i] + sign * b[i];
+    return result;
+  };
+  const auto r0 = row(0);
+  const auto r1 = row(1);
+  const auto r2 = row(2);
+  const auto r3 = row(3);
+
+  std::array<std::array<float, 4>, 6> planes{
+    combine(r3, r0, 1.0f),
+    combine(r3, r0, -1.0f),
+    combine(r3, r1, 1.0f),
+    combine(r3, r1, -1.0f),
+    r2,
+    combine(r3, r2, -1.0f),
+  };
+  for (auto& plane : planes)
+  {
+    const float length =
+      std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    for (auto& component : plane)
+      component /= length;
+  }
+  return planes;
+}
+
+GpuCulling::GpuCulling(CreateInfo info)
+  : maxInstances{info.maxInstances}
+  , occlusionCulling{info.occlusionCulling}
+  , programId{
+      info.occlusionCulling ? get_builtin_program("etna_cull_hiz", {"cull_hiz.comp.spv"})
+                            : get_builtin_program("etna_cull_frustum", {"cull_frustum.comp.spv"})}
+  , pipeline{get_context().getPipelineManager().createComputePipeline(
+      info.occlusionCulling ? "etna_cull_hiz" : "etna_cull_frustum", {})}
+  , depthPyramidSampler{Sampler::CreateInfo{
+      .filter = vk::Filter::eNearest,
+      .addressMode = vk::SamplerAddressMode::eClampToEdge,
+      .name = "GpuCulling::depthPyramidSampler",
+      .maxLod = vk::LodClampNone,
+    }}
+  , instances{get_context().createBuffer(Buffer::CreateInfo{
+      .size = sizeof(GpuInstance) * info.maxInstances,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = std::string(info.name) + "::instances",
+    })}
+  , drawCommands{get_context().createBuffer(Buffer::CreateInfo{
+      .size = sizeof(vk::DrawIndexedIndirectCommand) * info.maxInstances,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = std::string(info.name) + "::drawCommands",
+    })}
+  , drawCount{get_context().createBuffer(Buffer::CreateInfo{
+      .size = sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+      .name = std::string(info.name) + "::drawCount",
+    })}
+  , cullParams{get_context().getMainWorkCount(), [&info](std::size_t) {
+                 auto buffer = get_context().createBuffer(Buffer::CreateInfo{
+                   .size = sizeof(CullParamsData),
+                   .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
+                   .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+                   .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                     VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                   .name = std::string(info.name) + "::cullParams",
+                 });
+                 buffer.map();
+                 return buffer;
+               }}
+{
+  ETNA_VERIFYF(
+    get_context().getOptionalFeatures().drawIndirectCount,
+    "GPU-driven drawing requires the drawIndirectCount feature!");
+}
+
+void GpuCulling::cull(vk::CommandBuffer cmd_buf, const CullParams& params)
+{
+  ETNA_PROFILE_GPU(cmd_buf, GpuCulling::cull);
+
+  ETNA_VERIFYF(
+    params.instanceCount <= maxInstances,
+    "Can't cull {} instances, the buffers were created for {}!",
+    params.instanceCount,
+    maxInstances);
+  ETNA_VERIFYF(
+    !occlusionCulling || params.depthPyramid != nullptr,
+    "Occlusion culling requires a depth pyramid!");
+
+  CullParamsData data{
+    .viewProj = params.viewProj,
+    .frustumPlanes = extract_frustum_planes(params.viewProj),
+    .depthPyramidSize = {},
+    .instanceCount = params.instanceCount,
+    .depthPyramidMipCount = 0,
+  };
+  if (occlusionCulling)
+  {
+    const auto extent = params.depthPyramid->getExtent();
+    data.depthPyramidSize = {static_cast<float>(extent.width), static_cast<float>(extent.height)};
+    data.depthPyramidMipCount = params.depthPyramid->getMipLevelCount();
+  }
+  auto& paramsBuffer = cullParams.get();
+  std::memcpy(paramsBuffer.data(), &data, sizeof(data));
+
+  etna::set_state(
+    cmd_buf,
+    drawCount.get(),
+    vk::PipelineStageFlagBits2::eClear,
+    vk::AccessFlagBits2::eTransferWrite);
+  etna::flush_barriers(cmd_buf);
+  cmd_buf.fillBuffer(drawCount.get(), 0, sizeof(std::uint32_t), 0);
+
+  std::vector<Binding> bindings{
+    Binding{0, instances.genBinding()},
+    Binding{1, drawCommands.genBinding()},
+    Binding{2, drawCount.genBinding()},
+    Binding{3, paramsBuffer.genBinding()},
+  };
+  if (occlusionCulling)
+    bindings.emplace_back(
+      4,
+      params.depthPyramid->genBinding(
+        depthPyramidSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
+
+  // Also sets the states of all bound resources
+  auto set = etna::create_descriptor_set(
+    get_shader_program(programId).getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  cmd_buf.dispatch((params.instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  for (auto buffer : {drawCommands.get(), drawCount.get()})
+    etna::set_state(
+      cmd_buf,
+      buffer,
+      vk::PipelineStageFlagBits2::eDrawIndirect,
+      vk::AccessFlagBits2::eIndirectCommandRead);
+  etna::flush_barriers(cmd_buf);
+}
+
+void GpuCulling::drawIndexedIndirectCount(vk::CommandBuffer cmd_buf) const
+{
+  cmd_buf.drawIndexedIndirectCount(
+    drawCommands.get(),
+    0,
+    drawCount.get(),
+    0,
+    maxInstances,
+    sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+} // namespace etna
@@ -0,0 +1,342 @@
+#include <etna/GpuPrimitives.hpp>
+
+#include <algorithm>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include "BuiltinShaders.hpp"
+
+
+namespace etna
+{
+
+// Must be kept in sync with shaders/primitives.glsl
+static constexpr std::uint32_t BLOCK_SIZE = 1024;
+static constexpr std::uint32_t GROUP_SIZE = 256;
+static constexpr std::uint32_t RADIX_BITS = 4;
+static constexpr std::uint32_t RADIX = 1 << RADIX_BITS;
+
+// Mirror the push constant blocks of the shaders
+struct ScanParams
+{
+  std::uint32_t count;
+  std::uint32_t mode;
+  std::uint32_t inclusive;
+  std::uint32_t predicate;
+};
+struct ReduceParams
+{
+  std::uint32_t count;
+  std::uint32_t op;
+};
+struct CompactParams
+{
+  std::uint32_t count;
+};
+struct RadixSortParams
+{
+  std::uint32_t count;
+  std::uint32_t shift;
+  std::uint32_t mode;
+  std::uint32_t blockCount;
+};
+
+static constexpr std::uint32_t SCAN_MODE_SCAN_BLOCKS = 0;
+static constexpr std::uint32_t SCAN_MODE_ADD_BLOCK_SUMS = 1;
+static constexpr std::uint32_t SORT_MODE_HISTOGRAM = 0;
+static constexpr std::uint32_t SORT_MODE_SCATTER = 1;
+
+static std::uint32_t div_ceil(std::uint32_t a, std::uint32_t b)
+{
+  return (a + b - 1) / b;
+}
+
+template <class T>
+static std::span<const std::byte> as_push_constants(const T& params)
+{
+  return std::as_bytes(std::span{&params, 1});
+}
+
+static bool supports_subgroup_arithmetic()
+{
+  const auto chain = get_context()
+                       .getPhysicalDevice()
+                       .getProperties2<
+                         vk::PhysicalDeviceProperties2,
+                         vk::PhysicalDeviceSubgroupProperties>();
+  const auto& props = chain.get<vk::PhysicalDeviceSubgroupProperties>();
+  const auto requiredOps =
+    vk::SubgroupFeatureFlagBits::eBasic | vk::SubgroupFeatureFlagBits::eArithmetic;
+  return (props.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+    (props.supportedOperations & requiredOps) == requiredOps;
+}
+
+static Buffer create_scratch_buffer(std::uint32_t elements, std::string name)
+{
+  return get_context().createBuffer(Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * std::max(elements, 1u),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+    .name = std::move(name),
+  });
+}
+
+GpuPrimitives::GpuPrimitives(CreateInfo info)
+  : maxElements{info.maxElements}
+  , subgroups{!info.disableSubgroups && supports_subgroup_arithmetic()}
+  , scanKernel{createKernel("scan")}
+  , reduceKernel{createKernel("reduce")}
+  , compactKernel{createKernel("compact")}
+  , radixSortKernel{createKernel("radix_sort")}
+  , compactOffsets{create_scratch_buffer(info.maxElements, std::string(info.name) + "::offsets")}
+  , sortKeys{create_scratch_buffer(info.maxElements, std::string(info.name) + "::keys")}
+  , sortValues{create_scratch_buffer(info.maxElements, std::string(info.name) + "::values")}
+  , sortHistogram{create_scratch_buffer(
+      RADIX * div_ceil(info.maxElements, BLOCK_SIZE), std::string(info.name) + "::histogram")}
+{
+  const auto& limits = get_context().getPhysicalDevice().getProperties().limits;
+  ETNA_VERIFYF(
+    div_ceil(maxElements, BLOCK_SIZE) <= limits.maxComputeWorkGroupCount[0],
+    "{} elements are too many for a single dispatch!",
+    maxElements);
+
+  // The histogram of the radix sort is scanned as well
+  std::uint32_t levelCount = std::max(maxElements, RADIX * div_ceil(maxElements, BLOCK_SIZE));
+  do
+  {
+    levelCount = div_ceil(levelCount, BLOCK_SIZE);
+    blockSums.push_back(create_scratch_buffer(
+      levelCount, fmt::format("{}::blockSums{}", info.name, blockSums.size())));
+  } while (levelCount > 1);
+}
+
+GpuPrimitives::Kernel GpuPrimitives::createKernel(const char* name) const
+{
+  const std::string variant = subgroups ? std::string(name) + "_subgroup" : std::string(name);
+  const std::string programName = "etna_" + variant;
+  const std::string file = variant + ".comp.spv";
+  get_builtin_program(programName.c_str(), {file.c_str()});
+  return Kernel{
+    .programName = programName,
+    .pipeline =
+      get_context().getPipelineManager().createComputePipeline(programName.c_str(), {}),
+  };
+}
+
+void GpuPrimitives::dispatch(
+  vk::CommandBuffer cmd_buf,
+  const Kernel& kernel,
+  std::initializer_list<const Buffer*> buffers,
+  std::span<const std::byte> push_constants,
+  std::uint32_t group_count)
+{
+  std::vector<Binding> bindings;
+  bindings.reserve(buffers.size());
+  for (auto it = buffers.begin(); it != buffers.end(); ++it)
+  {
+    const Buffer* buffer = *it;
+    // Consecutive passes access the same buffers the same way, and the tracker
+    // doesn't separate identical states with barriers unless forced to.
+    if (std::find(buffers.begin(), it, buffer) == it)
+      etna::set_state(
+        cmd_buf,
+        buffer->get(),
+        vk::PipelineStageFlagBits2::eComputeShader,
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+        ForceSetState::eTrue);
+    bindings.emplace_back(static_cast<std::uint32_t>(bindings.size()), buffer->genBinding());
+  }
+  etna::flush_barriers(cmd_buf);
+
+  auto set = etna::create_descriptor_set(
+    get_shader_program(kernel.programName.c_str()).getDescriptorLayoutId(0),
+    cmd_buf,
+    std::move(bindings),
+    BarrierBehavoir::eSuppressBarriers);
+
+  const auto& pipeline = kernel.pipeline;
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants(
+    pipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    static_cast<std::uint32_t>(push_constants.size()),
+    push_constants.data());
+  cmd_buf.dispatch(group_count, 1, 1);
+}
+
+void GpuPrimitives::scan(
+  vk::CommandBuffer cmd_buf,
+  const Buffer& src,
+  const Buffer& dst,
+  std::uint32_t count,
+  bool inclusive,
+  bool predicate,
+  std::size_t level)
+{
+  const std::uint32_t blockCount = div_ceil(count, BLOCK_SIZE);
+  const Buffer& sums = blockSums[level];
+
+  dispatch(
+    cmd_buf,
+    scanKernel,
+    {&src, &dst, &sums},
+    as_push_constants(ScanParams{
+      .count = count,
+      .mode = SCAN_MODE_SCAN_BLOCKS,
+      .inclusive = inclusive,
+      .predicate = predicate,
+    }),
+    blockCount);
+
+  if (blockCount == 1)
+    return;
+
+  scan(cmd_buf, sums, sums, blockCount, false, false, level + 1);
+
+  dispatch(
+    cmd_buf,
+    scanKernel,
+    {&src, &dst, &sums},
+    as_push_constants(ScanParams{
+      .count = count,
+      .mode = SCAN_MODE_ADD_BLOCK_SUMS,
+      .inclusive = inclusive,
+      .predicate = predicate,
+    }),
+    blockCount);
+}
+
+void GpuPrimitives::exclusiveScan(
+  vk::CommandBuffer cmd_buf, const Buffer& src, const Buffer& dst, std::uint32_t count)
+{
+  ETNA_PROFILE_GPU(cmd_buf, GpuPrimitives::exclusiveScan);
+  ETNA_VERIFYF(
+    count <= maxElements, "Can't scan {} elements, the limit is {}!", count, maxElements);
+  if (count != 0)
+    scan(cmd_buf, src, dst, count, false, false);
+}
+
+void GpuPrimitives::inclusiveScan(
+  vk::CommandBuffer cmd_buf, const Buffer& src, const Buffer& dst, std::uint32_t count)
+{
+  ETNA_PROFILE_GPU(cmd_buf, GpuPrimitives::inclusiveScan);
+  ETNA_VERIFYF(
+    count <= maxElements, "Can't scan {} elements, the limit is {}!", count, maxElements);
+  if (count != 0)
+    scan(cmd_buf, src, dst, count, true, false);
+}
+
+void GpuPrimitives::reduce(
+  vk::CommandBuffer cmd_buf,
+  const Buffer& src,
+  const Buffer& result,
+  std::uint32_t count,
+  ReduceOp op)
+{
+  ETNA_PROFILE_GPU(cmd_buf, GpuPrimitives::reduce);
+  ETNA_VERIFYF(
+    count <= maxElements, "Can't reduce {} elements, the limit is {}!", count, maxElements);
+
+  // Work groups atomically combine their results with the identity of the operation
+  etna::set_state(
+    cmd_buf,
+    result.get(),
+    vk::PipelineStageFlagBits2::eClear,
+    vk::AccessFlagBits2::eTransferWrite,
+    ForceSetState::eTrue);
+  etna::flush_barriers(cmd_buf);
+  cmd_buf.fillBuffer(
+    result.get(), 0, sizeof(std::uint32_t), op == ReduceOp::eMin ? 0xFFFFFFFFu : 0u);
+
+  if (count == 0)
+    return;
+
+  dispatch(
+    cmd_buf,
+    reduceKernel,
+    {&src, &result},
+    as_push_constants(ReduceParams{.count = count, .op = static_cast<std::uint32_t>(op)}),
+    div_ceil(count, BLOCK_SIZE));
+}
+
+void GpuPrimitives::compact(
+  vk::CommandBuffer cmd_buf,
+  const Buffer& values,
+  const Buffer& flags,
+  const Buffer& dst,
+  const Buffer& dst_count,
+  std::uint32_t count)
+{
+  ETNA_PROFILE_GPU(cmd_buf, GpuPrimitives::compact);
+  ETNA_VERIFYF(
+    count <= maxElements, "Can't compact {} elements, the limit is {}!", count, maxElements);
+
+  if (count != 0)
+    scan(cmd_buf, flags, compactOffsets, count, false, true);
+
+  // An empty array still gets its count written
+  dispatch(
+    cmd_buf,
+    compactKernel,
+    {&values, &flags, &compactOffsets, &dst, &dst_count},
+    as_push_constants(CompactParams{.count = count}),
+    std::max(div_ceil(count, GROUP_SIZE), 1u));
+}
+
+void GpuPrimitives::sortPairs(
+  vk::CommandBuffer cmd_buf, const Buffer& keys, const Buffer& values, std::uint32_t count)
+{
+  ETNA_PROFILE_GPU(cmd_buf, GpuPrimitives::sortPairs);
+  ETNA_VERIFYF(
+    count <= maxElements, "Can't sort {} elements, the limit is {}!", count, maxElements);
+
+  if (count < 2)
+    return;
+
+  const std::uint32_t blockCount = div_ceil(count, BLOCK_SIZE);
+  const Buffer* keysIn = &keys;
+  const Buffer* valuesIn = &values;
+  const Buffer* keysOut = &sortKeys;
+  const Buffer* valuesOut = &sortValues;
+
+  // An even amount of passes leaves the result in the original buffers
+  static_assert((32 / RADIX_BITS) % 2 == 0);
+  for (std::uint32_t shift = 0; shift < 32; shift += RADIX_BITS)
+  {
+    RadixSortParams params{
+      .count = count,
+      .shift = shift,
+      .mode = SORT_MODE_HISTOGRAM,
+      .blockCount = blockCount,
+    };
+    dispatch(
+      cmd_buf,
+      radixSortKernel,
+      {keysIn, valuesIn, keysOut, valuesOut, &sortHistogram},
+      as_push_constants(params),
+      blockCount);
+
+    scan(cmd_buf, sortHistogram, sortHistogram, RADIX * blockCount, false, false);
+
+    params.mode = SORT_MODE_SCATTER;
+    dispatch(
+      cmd_buf,
+      radixSortKernel,
+      {keysIn, valuesIn, keysOut, valuesOut, &sortHistogram},
+      as_push_constants(params),
+      blockCount);
+
+    std::swap(keysIn, keysOut);
+    std::swap(valuesIn, valuesOut);
+  }
+}
+
+} // namespace etna
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef ETNA_HALF_FLOAT_HPP_INCLUDED
+#define ETNA_HALF_FLOAT_HPP_INCLUDED
+
+#include <bit>
+#include <cstdint>
+
+
+namespace etna
+{
+
+// Rounds to nearest even, overflows to infinity and keeps NaNs
+inline std::uint16_t float_to_half(float value)
+{
+  constexpr std::uint32_t F32_INFINITY = 255u << 23;
+  constexpr std::uint32_t F16_OVERFLOW = (127u + 16u) << 23;
+  constexpr std::uint32_t MIN_NORMAL_F16 = 113u << 23;
+  // 0.5f, adding it aligns the mantissa of tiny values to the subnormal half one
+  constexpr std::uint32_t DENORM_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  std::uint32_t bits = std::bit_cast<std::uint32_t>(value);
+  const std::uint32_t sign = (bits >> 16) & 0x8000u;
+  bits &= 0x7FFFFFFFu;
+
+  std::uint32_t result;
+  if (bits >= F16_OVERFLOW)
+    result = bits > F32_INFINITY ? 0x7E00u : 0x7C00u;
+  else if (bits < MIN_NORMAL_F16)
+    result = std::bit_cast<std::uint32_t>(
+               std::bit_cast<float>(bits) + std::bit_cast<float>(DENORM_MAGIC)) -
+      DENORM_MAGIC;
+  else
+  {
+    const std::uint32_t mantissaOdd = (bits >> 13) & 1u;
+    // Rebiases the exponent from 127 to 15 and rounds the dropped mantissa bits
+    bits += (15u - 127u) * (1u << 23) + 0xFFFu + mantissaOdd;
+    result = bits >> 13;
+  }
+  return static_cast<std::uint16_t>(result | sign);
+}
+
+} // namespace etna
+
+#endif // ETNA_HALF_FLOAT_HPP_INCLUDED
@@ -2,26 +2,31 @@
 
 #include <etna/GlobalContext.hpp>
 #include "DebugUtils.hpp"
+#include "StateTracking.hpp"
 
 
 namespace etna
 {
 
 Image::Image(VmaAllocator alloc, CreateInfo info)
-  : allocator{alloc}
+  : context{&get_context()}
+  , allocator{alloc}
   , type{info.type}
   , format{info.format}
   , name{info.name}
   , extent{info.extent}
+  , mipLevels{static_cast<uint32_t>(info.mipLevels)}
+  , layers{static_cast<uint32_t>(info.layers)}
+  , samples{info.samples}
 {
   vk::ImageCreateInfo imageInfo{
     .flags = info.flags,
     .imageType = type,
     .format = format,
     .extent = extent,
-    .mipLevels = static_cast<uint32_t>(info.mipLevels),
-    .arrayLayers = static_cast<uint32_t>(info.layers),
-    .samples = info.samples,
+    .mipLevels = mipLevels,
+    .arrayLayers = layers,
+    .samples = samples,
     .tiling = info.tiling,
     .usage = info.imageUsage,
     .sharingMode = vk::SharingMode::eExclusive,
@@ -53,12 +58,13 @@ Image::Image(VmaAllocator alloc, CreateInfo info)
     "Error {} occurred while trying to allocate an etna::Image!",
     vk::to_string(static_cast<vk::Result>(retcode)));
   image = vk::Image(img);
-  etna::set_debug_name(image, name.c_str());
+  etna::set_debug_name(context->getDevice(), image, name.c_str());
 }
 
 void Image::swap(Image& other)
 {
   std::swap(views, other.views);
+  std::swap(context, other.context);
   std::swap(allocator, other.allocator);
   std::swap(allocation, other.allocation);
   std::swap(image, other.image);
@@ -66,6 +72,9 @@ void Image::swap(Image& other)
   std::swap(format, other.format);
   std::swap(name, other.name);
   std::swap(extent, other.extent);
+  std::swap(mipLevels, other.mipLevels);
+  std::swap(layers, other.layers);
+  std::swap(samples, other.samples);
 }
 
 Image::Image(Image&& other) noexcept
@@ -90,6 +99,7 @@ void Image::reset()
     return;
 
   views.clear();
+  context->getResourceTracker().forget(image);
   vmaDestroyImage(allocator, VkImage(image), allocation);
   allocator = {};
   allocation = {};
@@ -119,14 +129,14 @@ static vk::ImageAspectFlags get_aspect_mask(vk::Format format)
   }
 }
 
-static vk::ImageViewType get_view_type(vk::ImageType image_type)
+static vk::ImageViewType get_view_type(vk::ImageType image_type, uint32_t layer_count)
 {
   switch (image_type)
   {
   case vk::ImageType::e1D:
-    return vk::ImageViewType::e1D;
+    return layer_count > 1 ? vk::ImageViewType::e1DArray : vk::ImageViewType::e1D;
   case vk::ImageType::e2D:
-    return vk::ImageViewType::e2D;
+    return layer_count > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
   case vk::ImageType::e3D:
     return vk::ImageViewType::e3D;
   default:
@@ -145,9 +155,11 @@ vk::ImageView Image::getView(Image::ViewParams params) const
 
   if (it == views.end())
   {
+    const uint32_t viewedLayers =
+      params.layerCount == vk::RemainingArrayLayers ? layers - params.baseLayer : params.layerCount;
     vk::ImageViewCreateInfo viewInfo{
       .image = image,
-      .viewType = params.type ? params.type.value() : get_view_type(type),
+      .viewType = params.type ? params.type.value() : get_view_type(type, viewedLayers),
       .format = format,
       .subresourceRange = vk::ImageSubresourceRange{
         .aspectMask = params.aspectMask ? params.aspectMask.value() : get_aspect_mask(format),
@@ -156,8 +168,16 @@ vk::ImageView Image::getView(Image::ViewParams params) const
         .baseArrayLayer = params.baseLayer,
         .layerCount = params.layerCount,
       }};
-    auto view = unwrap_vk_result(etna::get_context().getDevice().createImageViewUnique(viewInfo));
-    set_debug_name(view.get(), name.c_str());
+    vk::ImageViewMinLodCreateInfoEXT minLodInfo{.minLod = params.minLod};
+    if (params.minLod != 0.0f)
+    {
+      ETNA_VERIFYF(
+        context->getOptionalFeatures().imageViewMinLod,
+        "Image view min LOD is not supported by the device!");
+      viewInfo.pNext = &minLodInfo;
+    }
+    auto view = unwrap_vk_result(context->getDevice().createImageViewUnique(viewInfo));
+    set_debug_name(context->getDevice(), view.get(), name.c_str());
     it = views.emplace(params, std::move(view)).first;
   }
 
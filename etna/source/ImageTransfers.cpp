@@ -0,0 +1,192 @@
+#include <etna/ImageTransfers.hpp>
+
+#include <limits>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include <etna/Etna.hpp>
+#include <etna/Profiling.hpp>
+
+
+namespace etna
+{
+
+vk::DeviceSize get_buffer_image_copy_alignment(vk::Format format)
+{
+  const vk::DeviceSize blockSize = vk::blockSize(format);
+  ETNA_VERIFYF(blockSize > 0, "Format {} can't be copied from buffers!", vk::to_string(format));
+  return std::lcm(blockSize, vk::DeviceSize{4});
+}
+
+template <class Region>
+struct TransferGroup
+{
+  const Image* src;
+  const Image* dst;
+  std::vector<Region> regions;
+};
+
+// Marks images used by more than one group of a batch
+static constexpr std::size_t SEVERAL_GROUPS = std::numeric_limits<std::size_t>::max();
+
+template <class Region>
+static void fill_aspects(Region& region, const Image& src, const Image& dst)
+{
+  if (!region.srcSubresource.aspectMask)
+    region.srcSubresource.aspectMask = src.getAspectMaskByFormat();
+  if (!region.dstSubresource.aspectMask)
+    region.dstSubresource.aspectMask = dst.getAspectMaskByFormat();
+}
+
+// Groups consecutive requests into batches that don't depend on each other,
+// then records every batch as one flush of barriers followed by a command
+// per source and destination pair.
+template <class Region, class Request, class RecordGroup>
+static void transfer_in_batches(
+  vk::CommandBuffer cmd_buf, std::span<const Request> requests, RecordGroup record_group)
+{
+  std::vector<TransferGroup<Region>> groups;
+  std::map<std::pair<vk::Image, vk::Image>, std::size_t> groupIndices;
+  std::unordered_map<vk::Image, const Image*> images;
+  // Index of the group of the batch reading or writing an image
+  std::unordered_map<vk::Image, std::size_t> readers;
+  std::unordered_map<vk::Image, std::size_t> writers;
+
+  auto recordBatch = [&]() {
+    for (const auto& [handle, image] : images)
+    {
+      const bool read = readers.contains(handle);
+      const bool written = writers.contains(handle);
+      vk::AccessFlags2 access = {};
+      if (read)
+        access |= vk::AccessFlagBits2::eTransferRead;
+      if (written)
+        access |= vk::AccessFlagBits2::eTransferWrite;
+      vk::ImageLayout layout = vk::ImageLayout::eGeneral;
+      if (!written)
+        layout = vk::ImageLayout::eTransferSrcOptimal;
+      else if (!read)
+        layout = vk::ImageLayout::eTransferDstOptimal;
+
+      // Forced, as consecutive batches writing the same image still depend on each other
+      set_state(
+        cmd_buf,
+        handle,
+        vk::PipelineStageFlagBits2::eTransfer,
+        access,
+        layout,
+        image->getAspectMaskByFormat(),
+        ForceSetState::eTrue);
+    }
+    flush_barriers(cmd_buf);
+
+    for (const auto& group : groups)
+    {
+      const bool sameImage = group.src == group.dst;
+      record_group(
+        group,
+        sameImage ? vk::ImageLayout::eGeneral : vk::ImageLayout::eTransferSrcOptimal,
+        sameImage ? vk::ImageLayout::eGeneral : vk::ImageLayout::eTransferDstOptimal);
+    }
+
+    groups.clear();
+    groupIndices.clear();
+    images.clear();
+    readers.clear();
+    writers.clear();
+  };
+
+  auto usedByOtherGroup = [](const auto& users, vk::Image image, std::size_t group) {
+    auto it = users.find(image);
+    return it != users.end() && it->second != group;
+  };
+  auto addUser = [](auto& users, vk::Image image, std::size_t group) {
+    auto [it, inserted] = users.emplace(image, group);
+    if (!inserted && it->second != group)
+      it->second = SEVERAL_GROUPS;
+  };
+
+  for (const auto& request : requests)
+  {
+    const vk::Image src = request.src.get();
+    const vk::Image dst = request.dst.get();
+
+    auto it = groupIndices.find({src, dst});
+    std::size_t index = it != groupIndices.end() ? it->second : groups.size();
+    if (usedByOtherGroup(writers, src, index) || usedByOtherGroup(readers, dst, index))
+    {
+      recordBatch();
+      index = 0;
+    }
+
+    if (index == groups.size())
+    {
+      groupIndices.emplace(std::pair{src, dst}, index);
+      groups.push_back(TransferGroup<Region>{.src = &request.src, .dst = &request.dst});
+    }
+    Region region = request.region;
+    fill_aspects(region, request.src, request.dst);
+    groups[index].regions.push_back(region);
+
+    images.emplace(src, &request.src);
+    images.emplace(dst, &request.dst);
+    addUser(readers, src, index);
+    addUser(writers, dst, index);
+  }
+
+  if (!groups.empty())
+    recordBatch();
+}
+
+void copy_images(vk::CommandBuffer cmd_buf, std::span<const ImageCopyRequest> requests)
+{
+  ETNA_PROFILE_GPU(cmd_buf, copy_images);
+
+  transfer_in_batches<vk::ImageCopy2>(
+    cmd_buf,
+    requests,
+    [cmd_buf](
+      const TransferGroup<vk::ImageCopy2>& group,
+      vk::ImageLayout src_layout,
+      vk::ImageLayout dst_layout) {
+      cmd_buf.copyImage2(vk::CopyImageInfo2{
+        .srcImage = group.src->get(),
+        .srcImageLayout = src_layout,
+        .dstImage = group.dst->get(),
+        .dstImageLayout = dst_layout,
+        .regionCount = static_cast<std::uint32_t>(group.regions.size()),
+        .pRegions = group.regions.data(),
+      });
+    });
+}
+
+void blit_images(
+  vk::CommandBuffer cmd_buf, std::span<const ImageBlitRequest> requests, vk::Filter filter)
+{
+  ETNA_PROFILE_GPU(cmd_buf, blit_images);
+
+  transfer_in_batches<vk::ImageBlit2>(
+    cmd_buf,
+    requests,
+    [cmd_buf, filter](
+      const TransferGroup<vk::ImageBlit2>& group,
+      vk::ImageLayout src_layout,
+      vk::ImageLayout dst_layout) {
+      cmd_buf.blitImage2(vk::BlitImageInfo2{
+        .srcImage = group.src->get(),
+        .srcImageLayout = src_layout,
+        .dstImage = group.dst->get(),
+        .dstImageLayout = dst_layout,
+        .regionCount = static_cast<std::uint32_t>(group.regions.size()),
+        .pRegions = group.regions.data(),
+        .filter = filter,
+      });
+    });
+}
+
+} // namespace etna
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
 #include <etna/ShaderProgram.hpp>
 #include <etna/VulkanFormatter.hpp>
 
@@ -46,7 +47,7 @@ static vk::UniquePipeline create_graphics_pipeline_internal(
       const auto& attr =
         bindingDesc->byteStreamDescription.attributes[bindingDesc->attributeMapping[j]];
       vertexAttribures.emplace_back() = vk::VertexInputAttributeDescription{
-        .location = j,
+        .location = bindingDesc->firstLocation + j,
         .binding = i,
         .format = attr.format,
         .offset = attr.offset,
@@ -75,11 +76,34 @@ static vk::UniquePipeline create_graphics_pipeline_internal(
   dynamicState.setDynamicStates(info.dynamicStates);
 
   vk::PipelineRenderingCreateInfo rendering{
+    .viewMask = info.fragmentShaderOutput.viewMask,
     .depthAttachmentFormat = info.fragmentShaderOutput.depthAttachmentFormat,
     .stencilAttachmentFormat = info.fragmentShaderOutput.stencilAttachmentFormat,
   };
   rendering.setColorAttachmentFormats(info.fragmentShaderOutput.colorAttachmentFormats);
 
+  vk::RenderingInputAttachmentIndexInfoKHR inputIndices{};
+  if (info.inputAttachmentIndices.has_value())
+  {
+    const auto& mapping = *info.inputAttachmentIndices;
+    ETNA_VERIFYF(
+      get_context().getOptionalFeatures().dynamicRenderingLocalRead,
+      "Input attachment index mapping requires dynamic rendering local read support!");
+    ETNA_VERIFYF(
+      mapping.colorAttachmentInputIndices.size() ==
+        info.fragmentShaderOutput.colorAttachmentFormats.size(),
+      "Input attachment index mapping has {} color attachments, but the pipeline has {}!",
+      mapping.colorAttachmentInputIndices.size(),
+      info.fragmentShaderOutput.colorAttachmentFormats.size());
+
+    inputIndices.setColorAttachmentInputIndices(mapping.colorAttachmentInputIndices);
+    inputIndices.pDepthInputAttachmentIndex =
+      mapping.depthInputAttachmentIndex ? &*mapping.depthInputAttachmentIndex : nullptr;
+    inputIndices.pStencilInputAttachmentIndex =
+      mapping.stencilInputAttachmentIndex ? &*mapping.stencilInputAttachmentIndex : nullptr;
+    rendering.pNext = &inputIndices;
+  }
+
   vk::GraphicsPipelineCreateInfo pipelineInfo{
     .pNext = &rendering,
     .pVertexInputState = &vertexInput,
@@ -117,9 +141,11 @@ ComputePipeline PipelineManager::createComputePipeline(
     "Incorrect shader program, expected 1 stage for ComputePipeline, but got {}!",
     shaderStages.size());
 
-  pipelines.emplace(
-    pipelineId,
-    createComputePipelineInternal(device, shaderManager.getProgramLayout(progId), shaderStages[0]));
+  auto pipeline =
+    createComputePipelineInternal(device, shaderManager.getProgramLayout(progId), shaderStages[0]);
+
+  std::lock_guard lock{mutex};
+  publish(pipelineId, std::move(pipeline));
   computePipelineParameters.emplace(pipelineId, ComputeParameters{progId, std::move(info)});
 
   return ComputePipeline(this, pipelineId, progId);
@@ -145,11 +171,12 @@ static void print_prog_info(const etna::ShaderProgramInfo& info, const std::stri
 
       fmt::format_to(
         it,
-        "  Binding {}: {}, count = {}, stages = {}\n",
+        "  Binding {}: {}, count = {}, stages = {}{}\n",
         binding,
         vkBinding.descriptorType,
         vkBinding.descriptorCount,
-        vkBinding.stageFlags);
+        vkBinding.stageFlags,
+        setInfo.hasImmutableSampler(binding) ? ", immutable sampler" : "");
     }
   }
 
@@ -163,22 +190,42 @@ static void print_prog_info(const etna::ShaderProgramInfo& info, const std::stri
 GraphicsPipeline PipelineManager::createGraphicsPipeline(
   const char* shader_program_name, GraphicsPipeline::CreateInfo info)
 {
+  ETNA_VERIFYF(
+    !get_context().isComputeOnly(),
+    "Graphics pipeline {} can't be created by a compute only context!",
+    shader_program_name);
   const PipelineId pipelineId = static_cast<PipelineId>(pipelineIdCounter++);
   const ShaderProgramId progId = shaderManager.getProgram(shader_program_name);
 
-  pipelines.emplace(
-    pipelineId,
-    create_graphics_pipeline_internal(
-      device, shaderManager.getProgramLayout(progId), shaderManager.getShaderStages(progId), info));
-  graphicsPipelineParameters.emplace(pipelineId, PipelineParameters{progId, std::move(info)});
+  auto vkPipeline = create_graphics_pipeline_internal(
+    device, shaderManager.getProgramLayout(progId), shaderManager.getShaderStages(progId), info);
+  {
+    std::lock_guard lock{mutex};
+    publish(pipelineId, std::move(vkPipeline));
+    graphicsPipelineParameters.emplace(pipelineId, PipelineParameters{progId, std::move(info)});
+  }
 
   GraphicsPipeline pipeline(this, pipelineId, progId);
   print_prog_info(shaderManager.getProgramInfo(shader_program_name), shader_program_name);
   return pipeline;
 }
 
+void PipelineManager::publish(PipelineId id, vk::UniquePipeline pipeline)
+{
+  const auto index = static_cast<std::underlying_type_t<PipelineId>>(id);
+  auto handles = vkPipelines.latest();
+  // Pipelines created concurrently may be published out of order
+  if (handles.size() <= index)
+    handles.resize(index + 1);
+  handles[index] = pipeline.get();
+  pipelines.insert_or_assign(id, std::move(pipeline));
+  vkPipelines.publish(std::move(handles));
+}
+
 void PipelineManager::recreate()
 {
+  std::lock_guard lock{mutex};
+  // Nobody may be using the manager right now, so old handles can be freed
   pipelines.clear();
   for (const auto& [id, params] : graphicsPipelineParameters)
     pipelines.emplace(
@@ -195,6 +242,18 @@ void PipelineManager::recreate()
         device,
         shaderManager.getProgramLayout(params.shaderProgram),
         shaderManager.getShaderStages(params.shaderProgram)[0]));
+
+  std::vector<vk::Pipeline> handles(vkPipelines.latest().size());
+  for (const auto& [id, pipeline] : pipelines)
+    handles[static_cast<std::underlying_type_t<PipelineId>>(id)] = pipeline.get();
+  vkPipelines.publish(std::move(handles));
+  vkPipelines.reclaim();
+}
+
+void PipelineManager::collectRetiredSnapshots()
+{
+  std::lock_guard lock{mutex};
+  vkPipelines.collect();
 }
 
 void PipelineManager::destroyPipeline(PipelineId id)
@@ -202,14 +261,19 @@ void PipelineManager::destroyPipeline(PipelineId id)
   if (id == PipelineId::Invalid)
     return;
 
+  std::lock_guard lock{mutex};
+  auto handles = vkPipelines.latest();
+  handles[static_cast<std::underlying_type_t<PipelineId>>(id)] = vk::Pipeline{};
+  vkPipelines.publish(std::move(handles));
   pipelines.erase(id);
   graphicsPipelineParameters.erase(id);
+  computePipelineParameters.erase(id);
 }
 
 vk::Pipeline PipelineManager::getVkPipeline(PipelineId id) const
 {
   ETNA_VERIFY(id != PipelineId::Invalid);
-  return pipelines.find(id)->second.get();
+  return vkPipelines.read()->at(static_cast<std::underlying_type_t<PipelineId>>(id));
 }
 
 vk::PipelineLayout PipelineManager::getVkPipelineLayout(ShaderProgramId id) const
@@ -0,0 +1,420 @@
+#include <etna/PixelConversion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include <etna/Assert.hpp>
+
+#include "HalfFloat.hpp"
+
+// SIMD kernels are compiled for their instruction sets with target attributes
+// and chosen at runtime, so the library itself keeps the baseline ISA.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ETNA_PIXEL_CONVERSION_X86 1
+#include <immintrin.h>
+#else
+#define ETNA_PIXEL_CONVERSION_X86 0
+#endif
+
+
+namespace etna
+{
+
+// Pixels are converted in chunks through linear RGBA floats on the stack
+static constexpr std::size_t CHUNK_PIXELS = 256;
+
+enum class DstEncoding
+{
+  eUnorm8,
+  eSrgb8,
+  eUnorm16,
+  eHalf,
+  eFloat,
+};
+
+static std::optional<DstEncoding> get_dst_encoding(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eR8G8B8A8Unorm:
+    return DstEncoding::eUnorm8;
+  case vk::Format::eR8G8B8A8Srgb:
+    return DstEncoding::eSrgb8;
+  case vk::Format::eR16G16B16A16Unorm:
+    return DstEncoding::eUnorm16;
+  case vk::Format::eR16G16B16A16Sfloat:
+    return DstEncoding::eHalf;
+  case vk::Format::eR32G32B32A32Sfloat:
+    return DstEncoding::eFloat;
+  default:
+    return std::nullopt;
+  }
+}
+
+std::size_t get_source_pixel_size(SourcePixelFormat format)
+{
+  switch (format)
+  {
+  case SourcePixelFormat::eRgb8:
+    return 3;
+  case SourcePixelFormat::eRgba8:
+    return 4;
+  case SourcePixelFormat::eRgb16:
+    return 6;
+  case SourcePixelFormat::eRgba16:
+    return 8;
+  case SourcePixelFormat::eRgb32f:
+    return 12;
+  case SourcePixelFormat::eRgba32f:
+    return 16;
+  }
+  ETNA_PANIC("Unknown source pixel format {}!", static_cast<std::uint32_t>(format));
+}
+
+bool can_convert_pixels(vk::Format dst_format)
+{
+  return get_dst_encoding(dst_format).has_value();
+}
+
+static bool has_alpha(SourcePixelFormat format)
+{
+  return format == SourcePixelFormat::eRgba8 || format == SourcePixelFormat::eRgba16 ||
+    format == SourcePixelFormat::eRgba32f;
+}
+
+static float srgb_to_linear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float value)
+{
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static const std::array<float, 256>& srgb8_to_linear_table()
+{
+  static const std::array<float, 256> table = [] {
+    std::array<float, 256> result;
+    for (std::size_t i = 0; i < result.size(); ++i)
+      result[i] = srgb_to_linear(static_cast<float>(i) / 255.0f);
+    return result;
+  }();
+  return table;
+}
+
+static void floats_to_halves_scalar(const float* src, std::uint16_t* dst, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+    dst[i] = float_to_half(src[i]);
+}
+
+static void expand_rgb8_scalar(const std::uint8_t* src, std::uint8_t* dst, std::size_t pixels)
+{
+  for (std::size_t i = 0; i < pixels; ++i)
+  {
+    dst[i * 4 + 0] = src[i * 3 + 0];
+    dst[i * 4 + 1] = src[i * 3 + 1];
+    dst[i * 4 + 2] = src[i * 3 + 2];
+    dst[i * 4 + 3] = 0xFF;
+  }
+}
+
+static void unorm8_to_floats_scalar(const std::uint8_t* src, float* dst, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+    dst[i] = static_cast<float>(src[i]) / 255.0f;
+}
+
+#if ETNA_PIXEL_CONVERSION_X86
+
+__attribute__((target("ssse3"))) static void expand_rgb8_ssse3(
+  const std::uint8_t* src, std::uint8_t* dst, std::size_t pixels)
+{
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+  // Every load reads 16 bytes but only uses 12, hence the margin at the end
+  std::size_t i = 0;
+  for (; i + 6 <= pixels; i += 4)
+  {
+    const __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+    const __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), rgba);
+  }
+  expand_rgb8_scalar(src + i * 3, dst + i * 4, pixels - i);
+}
+
+__attribute__((target("avx2"))) static void unorm8_to_floats_avx2(
+  const std::uint8_t* src, float* dst, std::size_t count)
+{
+  const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    const __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(values, scale));
+  }
+  unorm8_to_floats_scalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2,f16c"))) static void floats_to_halves_f16c(
+  const float* src, std::uint16_t* dst, std::size_t count)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    const __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), halves);
+  }
+  floats_to_halves_scalar(src + i, dst + i, count - i);
+}
+
+struct CpuFeatures
+{
+  bool ssse3;
+  bool avx2;
+  // Usually comes with AVX2, but may be masked out separately, e.g. by hypervisors
+  bool f16c;
+};
+
+static const CpuFeatures& get_cpu_features()
+{
+  static const CpuFeatures features{
+    .ssse3 = __builtin_cpu_supports("ssse3") != 0,
+    .avx2 = __builtin_cpu_supports("avx2") != 0,
+    .f16c = __builtin_cpu_supports("f16c") != 0,
+  };
+  return features;
+}
+
+#endif
+
+static void expand_rgb8(const std::uint8_t* src, std::uint8_t* dst, std::size_t pixels)
+{
+#if ETNA_PIXEL_CONVERSION_X86
+  if (get_cpu_features().ssse3)
+  {
+    expand_rgb8_ssse3(src, dst, pixels);
+    return;
+  }
+#endif
+  expand_rgb8_scalar(src, dst, pixels);
+}
+
+static void unorm8_to_floats(const std::uint8_t* src, float* dst, std::size_t count)
+{
+#if ETNA_PIXEL_CONVERSION_X86
+  if (get_cpu_features().avx2)
+  {
+    unorm8_to_floats_avx2(src, dst, count);
+    return;
+  }
+#endif
+  unorm8_to_floats_scalar(src, dst, count);
+}
+
+static void floats_to_halves(const float* src, std::uint16_t* dst, std::size_t count)
+{
+#if ETNA_PIXEL_CONVERSION_X86
+  if (get_cpu_features().avx2 && get_cpu_features().f16c)
+  {
+    floats_to_halves_f16c(src, dst, count);
+    return;
+  }
+#endif
+  floats_to_halves_scalar(src, dst, count);
+}
+
+// Copies pixels with 3 channels of type T into 4 channel ones with the given alpha
+template <class T>
+static void expand_rgb(const std::byte* src, std::byte* dst, std::size_t pixels, T alpha)
+{
+  for (std::size_t i = 0; i < pixels; ++i)
+  {
+    std::memcpy(dst + i * 4 * sizeof(T), src + i * 3 * sizeof(T), 3 * sizeof(T));
+    std::memcpy(dst + (i * 4 + 3) * sizeof(T), &alpha, sizeof(T));
+  }
+}
+
+// Decodes pixels into linear RGBA floats
+static void decode_pixels(PixelSource source, const std::byte* src, float* dst, std::size_t pixels)
+{
+  const bool alpha = has_alpha(source.format);
+  const std::size_t channels = alpha ? 4 : 3;
+
+  switch (source.format)
+  {
+  case SourcePixelFormat::eRgb8:
+  case SourcePixelFormat::eRgba8:
+  {
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(src);
+    if (alpha && !source.srgb)
+    {
+      unorm8_to_floats(bytes, dst, pixels * 4);
+      return;
+    }
+
+    const auto& table = srgb8_to_linear_table();
+    for (std::size_t i = 0; i < pixels; ++i)
+    {
+      for (std::size_t c = 0; c < 3; ++c)
+      {
+        const std::uint8_t value = bytes[i * channels + c];
+        dst[i * 4 + c] = source.srgb ? table[value] : static_cast<float>(value) / 255.0f;
+      }
+      dst[i * 4 + 3] = alpha ? static_cast<float>(bytes[i * 4 + 3]) / 255.0f : 1.0f;
+    }
+    return;
+  }
+  case SourcePixelFormat::eRgb16:
+  case SourcePixelFormat::eRgba16:
+    for (std::size_t i = 0; i < pixels; ++i)
+      for (std::size_t c = 0; c < 4; ++c)
+      {
+        if (c == 3 && !alpha)
+        {
+          dst[i * 4 + c] = 1.0f;
+          continue;
+        }
+        std::uint16_t value;
+        std::memcpy(&value, src + (i * channels + c) * sizeof(value), sizeof(value));
+        const float unorm = static_cast<float>(value) / 65535.0f;
+        dst[i * 4 + c] = source.srgb && c < 3 ? srgb_to_linear(unorm) : unorm;
+      }
+    return;
+  case SourcePixelFormat::eRgb32f:
+    for (std::size_t i = 0; i < pixels; ++i)
+    {
+      std::memcpy(dst + i * 4, src + i * 3 * sizeof(float), 3 * sizeof(float));
+      dst[i * 4 + 3] = 1.0f;
+    }
+    return;
+  case SourcePixelFormat::eRgba32f:
+    std::memcpy(dst, src, pixels * 4 * sizeof(float));
+    return;
+  }
+}
+
+template <class T>
+static T to_unorm(float value)
+{
+  constexpr float MAX = static_cast<float>(std::numeric_limits<T>::max());
+  return static_cast<T>(std::clamp(value, 0.0f, 1.0f) * MAX + 0.5f);
+}
+
+static void encode_pixels(
+  DstEncoding encoding, const float* src, std::byte* dst, std::size_t pixels)
+{
+  switch (encoding)
+  {
+  case DstEncoding::eUnorm8:
+  case DstEncoding::eSrgb8:
+  {
+    auto* bytes = reinterpret_cast<std::uint8_t*>(dst);
+    for (std::size_t i = 0; i < pixels * 4; ++i)
+    {
+      const bool color = i % 4 != 3;
+      const float value = std::clamp(src[i], 0.0f, 1.0f);
+      bytes[i] = to_unorm<std::uint8_t>(
+        encoding == DstEncoding::eSrgb8 && color ? linear_to_srgb(value) : value);
+    }
+    return;
+  }
+  case DstEncoding::eUnorm16:
+    for (std::size_t i = 0; i < pixels * 4; ++i)
+    {
+      const std::uint16_t value = to_unorm<std::uint16_t>(src[i]);
+      std::memcpy(dst + i * sizeof(value), &value, sizeof(value));
+    }
+    return;
+  case DstEncoding::eHalf:
+    floats_to_halves(src, reinterpret_cast<std::uint16_t*>(dst), pixels * 4);
+    return;
+  case DstEncoding::eFloat:
+    std::memcpy(dst, src, pixels * 4 * sizeof(float));
+    return;
+  }
+}
+
+// Conversions that don't need to go through floats, returns false for the rest
+static bool convert_directly(
+  PixelSource source,
+  DstEncoding encoding,
+  const std::byte* src,
+  std::byte* dst,
+  std::size_t pixels)
+{
+  const std::size_t srcSize = get_source_pixel_size(source.format);
+  switch (source.format)
+  {
+  case SourcePixelFormat::eRgb8:
+  case SourcePixelFormat::eRgba8:
+    if (encoding != (source.srgb ? DstEncoding::eSrgb8 : DstEncoding::eUnorm8))
+      return false;
+    if (has_alpha(source.format))
+      std::memcpy(dst, src, pixels * srcSize);
+    else
+      expand_rgb8(
+        reinterpret_cast<const std::uint8_t*>(src), reinterpret_cast<std::uint8_t*>(dst), pixels);
+    return true;
+  case SourcePixelFormat::eRgb16:
+  case SourcePixelFormat::eRgba16:
+    if (encoding != DstEncoding::eUnorm16 || source.srgb)
+      return false;
+    if (has_alpha(source.format))
+      std::memcpy(dst, src, pixels * srcSize);
+    else
+      expand_rgb<std::uint16_t>(src, dst, pixels, 0xFFFF);
+    return true;
+  case SourcePixelFormat::eRgb32f:
+  case SourcePixelFormat::eRgba32f:
+    if (encoding == DstEncoding::eFloat && has_alpha(source.format))
+      std::memcpy(dst, src, pixels * srcSize);
+    else if (encoding == DstEncoding::eFloat)
+      expand_rgb<float>(src, dst, pixels, 1.0f);
+    else if (encoding == DstEncoding::eHalf && has_alpha(source.format))
+      floats_to_halves(
+        reinterpret_cast<const float*>(src), reinterpret_cast<std::uint16_t*>(dst), pixels * 4);
+    else
+      return false;
+    return true;
+  }
+  return false;
+}
+
+void convert_pixels(
+  PixelSource source,
+  vk::Format dst_format,
+  const std::byte* src,
+  std::byte* dst,
+  std::size_t pixel_count)
+{
+  const auto encoding = get_dst_encoding(dst_format);
+  ETNA_VERIFYF(
+    encoding.has_value(), "Can't convert pixels into the {} format!", vk::to_string(dst_format));
+
+  if (convert_directly(source, *encoding, src, dst, pixel_count))
+    return;
+
+  const std::size_t srcSize = get_source_pixel_size(source.format);
+  const std::size_t dstSize = vk::blockSize(dst_format);
+  std::array<float, CHUNK_PIXELS * 4> linear;
+  for (std::size_t first = 0; first < pixel_count; first += CHUNK_PIXELS)
+  {
+    const std::size_t pixels = std::min(CHUNK_PIXELS, pixel_count - first);
+    decode_pixels(source, src + first * srcSize, linear.data(), pixels);
+    encode_pixels(*encoding, linear.data(), dst + first * dstSize, pixels);
+  }
+}
+
+} // namespace etna
@@ -0,0 +1,89 @@
+#include <etna/PushData.hpp>
+
+#include <cstring>
+#include <string>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+
+
+namespace etna
+{
+
+// Enough for any std430 member, shaders declare it as buffer_reference_align
+static constexpr vk::DeviceSize SPILL_ALIGNMENT = 16;
+
+PushData::PushData(CreateInfo info)
+  : ringSize{info.ringSize}
+  , rings{get_context().getMainWorkCount(), [&info](std::size_t) {
+            // Without device addresses the ring is never used, so keep it tiny
+            const bool canSpill = get_context().getOptionalFeatures().bufferDeviceAddress;
+            Ring ring{
+              .buffer = get_context().createBuffer(Buffer::CreateInfo{
+                .size = canSpill ? info.ringSize : 1,
+                .bufferUsage = canSpill
+                  ? vk::BufferUsageFlagBits::eStorageBuffer |
+                    vk::BufferUsageFlagBits::eShaderDeviceAddress
+                  : vk::BufferUsageFlags{vk::BufferUsageFlagBits::eStorageBuffer},
+                .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+                .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                  VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                .name = std::string(info.name) + "::ring",
+              }),
+            };
+            ring.buffer.map();
+            return ring;
+          }}
+{
+}
+
+void PushData::pushBytes(
+  vk::CommandBuffer cmd_buf, const PipelineBase& pipeline, std::span<const std::byte> data)
+{
+  const auto range = get_shader_program(pipeline.getShaderProgram()).getPushConst();
+  ETNA_VERIFYF(range.size != 0, "The pipeline has no push constants to push data into!");
+
+  if (data.size() <= range.size)
+  {
+    cmd_buf.pushConstants(
+      pipeline.getVkPipelineLayout(),
+      range.stageFlags,
+      0,
+      static_cast<std::uint32_t>(data.size()),
+      data.data());
+    return;
+  }
+
+  ETNA_VERIFYF(
+    range.size >= sizeof(vk::DeviceAddress),
+    "{} bytes of data don't fit into {} bytes of push constants, and neither does an address!",
+    data.size(),
+    range.size);
+  ETNA_VERIFYF(
+    get_context().getOptionalFeatures().bufferDeviceAddress,
+    "Spilling {} bytes of push data requires the bufferDeviceAddress feature!",
+    data.size());
+
+  auto& ring = rings.get();
+  // First use of this ring in a new frame, the GPU is done with its old contents
+  if (ring.lastBatch != get_context().getMainWorkCount().batchIndex())
+  {
+    ring.used = 0;
+    ring.lastBatch = get_context().getMainWorkCount().batchIndex();
+  }
+
+  const vk::DeviceSize offset =
+    (ring.used + SPILL_ALIGNMENT - 1) / SPILL_ALIGNMENT * SPILL_ALIGNMENT;
+  ETNA_VERIFYF(
+    offset + data.size() <= ringSize,
+    "PushData ring of {} bytes is exhausted, increase CreateInfo::ringSize!",
+    ringSize);
+  std::memcpy(ring.buffer.data() + offset, data.data(), data.size());
+  ring.used = offset + data.size();
+
+  const vk::DeviceAddress address = ring.buffer.getDeviceAddress() + offset;
+  cmd_buf.pushConstants(
+    pipeline.getVkPipelineLayout(), range.stageFlags, 0, sizeof(address), &address);
+}
+
+} // namespace etna
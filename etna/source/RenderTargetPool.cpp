@@ -0,0 +1,146 @@
+#include <etna/RenderTargetPool.hpp>
+
+#include <algorithm>
+
+#include <tracy/Tracy.hpp>
+
+
+namespace etna
+{
+
+template <typename T>
+static void hash_combine(std::size_t& s, const T& v)
+{
+  std::hash<T> h;
+  s ^= h(v) + 0x9e3779b9 + (s << 6) + (s >> 2);
+}
+
+RenderTargetPool::Key::Key(const Image::CreateInfo& info)
+  : extent{info.extent}
+  , format{info.format}
+  , imageUsage{info.imageUsage}
+  , memoryUsage{info.memoryUsage}
+  , allocationCreate{info.allocationCreate}
+  , tiling{info.tiling}
+  , layers{info.layers}
+  , mipLevels{info.mipLevels}
+  , samples{info.samples}
+  , type{info.type}
+  , flags{info.flags}
+{
+}
+
+std::size_t RenderTargetPool::KeyHash::operator()(const Key& key) const
+{
+  std::size_t hash = 0;
+  hash_combine(hash, key.extent.width);
+  hash_combine(hash, key.extent.height);
+  hash_combine(hash, key.extent.depth);
+  hash_combine(hash, static_cast<uint32_t>(key.format));
+  hash_combine(hash, static_cast<uint32_t>(key.imageUsage));
+  hash_combine(hash, static_cast<uint32_t>(key.memoryUsage));
+  hash_combine(hash, static_cast<uint32_t>(key.allocationCreate));
+  hash_combine(hash, static_cast<uint32_t>(key.tiling));
+  hash_combine(hash, key.layers);
+  hash_combine(hash, key.mipLevels);
+  hash_combine(hash, static_cast<uint32_t>(key.samples));
+  hash_combine(hash, static_cast<uint32_t>(key.type));
+  hash_combine(hash, static_cast<uint32_t>(key.flags));
+  return hash;
+}
+
+RenderTargetPool::RenderTargetPool(const Dependencies& deps)
+  : workCount{deps.workCount}
+  , device{deps.device}
+  , allocator{deps.allocator}
+{
+}
+
+bool RenderTargetPool::isSafeToReuse(const IdleImage& idle_image) const
+{
+  return idle_image.releaseBatch + workCount.multiBufferingCount() <= workCount.batchIndex();
+}
+
+Image RenderTargetPool::acquire(const Image::CreateInfo& info)
+{
+  ZoneScoped;
+
+  Key key{info};
+
+  Image result;
+
+  if (auto it = idleImages.find(key); it != idleImages.end())
+  {
+    auto& candidates = it->second;
+    // Images are released in batch order, so the front one is the oldest
+    if (!candidates.empty() && isSafeToReuse(candidates.front()))
+    {
+      stats.idleBytes -= candidates.front().size;
+      --stats.idleImages;
+      result = std::move(candidates.front().image);
+      candidates.erase(candidates.begin());
+    }
+  }
+
+  if (result.get())
+  {
+    ++stats.hits;
+  }
+  else
+  {
+    ++stats.misses;
+    result = Image(allocator, info);
+  }
+
+  acquiredImages.emplace(result.get(), key);
+  ++stats.acquiredImages;
+
+  return result;
+}
+
+void RenderTargetPool::release(Image image)
+{
+  auto it = acquiredImages.find(image.get());
+  ETNA_VERIFYF(it != acquiredImages.end(), "Image was not acquired from this pool!");
+
+  const vk::DeviceSize size = device.getImageMemoryRequirements(image.get()).size;
+  idleImages[it->second].push_back(IdleImage{
+    .image = std::move(image),
+    .releaseBatch = workCount.batchIndex(),
+    .size = size,
+  });
+
+  acquiredImages.erase(it);
+  --stats.acquiredImages;
+  ++stats.idleImages;
+  stats.idleBytes += size;
+}
+
+void RenderTargetPool::trim(std::uint64_t max_idle_batches)
+{
+  ZoneScoped;
+
+  const auto tooOld = [this, max_idle_batches](const IdleImage& idle) {
+    return isSafeToReuse(idle) && idle.releaseBatch + max_idle_batches <= workCount.batchIndex();
+  };
+
+  for (auto it = idleImages.begin(); it != idleImages.end();)
+  {
+    auto& candidates = it->second;
+    for (const auto& idle : candidates)
+    {
+      if (!tooOld(idle))
+        continue;
+      stats.idleBytes -= idle.size;
+      --stats.idleImages;
+    }
+    std::erase_if(candidates, tooOld);
+
+    if (candidates.empty())
+      it = idleImages.erase(it);
+    else
+      ++it;
+  }
+}
+
+} // namespace etna
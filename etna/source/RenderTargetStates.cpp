@@ -1,5 +1,8 @@
 #include <etna/RenderTargetStates.hpp>
 
+#include <algorithm>
+#include <bit>
+
 #include <etna/GlobalContext.hpp>
 #include "StateTracking.hpp"
 
@@ -7,20 +10,25 @@
 namespace etna
 {
 
-bool RenderTargetState::inScope = false;
+RenderTargetState::AttachmentParams RenderTargetState::AttachmentParams::fromView(
+  const Image& image, Image::ViewParams params)
+{
+  const uint32_t layerCount = params.layerCount == vk::RemainingArrayLayers
+    ? image.getLayerCount() - params.baseLayer
+    : params.layerCount;
+  return AttachmentParams{
+    .image = image.get(),
+    .view = image.getView(params),
+    .imageAspect = params.aspectMask,
+    .baseLayer = params.baseLayer,
+    .layerCount = layerCount,
+    .format = image.getFormat(),
+    .samples = image.getSampleCount(),
+  };
+}
 
-RenderTargetState::RenderTargetState(
-  vk::CommandBuffer cmd_buff,
-  vk::Rect2D rect,
-  const std::vector<AttachmentParams>& color_attachments,
-  AttachmentParams depth_attachment,
-  AttachmentParams stencil_attachment,
-  BarrierBehavoir behavoir)
+static void set_viewport_and_scissor(vk::CommandBuffer cmd_buff, vk::Rect2D rect)
 {
-  ETNA_VERIFYF(!inScope, "RenderTargetState scopes shouldn't overlap.");
-  inScope = true;
-  // TODO: add resource state tracking
-  commandBuffer = cmd_buff;
   vk::Viewport viewport{
     .x = static_cast<float>(rect.offset.x),
     .y = static_cast<float>(rect.offset.y),
@@ -30,20 +38,165 @@ RenderTargetState::RenderTargetState(
     .maxDepth = 1.0f,
   };
 
-  commandBuffer.setViewport(0, {viewport});
-  commandBuffer.setScissor(0, {rect});
+  cmd_buff.setViewport(0, {viewport});
+  cmd_buff.setScissor(0, {rect});
+}
+
+static uint32_t deduce_layer_count(const RenderTargetState::CreateInfo& info)
+{
+  uint32_t minLayers = vk::RemainingArrayLayers;
+  auto account = [&minLayers](const RenderTargetState::AttachmentParams& attachment) {
+    if (attachment.image)
+      minLayers = std::min(minLayers, attachment.layerCount);
+  };
+  for (const auto& attachment : info.colorAttachments)
+    account(attachment);
+  account(info.depthAttachment);
+  account(info.stencilAttachment);
+
+  if (info.layerCount == 0)
+    return minLayers == vk::RemainingArrayLayers ? 1 : minLayers;
+
+  ETNA_VERIFYF(
+    minLayers == vk::RemainingArrayLayers || minLayers >= info.layerCount,
+    "Can't render {} layers into an attachment with {} layers!",
+    info.layerCount,
+    minLayers);
+  return info.layerCount;
+}
+
+// Must be called before the barriers for the attachment are requested,
+// as those overwrite the tracked layout.
+static vk::AttachmentLoadOp choose_load_op(
+  vk::CommandBuffer cmd_buff,
+  const RenderTargetState::AttachmentParams& attachment,
+  BarrierBehavoir behavoir)
+{
+  if (!attachment.inferOps || attachment.loadOp != vk::AttachmentLoadOp::eLoad)
+    return attachment.loadOp;
+  if (!attachment.image || !get_context().shouldGenerateBarriersWhen(behavoir))
+    return attachment.loadOp;
+
+  // Contents at the time of recording say nothing about the ones at execution
+  auto& tracker = get_context().getResourceTracker();
+  if (tracker.findCapture(cmd_buff) != nullptr)
+    return attachment.loadOp;
+
+  const bool undefined = tracker.hasUndefinedContents(
+    attachment.image, attachment.baseLayer, attachment.layerCount);
+  return undefined ? vk::AttachmentLoadOp::eDontCare : attachment.loadOp;
+}
+
+static vk::AttachmentStoreOp choose_store_op(const RenderTargetState::AttachmentParams& attachment)
+{
+  if (attachment.inferOps && attachment.lastUse)
+    return vk::AttachmentStoreOp::eDontCare;
+  return attachment.storeOp;
+}
+
+RenderTargetState::RenderTargetState(vk::CommandBuffer cmd_buff, const CreateInfo& info)
+{
+  etna::get_context().getResourceTracker().beginRenderScope(cmd_buff);
+
+  const auto& rect = info.rect;
+  const auto& color_attachments = info.colorAttachments;
+  const auto& depth_attachment = info.depthAttachment;
+  const auto& stencil_attachment = info.stencilAttachment;
+  const auto behavoir = info.behavoir;
+
+  if (auto* residency = etna::get_context().getResidencyManager())
+  {
+    for (const auto& attachment : color_attachments)
+      residency->markUsed(attachment.image);
+    residency->markUsed(depth_attachment.image);
+    residency->markUsed(stencil_attachment.image);
+  }
+
+  if (info.viewMask != 0)
+  {
+    ETNA_VERIFYF(
+      etna::get_context().getOptionalFeatures().multiview,
+      "Multiview rendering is not supported by the device!");
+
+    // Every view is rendered into the layer with the same index
+    const uint32_t layersUsed = 32 - static_cast<uint32_t>(std::countl_zero(info.viewMask));
+    auto checkLayers = [layersUsed](const AttachmentParams& attachment) {
+      ETNA_VERIFYF(
+        !attachment.image || attachment.layerCount == vk::RemainingArrayLayers ||
+          attachment.layerCount >= layersUsed,
+        "Attachment has {} layers, but the multiview view mask requires {}!",
+        attachment.layerCount,
+        layersUsed);
+    };
+    for (const auto& attachment : color_attachments)
+      checkLayers(attachment);
+    checkLayers(depth_attachment);
+    checkLayers(stencil_attachment);
+  }
+
+  if (info.localRead)
+  {
+    ETNA_VERIFYF(
+      etna::get_context().getOptionalFeatures().dynamicRenderingLocalRead,
+      "Dynamic rendering local read is not supported by the device!");
+  }
+  localRead = info.localRead;
+
+  const vk::ImageLayout colorLayout =
+    localRead ? vk::ImageLayout::eRenderingLocalReadKHR : vk::ImageLayout::eColorAttachmentOptimal;
+  const vk::ImageLayout depthStencilLayout = localRead
+    ? vk::ImageLayout::eRenderingLocalReadKHR
+    : vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+  secondaryContents = info.recordInSecondaryBuffers;
+  if (secondaryContents)
+  {
+    ETNA_VERIFYF(
+      !localRead, "Local read is not supported in scopes recorded into secondary buffers!");
+
+    renderArea = rect;
+    viewMask = info.viewMask;
+    auto checkFormat = [](const AttachmentParams& attachment) {
+      ETNA_VERIFYF(
+        !attachment.view || attachment.format != vk::Format::eUndefined,
+        "Attachments of scopes recorded into secondary buffers must specify their format!");
+      return attachment.view ? attachment.format : vk::Format::eUndefined;
+    };
+    colorFormats.reserve(color_attachments.size());
+    for (const auto& attachment : color_attachments)
+      colorFormats.push_back(checkFormat(attachment));
+    depthFormat = checkFormat(depth_attachment);
+    stencilFormat = checkFormat(stencil_attachment);
+
+    // All attachments must have the same sample count, so any of them will do
+    for (const auto* attachment : {&depth_attachment, &stencil_attachment})
+      if (attachment->view)
+        samples = attachment->samples;
+    for (const auto& attachment : color_attachments)
+      if (attachment.view)
+        samples = attachment.samples;
+  }
+
+  // TODO: add resource state tracking
+  commandBuffer = cmd_buff;
+  set_viewport_and_scissor(commandBuffer, rect);
 
   std::vector<vk::RenderingAttachmentInfo> attachmentInfos(color_attachments.size());
   for (uint32_t i = 0; i < color_attachments.size(); ++i)
   {
     attachmentInfos[i].imageView = color_attachments[i].view;
-    attachmentInfos[i].imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
-    attachmentInfos[i].loadOp = color_attachments[i].loadOp;
-    attachmentInfos[i].storeOp = color_attachments[i].storeOp;
+    attachmentInfos[i].imageLayout = colorLayout;
+    attachmentInfos[i].loadOp = choose_load_op(commandBuffer, color_attachments[i], behavoir);
+    attachmentInfos[i].storeOp = choose_store_op(color_attachments[i]);
     attachmentInfos[i].clearValue = color_attachments[i].clearColorValue;
 
     etna::get_context().getResourceTracker().setColorTarget(
-      commandBuffer, color_attachments[i].image, behavoir);
+      commandBuffer,
+      color_attachments[i].image,
+      behavoir,
+      color_attachments[i].baseLayer,
+      color_attachments[i].layerCount,
+      localRead);
 
     if (color_attachments[i].resolveImage)
     {
@@ -61,23 +214,23 @@ RenderTargetState::RenderTargetState(
 
   vk::RenderingAttachmentInfo depthAttInfo{
     .imageView = depth_attachment.view,
-    .imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+    .imageLayout = depthStencilLayout,
     .resolveMode = depth_attachment.resolveMode,
     .resolveImageView = depth_attachment.resolveImageView,
     .resolveImageLayout = vk::ImageLayout::eGeneral,
-    .loadOp = depth_attachment.loadOp,
-    .storeOp = depth_attachment.storeOp,
+    .loadOp = choose_load_op(commandBuffer, depth_attachment, behavoir),
+    .storeOp = choose_store_op(depth_attachment),
     .clearValue = depth_attachment.clearDepthStencilValue,
   };
 
   vk::RenderingAttachmentInfo stencilAttInfo{
     .imageView = stencil_attachment.view,
-    .imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+    .imageLayout = depthStencilLayout,
     .resolveMode = stencil_attachment.resolveMode,
     .resolveImageView = stencil_attachment.resolveImageView,
     .resolveImageLayout = vk::ImageLayout::eGeneral,
-    .loadOp = stencil_attachment.loadOp,
-    .storeOp = stencil_attachment.storeOp,
+    .loadOp = choose_load_op(commandBuffer, stencil_attachment, behavoir),
+    .storeOp = choose_store_op(stencil_attachment),
     .clearValue = stencil_attachment.clearDepthStencilValue,
   };
 
@@ -90,7 +243,10 @@ RenderTargetState::RenderTargetState(
       commandBuffer,
       depth_attachment.image,
       vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil,
-      behavoir);
+      behavoir,
+      depth_attachment.baseLayer,
+      depth_attachment.layerCount,
+      localRead);
 
     if (depth_attachment.resolveImage && stencil_attachment.resolveImage)
     {
@@ -109,7 +265,10 @@ RenderTargetState::RenderTargetState(
         commandBuffer,
         depth_attachment.image,
         depth_attachment.imageAspect.value_or(vk::ImageAspectFlagBits::eDepth),
-        behavoir);
+        behavoir,
+        depth_attachment.baseLayer,
+        depth_attachment.layerCount,
+        localRead);
 
       if (depth_attachment.resolveImage)
       {
@@ -127,7 +286,10 @@ RenderTargetState::RenderTargetState(
         commandBuffer,
         stencil_attachment.image,
         stencil_attachment.imageAspect.value_or(vk::ImageAspectFlagBits::eStencil),
-        behavoir);
+        behavoir,
+        stencil_attachment.baseLayer,
+        stencil_attachment.layerCount,
+        localRead);
 
       if (stencil_attachment.resolveImage)
       {
@@ -142,9 +304,13 @@ RenderTargetState::RenderTargetState(
 
   etna::get_context().getResourceTracker().flushBarriers(commandBuffer);
 
+  // NOTE: layerCount is ignored when multiview is used
   vk::RenderingInfo renderInfo{
+    .flags = secondaryContents ? vk::RenderingFlagBits::eContentsSecondaryCommandBuffers
+                               : vk::RenderingFlags{},
     .renderArea = rect,
-    .layerCount = 1,
+    .layerCount = deduce_layer_count(info),
+    .viewMask = info.viewMask,
     .colorAttachmentCount = static_cast<uint32_t>(attachmentInfos.size()),
     .pColorAttachments = attachmentInfos.empty() ? nullptr : attachmentInfos.data(),
     .pDepthAttachment = depth_attachment.view ? &depthAttInfo : nullptr,
@@ -153,10 +319,82 @@ RenderTargetState::RenderTargetState(
   commandBuffer.beginRendering(renderInfo);
 }
 
+void RenderTargetState::beginSecondary(vk::CommandBuffer secondary) const
+{
+  ETNA_VERIFYF(
+    secondaryContents,
+    "Secondary buffers require a RenderTargetState with recordInSecondaryBuffers!");
+
+  vk::CommandBufferInheritanceRenderingInfo renderingInfo{
+    .viewMask = viewMask,
+    .depthAttachmentFormat = depthFormat,
+    .stencilAttachmentFormat = stencilFormat,
+    .rasterizationSamples = samples,
+  };
+  renderingInfo.setColorAttachmentFormats(colorFormats);
+
+  vk::CommandBufferInheritanceInfo inheritanceInfo{
+    .pNext = &renderingInfo,
+  };
+  ETNA_CHECK_VK_RESULT(secondary.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+      vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+    .pInheritanceInfo = &inheritanceInfo,
+  }));
+
+  // Dynamic state is not inherited from the primary buffer
+  set_viewport_and_scissor(secondary, renderArea);
+}
+
+void RenderTargetState::execute(std::span<const vk::CommandBuffer> secondaries)
+{
+  ETNA_VERIFYF(
+    secondaryContents,
+    "Secondary buffers require a RenderTargetState with recordInSecondaryBuffers!");
+  if (!secondaries.empty())
+    commandBuffer.executeCommands(
+      static_cast<uint32_t>(secondaries.size()), secondaries.data());
+}
+
+void RenderTargetState::localReadBarrier()
+{
+  ETNA_VERIFYF(localRead, "Local read barriers require a RenderTargetState with localRead!");
+
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput |
+      vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+      vk::PipelineStageFlagBits2::eLateFragmentTests,
+    .srcAccessMask = vk::AccessFlagBits2::eColorAttachmentWrite |
+      vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+    .dstAccessMask = vk::AccessFlagBits2::eInputAttachmentRead,
+  };
+  vk::DependencyInfo depInfo{
+    .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  };
+  commandBuffer.pipelineBarrier2(depInfo);
+}
+
+void RenderTargetState::setInputAttachmentIndices(const InputAttachmentIndexMapping& mapping)
+{
+  ETNA_VERIFYF(localRead, "Input attachments require a RenderTargetState with localRead!");
+
+  vk::RenderingInputAttachmentIndexInfoKHR info{
+    .pDepthInputAttachmentIndex =
+      mapping.depthInputAttachmentIndex ? &*mapping.depthInputAttachmentIndex : nullptr,
+    .pStencilInputAttachmentIndex =
+      mapping.stencilInputAttachmentIndex ? &*mapping.stencilInputAttachmentIndex : nullptr,
+  };
+  info.setColorAttachmentInputIndices(mapping.colorAttachmentInputIndices);
+  commandBuffer.setRenderingInputAttachmentIndicesKHR(info);
+}
+
 RenderTargetState::~RenderTargetState()
 {
   commandBuffer.endRendering();
-  inScope = false;
+  etna::get_context().getResourceTracker().endRenderScope(commandBuffer);
 }
 
 } // namespace etna
@@ -0,0 +1,331 @@
+#include <etna/ResidencyManager.hpp>
+
+#include <algorithm>
+#include <array>
+
+#include <tracy/Tracy.hpp>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/ImageTransfers.hpp>
+
+
+namespace etna
+{
+
+ResidencyManager::ResidencyManager(const Dependencies& deps, CreateInfo info_)
+  : workCount{deps.workCount}
+  , device{deps.device}
+  , allocator{deps.allocator}
+  , info{info_}
+{
+  ETNA_VERIFYF(info.minImageMips > 0, "Images must keep at least one mip!");
+  auto& registered = get_context().residencyManager;
+  ETNA_VERIFYF(registered == nullptr, "Only one ResidencyManager may exist at a time!");
+  registered = this;
+}
+
+ResidencyManager::~ResidencyManager()
+{
+  get_context().residencyManager = nullptr;
+}
+
+ResidencyManager::ImageId ResidencyManager::addImage(const Image::CreateInfo& image_info)
+{
+  constexpr auto TRANSFER_USAGE =
+    vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+  ETNA_VERIFYF(
+    (image_info.imageUsage & TRANSFER_USAGE) == TRANSFER_USAGE,
+    "Managed image {} needs transfer src and dst usages to be evicted!",
+    image_info.name);
+
+  ManagedImage managed{
+    .image = {},
+    .info = image_info,
+    .name = std::string{image_info.name},
+    .evictedMips = 0,
+    .lastUsedBatch = workCount.batchIndex(),
+    .size = 0,
+  };
+  managed.info.name = managed.name;
+  managed.image = Image(allocator, managed.info);
+  managed.size = device.getImageMemoryRequirements(managed.image.get()).size;
+  stats.residentBytes += managed.size;
+
+  const auto id = static_cast<std::uint32_t>(images.size());
+  imageIds.emplace(managed.image.get(), id);
+  images.emplace_back(std::move(managed));
+  return static_cast<ImageId>(id);
+}
+
+ResidencyManager::BufferId ResidencyManager::addBuffer(const Buffer::CreateInfo& buffer_info)
+{
+  constexpr auto TRANSFER_USAGE =
+    vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+  ETNA_VERIFYF(
+    (buffer_info.bufferUsage & TRANSFER_USAGE) == TRANSFER_USAGE,
+    "Managed buffer {} needs transfer src and dst usages to be evicted!",
+    buffer_info.name);
+
+  ManagedBuffer managed{
+    .buffer = {},
+    .info = buffer_info,
+    .name = std::string{buffer_info.name},
+    .onHost = false,
+    .lastUsedBatch = workCount.batchIndex(),
+    .size = 0,
+  };
+  managed.info.name = managed.name;
+  managed.buffer = Buffer(allocator, managed.info);
+  managed.size = device.getBufferMemoryRequirements(managed.buffer.get()).size;
+  stats.residentBytes += managed.size;
+
+  const auto id = static_cast<std::uint32_t>(buffers.size());
+  bufferIds.emplace(managed.buffer.get(), id);
+  buffers.emplace_back(std::move(managed));
+  return static_cast<BufferId>(id);
+}
+
+void ResidencyManager::remove(ImageId id)
+{
+  auto& managed = images.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(managed.has_value(), "Removing an image that was removed already!");
+  stats.residentBytes -= managed->size;
+  imageIds.erase(managed->image.get());
+  retire(std::move(managed->image), managed->size);
+  managed.reset();
+}
+
+void ResidencyManager::remove(BufferId id)
+{
+  auto& managed = buffers.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(managed.has_value(), "Removing a buffer that was removed already!");
+  if (!managed->onHost)
+    stats.residentBytes -= managed->size;
+  bufferIds.erase(managed->buffer.get());
+  retire(std::move(managed->buffer), managed->onHost ? 0 : managed->size);
+  managed.reset();
+}
+
+Image& ResidencyManager::getImage(ImageId id)
+{
+  auto& managed = images.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(managed.has_value(), "Using a removed image!");
+  return managed->image;
+}
+
+Buffer& ResidencyManager::getBuffer(BufferId id)
+{
+  auto& managed = buffers.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(managed.has_value(), "Using a removed buffer!");
+  return managed->buffer;
+}
+
+std::uint32_t ResidencyManager::getEvictedMips(ImageId id) const
+{
+  const auto& managed = images.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(managed.has_value(), "Using a removed image!");
+  return managed->evictedMips;
+}
+
+bool ResidencyManager::isEvictedToHost(BufferId id) const
+{
+  const auto& managed = buffers.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(managed.has_value(), "Using a removed buffer!");
+  return managed->onHost;
+}
+
+void ResidencyManager::markUsed(vk::Image image)
+{
+  if (auto it = imageIds.find(image); it != imageIds.end())
+    images[it->second]->lastUsedBatch = workCount.batchIndex();
+}
+
+void ResidencyManager::markUsed(vk::Buffer buffer)
+{
+  if (auto it = bufferIds.find(buffer); it != bufferIds.end())
+    buffers[it->second]->lastUsedBatch = workCount.batchIndex();
+}
+
+bool ResidencyManager::isInFlight(std::uint64_t last_used_batch) const
+{
+  return last_used_batch + workCount.multiBufferingCount() > workCount.batchIndex();
+}
+
+void ResidencyManager::retire(Image image, vk::DeviceSize device_bytes)
+{
+  retired.push_back(Retired{
+    .image = std::move(image),
+    .buffer = {},
+    .retireBatch = workCount.batchIndex(),
+    .deviceBytes = device_bytes,
+  });
+}
+
+void ResidencyManager::retire(Buffer buffer, vk::DeviceSize device_bytes)
+{
+  retired.push_back(Retired{
+    .image = {},
+    .buffer = std::move(buffer),
+    .retireBatch = workCount.batchIndex(),
+    .deviceBytes = device_bytes,
+  });
+}
+
+vk::DeviceSize ResidencyManager::evictImage(vk::CommandBuffer cmd_buf, ManagedImage& managed)
+{
+  Image::CreateInfo smallerInfo = managed.info;
+  smallerInfo.name = managed.name;
+  smallerInfo.extent = vk::Extent3D{
+    .width = std::max(managed.info.extent.width / 2, 1u),
+    .height = std::max(managed.info.extent.height / 2, 1u),
+    .depth = std::max(managed.info.extent.depth / 2, 1u),
+  };
+  smallerInfo.mipLevels = managed.info.mipLevels - 1;
+  Image smaller(allocator, smallerInfo);
+
+  const auto layers = static_cast<std::uint32_t>(managed.info.layers);
+  std::vector<ImageCopyRequest> copies;
+  for (std::uint32_t mip = 0; mip < smallerInfo.mipLevels; ++mip)
+  {
+    const vk::Extent3D extent{
+      .width = std::max(smallerInfo.extent.width >> mip, 1u),
+      .height = std::max(smallerInfo.extent.height >> mip, 1u),
+      .depth = std::max(smallerInfo.extent.depth >> mip, 1u),
+    };
+    copies.push_back(ImageCopyRequest{
+      .src = managed.image,
+      .dst = smaller,
+      .region =
+        vk::ImageCopy2{
+          .srcSubresource = {{}, mip + 1, 0, layers},
+          .srcOffset = {},
+          .dstSubresource = {{}, mip, 0, layers},
+          .dstOffset = {},
+          .extent = extent,
+        },
+    });
+  }
+  copy_images(cmd_buf, copies);
+
+  const vk::DeviceSize oldSize = managed.size;
+  auto idNode = imageIds.extract(managed.image.get());
+  idNode.key() = smaller.get();
+  imageIds.insert(std::move(idNode));
+  retire(std::move(managed.image), oldSize);
+
+  managed.image = std::move(smaller);
+  managed.info = smallerInfo;
+  managed.evictedMips += 1;
+  // The copy uses the new image, so it isn't evicted again until the copy is done
+  managed.lastUsedBatch = workCount.batchIndex();
+  managed.size = device.getImageMemoryRequirements(managed.image.get()).size;
+  stats.residentBytes = stats.residentBytes - oldSize + managed.size;
+  ++stats.evictedImageMips;
+  return oldSize - managed.size;
+}
+
+vk::DeviceSize ResidencyManager::evictBuffer(vk::CommandBuffer cmd_buf, ManagedBuffer& managed)
+{
+  Buffer::CreateInfo hostInfo = managed.info;
+  hostInfo.name = managed.name;
+  hostInfo.memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+  Buffer hostBuffer(allocator, hostInfo);
+
+  set_state(
+    cmd_buf,
+    managed.buffer.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead);
+  set_state(
+    cmd_buf,
+    hostBuffer.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite);
+  flush_barriers(cmd_buf);
+
+  const vk::BufferCopy2 region{.srcOffset = 0, .dstOffset = 0, .size = managed.info.size};
+  cmd_buf.copyBuffer2(vk::CopyBufferInfo2{
+    .srcBuffer = managed.buffer.get(),
+    .dstBuffer = hostBuffer.get(),
+    .regionCount = 1,
+    .pRegions = &region,
+  });
+
+  auto idNode = bufferIds.extract(managed.buffer.get());
+  idNode.key() = hostBuffer.get();
+  bufferIds.insert(std::move(idNode));
+  retire(std::move(managed.buffer), managed.size);
+  managed.buffer = std::move(hostBuffer);
+  managed.info = hostInfo;
+  managed.onHost = true;
+  managed.lastUsedBatch = workCount.batchIndex();
+  stats.residentBytes -= managed.size;
+  ++stats.evictedBuffers;
+  return managed.size;
+}
+
+void ResidencyManager::update(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  std::erase_if(retired, [this](const Retired& old) { return !isInFlight(old.retireBatch); });
+  stats.retiredBytes = 0;
+  for (const auto& old : retired)
+    stats.retiredBytes += old.deviceBytes;
+
+  const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+  vmaGetMemoryProperties(allocator, &memoryProperties);
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+  vmaGetHeapBudgets(allocator, budgets.data());
+
+  stats.heapBudget = 0;
+  stats.heapUsage = 0;
+  for (std::uint32_t i = 0; i < memoryProperties->memoryHeapCount; ++i)
+    if (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+    {
+      stats.heapBudget += budgets[i].budget;
+      stats.heapUsage += budgets[i].usage;
+    }
+
+  const auto limit = info.budget != 0
+    ? info.budget
+    : static_cast<vk::DeviceSize>(static_cast<double>(stats.heapBudget) * info.budgetFraction);
+  // Memory of earlier evictions is freed soon, nothing more is evicted to make up for it
+  const vk::DeviceSize usage = stats.heapUsage - std::min(stats.heapUsage, stats.retiredBytes);
+  if (usage <= limit)
+    return;
+  vk::DeviceSize excess = usage - limit;
+
+  struct Candidate
+  {
+    std::uint64_t lastUsedBatch;
+    std::uint32_t index;
+    bool isImage;
+  };
+  std::vector<Candidate> candidates;
+  for (std::uint32_t i = 0; i < images.size(); ++i)
+    if (
+      images[i].has_value() && !isInFlight(images[i]->lastUsedBatch) &&
+      images[i]->info.mipLevels > info.minImageMips)
+      candidates.push_back({images[i]->lastUsedBatch, i, true});
+  for (std::uint32_t i = 0; i < buffers.size(); ++i)
+    if (buffers[i].has_value() && !isInFlight(buffers[i]->lastUsedBatch) && !buffers[i]->onHost)
+      candidates.push_back({buffers[i]->lastUsedBatch, i, false});
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+    return a.lastUsedBatch < b.lastUsedBatch;
+  });
+
+  // Memory of the evicted resources is only freed once the GPU is done copying them
+  for (const auto& candidate : candidates)
+  {
+    if (excess == 0)
+      break;
+    const vk::DeviceSize freed = candidate.isImage
+      ? evictImage(cmd_buf, *images[candidate.index])
+      : evictBuffer(cmd_buf, *buffers[candidate.index]);
+    excess -= std::min(excess, freed);
+  }
+}
+
+} // namespace etna
@@ -21,8 +21,9 @@ Sampler::Sampler(CreateInfo info)
     .maxLod = info.maxLod,
     .borderColor = vk::BorderColor::eFloatOpaqueWhite,
   };
-  sampler = unwrap_vk_result(etna::get_context().getDevice().createSamplerUnique(createInfo));
-  etna::set_debug_name(sampler.get(), info.name.data());
+  const auto device = etna::get_context().getDevice();
+  sampler = unwrap_vk_result(device.createSamplerUnique(createInfo));
+  etna::set_debug_name(device, sampler.get(), info.name.data());
 }
 
 } // namespace etna
@@ -0,0 +1,60 @@
+#include <etna/SecondaryCmdMgr.hpp>
+
+#include <tracy/Tracy.hpp>
+
+
+namespace etna
+{
+
+SecondaryCmdMgr::SecondaryCmdMgr(const Dependencies& deps)
+  : workCount{deps.workCount}
+  , device{deps.device}
+  , pools{deps.workCount, [&deps](std::size_t) {
+            std::vector<ThreadPool> result(deps.threadCount);
+            for (auto& threadPool : result)
+              threadPool.pool =
+                unwrap_vk_result(deps.device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+                  .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                  .queueFamilyIndex = deps.queueFamily,
+                }));
+            return result;
+          }}
+{
+}
+
+vk::CommandBuffer SecondaryCmdMgr::acquire(std::size_t thread_index)
+{
+  ZoneScoped;
+
+  auto& threadPools = pools.get();
+  ETNA_VERIFYF(
+    thread_index < threadPools.size(),
+    "Thread index {} is out of range, the manager only has {} threads!",
+    thread_index,
+    threadPools.size());
+  auto& threadPool = threadPools[thread_index];
+
+  // First use of this pool in a new frame, the GPU is done with
+  // all buffers recorded into it frames-in-flight batches ago.
+  if (threadPool.lastBatch != workCount.batchIndex())
+  {
+    ETNA_CHECK_VK_RESULT(device.resetCommandPool(threadPool.pool.get()));
+    threadPool.buffersUsed = 0;
+    threadPool.lastBatch = workCount.batchIndex();
+  }
+
+  if (threadPool.buffersUsed == threadPool.buffers.size())
+  {
+    auto newBuffers =
+      unwrap_vk_result(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool = threadPool.pool.get(),
+        .level = vk::CommandBufferLevel::eSecondary,
+        .commandBufferCount = 1,
+      }));
+    threadPool.buffers.push_back(std::move(newBuffers[0]));
+  }
+
+  return threadPool.buffers[threadPool.buffersUsed++].get();
+}
+
+} // namespace etna
@@ -10,8 +10,10 @@
 namespace etna
 {
 
-ShaderModule::ShaderModule(vk::Device device, std::filesystem::path shader_path)
+ShaderModule::ShaderModule(
+  vk::Device device, std::filesystem::path shader_path, std::span<const uint32_t> embedded_code)
   : path{shader_path}
+  , embeddedCode{embedded_code}
 {
   reload(device);
 }
@@ -52,7 +54,11 @@ void ShaderModule::reload(vk::Device device)
 {
   vkModule = {};
 
-  auto code = read_file(path);
+  auto code = embeddedCode.empty()
+    ? read_file(path)
+    : std::vector<char>(
+        reinterpret_cast<const char*>(embeddedCode.data()),
+        reinterpret_cast<const char*>(embeddedCode.data() + embeddedCode.size()));
   vk::ShaderModuleCreateInfo info{};
   info.setPCode(reinterpret_cast<const uint32_t*>(code.data()));
   info.setCodeSize(code.size());
@@ -114,7 +120,8 @@ void ShaderModule::reload(vk::Device device)
   }
 }
 
-uint32_t ShaderProgramManager::registerModule(std::filesystem::path path)
+uint32_t ShaderProgramManager::registerModule(
+  std::filesystem::path path, std::span<const uint32_t> embedded_code)
 {
   auto it = shaderModuleNames.find(path);
   if (it != shaderModuleNames.end())
@@ -122,7 +129,7 @@ uint32_t ShaderProgramManager::registerModule(std::filesystem::path path)
 
   uint32_t modId = static_cast<uint32_t>(shaderModules.size());
   std::unique_ptr<ShaderModule> newMod;
-  newMod.reset(new ShaderModule{get_context().getDevice(), path});
+  newMod.reset(new ShaderModule{context.getDevice(), path, embedded_code});
   shaderModules.push_back(std::move(newMod));
   return modId;
 }
@@ -167,43 +174,68 @@ static void validate_program_shaders(
 }
 
 ShaderProgramId ShaderProgramManager::loadProgram(
-  const char* name, std::span<std::filesystem::path const> shaders_path)
+  const char* name,
+  std::span<std::filesystem::path const> shaders_path,
+  ShaderProgramLayoutOptions layout_options)
 {
-  if (programNames.find(name) != programNames.end())
-    ETNA_PANIC("Shader program {} redefenition", name);
-
+  std::lock_guard lock{mutex};
   std::vector<uint32_t> moduleIds;
-  std::vector<vk::ShaderStageFlagBits> stages;
   for (const auto& path : shaders_path)
-  {
-    auto id = registerModule(path);
-    auto stage = getModule(id).getStage();
+    moduleIds.push_back(registerModule(path));
+  return addProgram(name, std::move(moduleIds), std::move(layout_options));
+}
 
-    moduleIds.push_back(id);
-    stages.push_back(stage);
-  }
+ShaderProgramId ShaderProgramManager::loadEmbeddedProgram(
+  const char* name,
+  std::span<const EmbeddedShader> shaders,
+  ShaderProgramLayoutOptions layout_options)
+{
+  std::lock_guard lock{mutex};
+  std::vector<uint32_t> moduleIds;
+  for (const auto& shader : shaders)
+    moduleIds.push_back(registerModule(std::filesystem::path{shader.name}, shader.code));
+  return addProgram(name, std::move(moduleIds), std::move(layout_options));
+}
+
+ShaderProgramId ShaderProgramManager::addProgram(
+  const char* name, std::vector<uint32_t> module_ids, ShaderProgramLayoutOptions layout_options)
+{
+  const Snapshot& current = snapshot.latest();
+  if (current.names.find(name) != current.names.end())
+    ETNA_PANIC("Shader program {} redefenition", name);
+
+  std::vector<vk::ShaderStageFlagBits> stages;
+  for (auto id : module_ids)
+    stages.push_back(getModule(id).getStage());
 
   validate_program_shaders(name, stages);
 
   ShaderProgramId progId = static_cast<ShaderProgramId>(programs.size());
-  programs.emplace_back(new ShaderProgramInternal{name, std::move(moduleIds)});
-  programs[static_cast<std::underlying_type_t<ShaderProgramId>>(progId)]->reload(*this);
-  programNames[name] = progId;
+  programs.emplace_back(
+    new ShaderProgramInternal{name, std::move(module_ids), std::move(layout_options)});
+  programs.back()->reload(*this);
+
+  Snapshot next = current;
+  next.names[name] = progId;
+  next.programs.push_back(programs.back().get());
+  snapshot.publish(std::move(next));
   return progId;
 }
 
 ShaderProgramId ShaderProgramManager::tryGetProgram(const char* name) const
 {
-  auto it = programNames.find(name);
-  if (it == programNames.end())
+  const auto current = snapshot.read();
+  auto it = current->names.find(name);
+  if (it == current->names.end())
     return ShaderProgramId::Invalid;
   return it->second;
 }
 
 ShaderProgramId ShaderProgramManager::getProgram(const char* name) const
 {
-  auto it = programNames.find(name);
-  if (it == programNames.end())
+  const auto current = snapshot.read();
+  auto it = current->names.find(name);
+  if (it == current->names.end())
     ETNA_PANIC("Shader program {} not found", name);
   return it->second;
 }
@@ -215,7 +247,7 @@ void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& m
   pushConst = vk::PushConstantRange{};
 
   std::array<DescriptorSetInfo, MAX_PROGRAM_DESCRIPTORS> dstDescriptors;
-  auto& descriptorLayoutCache = get_context().getDescriptorSetLayouts();
+  auto& descriptorLayoutCache = manager.context.getDescriptorSetLayouts();
 
   for (auto id : moduleIds)
   {
@@ -257,13 +289,51 @@ void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& m
     }
   }
 
+  for (const auto& immutable : layoutOptions.immutableSamplers)
+  {
+    if (immutable.set >= MAX_PROGRAM_DESCRIPTORS || !usedDescriptors.test(immutable.set))
+      ETNA_PANIC("ShaderProgram {} : immutable sampler for unused set {}", name, immutable.set);
+    dstDescriptors[immutable.set].setImmutableSampler(immutable.binding, immutable.sampler);
+  }
+
+  std::uint32_t maxInlineUniformBlockSize = 0;
+  if (!layoutOptions.inlineUniformBlocks.empty())
+    maxInlineUniformBlockSize = manager.context.getPhysicalDevice()
+                                  .getProperties2<
+                                    vk::PhysicalDeviceProperties2,
+                                    vk::PhysicalDeviceInlineUniformBlockProperties>()
+                                  .get<vk::PhysicalDeviceInlineUniformBlockProperties>()
+                                  .maxInlineUniformBlockSize;
+  for (const auto& block : layoutOptions.inlineUniformBlocks)
+  {
+    ETNA_VERIFYF(
+      manager.context.getOptionalFeatures().inlineUniformBlock,
+      "ShaderProgram {} : inline uniform blocks are not supported by the device",
+      name);
+    if (block.set >= MAX_PROGRAM_DESCRIPTORS || !usedDescriptors.test(block.set))
+      ETNA_PANIC("ShaderProgram {} : inline uniform block for unused set {}", name, block.set);
+    dstDescriptors[block.set].setInlineUniformBlock(block.binding);
+
+    // Bigger blocks have to stay uniform buffers
+    const auto blockSize = dstDescriptors[block.set].getBinding(block.binding).descriptorCount;
+    ETNA_VERIFYF(
+      blockSize <= maxInlineUniformBlockSize,
+      "ShaderProgram {} : inline uniform block at set {} binding {} is {} bytes, "
+      "the device supports at most {} bytes",
+      name,
+      block.set,
+      block.binding,
+      blockSize,
+      maxInlineUniformBlockSize);
+  }
+
   std::vector<vk::DescriptorSetLayout> vkLayouts;
 
   for (uint32_t i = 0; i < MAX_PROGRAM_DESCRIPTORS; i++)
   {
     if (!usedDescriptors.test(i))
       continue;
-    auto res = descriptorLayoutCache.get(get_context().getDevice(), dstDescriptors[i]);
+    auto res = descriptorLayoutCache.get(manager.context.getDevice(), dstDescriptors[i]);
     descriptorIds[i] = res.first;
     vkLayouts.push_back(res.second);
   }
@@ -277,14 +347,18 @@ void ShaderProgramManager::ShaderProgramInternal::reload(ShaderProgramManager& m
     info.setPushConstantRangeCount(1u);
   }
 
-  progLayout = unwrap_vk_result(get_context().getDevice().createPipelineLayoutUnique(info));
+  progLayout = unwrap_vk_result(manager.context.getDevice().createPipelineLayoutUnique(info));
 }
 
 void ShaderProgramManager::reloadPrograms()
 {
+  std::lock_guard lock{mutex};
+  // Nobody may be reading while programs are reloaded, so it's a good time to free snapshots
+  snapshot.reclaim();
+
   for (auto& mod : shaderModules)
   {
-    mod->reload(get_context().getDevice());
+    mod->reload(context.getDevice());
   }
 
   for (auto& progPtr : programs)
@@ -293,9 +367,17 @@ void ShaderProgramManager::reloadPrograms()
   }
 }
 
+void ShaderProgramManager::collectRetiredSnapshots()
+{
+  std::lock_guard lock{mutex};
+  snapshot.collect();
+}
+
 void ShaderProgramManager::clear()
 {
-  programNames.clear();
+  std::lock_guard lock{mutex};
+  snapshot.publish(Snapshot{});
+  snapshot.reclaim();
   programs.clear();
   shaderModuleNames.clear();
   shaderModules.clear();
@@ -304,6 +386,8 @@ void ShaderProgramManager::clear()
 std::vector<vk::PipelineShaderStageCreateInfo> ShaderProgramManager::getShaderStages(
   ShaderProgramId id) const
 {
+  // Modules may be registered by other threads at the same time
+  std::lock_guard lock{mutex};
   auto& prog = getProgInternal(id);
 
   std::vector<vk::PipelineShaderStageCreateInfo> stages;
@@ -325,7 +409,7 @@ vk::DescriptorSetLayout ShaderProgramManager::getDescriptorLayout(
   ShaderProgramId id, uint32_t set) const
 {
   auto layoutId = getDescriptorLayoutId(id, set);
-  return get_context().getDescriptorSetLayouts().getVkLayout(layoutId);
+  return context.getDescriptorSetLayouts().getVkLayout(layoutId);
 }
 
 vk::PushConstantRange ShaderProgramInfo::getPushConst() const
@@ -354,12 +438,12 @@ DescriptorLayoutId ShaderProgramInfo::getDescriptorLayoutId(uint32_t set) const
 
 vk::DescriptorSetLayout ShaderProgramInfo::getDescriptorSetLayout(uint32_t set) const
 {
-  return get_context().getDescriptorSetLayouts().getVkLayout(getDescriptorLayoutId(set));
+  return mgr.context.getDescriptorSetLayouts().getVkLayout(getDescriptorLayoutId(set));
 }
 
 const DescriptorSetInfo& ShaderProgramInfo::getDescriptorSetInfo(uint32_t set) const
 {
-  return get_context().getDescriptorSetLayouts().getLayoutInfo(getDescriptorLayoutId(set));
+  return mgr.context.getDescriptorSetLayouts().getLayoutInfo(getDescriptorLayoutId(set));
 }
 
 } // namespace etna
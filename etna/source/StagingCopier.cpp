@@ -0,0 +1,159 @@
+#include "StagingCopier.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define ETNA_STAGING_COPY_SSE2 1
+#include <emmintrin.h>
+#else
+#define ETNA_STAGING_COPY_SSE2 0
+#endif
+
+
+namespace etna
+{
+
+static constexpr std::size_t CACHE_LINE_SIZE = 64;
+// Memory bandwidth is saturated long before all cores of big CPUs are busy
+static constexpr std::size_t MAX_AUTO_THREADS = 8;
+
+static void copy_streaming(std::byte* dst, const std::byte* src, std::size_t size)
+{
+#if ETNA_STAGING_COPY_SSE2
+  // Streaming stores need aligned destinations
+  const auto address = std::bit_cast<std::uintptr_t>(dst);
+  const std::size_t head =
+    std::min(size, (CACHE_LINE_SIZE - address % CACHE_LINE_SIZE) % CACHE_LINE_SIZE);
+  std::memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  size -= head;
+
+  // Whole cache lines at a time, so that write-combining buffers are flushed full
+  const std::size_t lines = size / CACHE_LINE_SIZE;
+  for (std::size_t i = 0; i < lines; ++i)
+  {
+    const auto* from = reinterpret_cast<const __m128i*>(src + i * CACHE_LINE_SIZE);
+    auto* to = reinterpret_cast<__m128i*>(dst + i * CACHE_LINE_SIZE);
+    const __m128i a = _mm_loadu_si128(from + 0);
+    const __m128i b = _mm_loadu_si128(from + 1);
+    const __m128i c = _mm_loadu_si128(from + 2);
+    const __m128i d = _mm_loadu_si128(from + 3);
+    _mm_stream_si128(to + 0, a);
+    _mm_stream_si128(to + 1, b);
+    _mm_stream_si128(to + 2, c);
+    _mm_stream_si128(to + 3, d);
+  }
+  // Streaming stores are weakly ordered, they must be visible before the submit
+  _mm_sfence();
+
+  const std::size_t copied = lines * CACHE_LINE_SIZE;
+  std::memcpy(dst + copied, src + copied, size - copied);
+#else
+  std::memcpy(dst, src, size);
+#endif
+}
+
+StagingCopier::StagingCopier(std::size_t thread_count, std::size_t min_part_size)
+  : minPartSize{std::max(min_part_size, CACHE_LINE_SIZE)}
+{
+  if (thread_count == 0)
+    thread_count =
+      std::clamp<std::size_t>(std::thread::hardware_concurrency() / 2, 1, MAX_AUTO_THREADS);
+  parts.resize(thread_count);
+}
+
+void StagingCopier::startWorkers()
+{
+  workers.reserve(parts.size() - 1);
+  for (std::size_t i = 0; i + 1 < parts.size(); ++i)
+    workers.emplace_back([this, i]() { workerLoop(i); });
+}
+
+StagingCopier::~StagingCopier()
+{
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  workReady.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void StagingCopier::workerLoop(std::size_t worker_index)
+{
+  std::uint64_t seenGeneration = 0;
+  while (true)
+  {
+    Part part;
+    {
+      std::unique_lock lock{mutex};
+      workReady.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+      if (stopping)
+        return;
+      seenGeneration = generation;
+      part = parts[worker_index];
+    }
+
+    if (part.size > 0)
+      copy_streaming(part.dst, part.src, part.size);
+
+    {
+      std::lock_guard lock{mutex};
+      --partsLeft;
+    }
+    workDone.notify_one();
+  }
+}
+
+void StagingCopier::copy(std::byte* dst, const std::byte* src, std::size_t size)
+{
+  ZoneScoped;
+
+  const std::size_t partCount = std::clamp<std::size_t>(size / minPartSize, 1, parts.size());
+  // The workers are busy with a copy of another thread, which saturates the memory bus anyway
+  std::unique_lock split{splitMutex, std::try_to_lock};
+  if (partCount == 1 || !split.owns_lock())
+  {
+    copy_streaming(dst, src, size);
+    return;
+  }
+  if (workers.empty())
+    startWorkers();
+
+  // Parts end on cache line boundaries of the destination, so that no two
+  // threads write into the same line. The calling thread copies the last part.
+  const auto address = std::bit_cast<std::uintptr_t>(dst);
+  {
+    std::lock_guard lock{mutex};
+    std::fill(parts.begin(), parts.end(), Part{.dst = dst, .src = src, .size = 0});
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < partCount; ++i)
+    {
+      const std::uintptr_t split = address + size * (i + 1) / partCount;
+      const std::uintptr_t alignedSplit =
+        (split + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+      const std::size_t end = std::clamp<std::size_t>(alignedSplit - address, begin, size);
+
+      const std::size_t slot = i + 1 < partCount ? i : parts.size() - 1;
+      parts[slot] = Part{.dst = dst + begin, .src = src + begin, .size = end - begin};
+      begin = end;
+    }
+    ++generation;
+    partsLeft = workers.size();
+  }
+  workReady.notify_all();
+
+  const Part& own = parts.back();
+  copy_streaming(own.dst, own.src, own.size);
+
+  std::unique_lock lock{mutex};
+  workDone.wait(lock, [this]() { return partsLeft == 0; });
+}
+
+} // namespace etna
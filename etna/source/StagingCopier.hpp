@@ -0,0 +1,74 @@
+#pragma once
+#ifndef ETNA_STAGING_COPIER_HPP_INCLUDED
+#define ETNA_STAGING_COPIER_HPP_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace etna
+{
+
+/**
+ * Copies data into mapped staging memory, which is usually write-combined.
+ * Large copies are split into cache-line-aligned parts that are copied by
+ * several threads at once, as a single core can't saturate the memory bus.
+ * Non-temporal stores are used where available to not pollute the caches
+ * with data the CPU will never read.
+ */
+class StagingCopier
+{
+public:
+  // Smaller parts aren't worth waking a thread up for, see benchmarks/StagingCopierBench.cpp
+  static constexpr std::size_t DEFAULT_MIN_PART_SIZE = std::size_t{1} << 20;
+
+  // thread_count includes the calling thread, 0 picks a count based on the CPU.
+  // The workers are only started by the first copy that is split between them.
+  explicit StagingCopier(
+    std::size_t thread_count, std::size_t min_part_size = DEFAULT_MIN_PART_SIZE);
+  ~StagingCopier();
+
+  StagingCopier(const StagingCopier&) = delete;
+  StagingCopier& operator=(const StagingCopier&) = delete;
+  StagingCopier(StagingCopier&&) = delete;
+  StagingCopier& operator=(StagingCopier&&) = delete;
+
+  std::size_t getThreadCount() const { return parts.size(); }
+
+  // Blocks until all of the data is copied. May be called from several threads,
+  // while one copy is split between the workers, others are done by their callers.
+  void copy(std::byte* dst, const std::byte* src, std::size_t size);
+
+private:
+  struct Part
+  {
+    std::byte* dst;
+    const std::byte* src;
+    std::size_t size;
+  };
+
+  void startWorkers();
+  void workerLoop(std::size_t worker_index);
+
+  std::size_t minPartSize;
+  // Held for the whole split copy, guards the workers as well
+  std::mutex splitMutex;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable workReady;
+  std::condition_variable workDone;
+  // Parts for the workers, the last one is copied by the calling thread
+  std::vector<Part> parts;
+  std::uint64_t generation = 0;
+  std::size_t partsLeft = 0;
+  bool stopping = false;
+};
+
+} // namespace etna
+
+#endif // ETNA_STAGING_COPIER_HPP_INCLUDED
@@ -1,25 +1,84 @@
 #include "StateTracking.hpp"
 #include "etna/GlobalContext.hpp"
 
+#include <algorithm>
 #include <bit>
 
 
 namespace etna
 {
 
+ResourceStates::ImageState& ResourceStates::getImageState(vk::Image image, vk::CommandBuffer owner)
+{
+  HandleType resHandle = std::bit_cast<HandleType>(static_cast<VkImage>(image));
+  auto it = currentStates.find(resHandle);
+  // A buffer that had the handle before was destroyed without being forgotten
+  if (it != currentStates.end() && !std::holds_alternative<ImageState>(it->second))
+  {
+    currentStates.erase(it);
+    it = currentStates.end();
+  }
+  if (it == currentStates.end())
+  {
+    // Captures keep the unknown state intact to tell first uses apart
+    ImageState initial{LayerRangeState{
+      .beginLayer = 0,
+      .endLayer = ALL_LAYERS,
+      .state = TextureState{.owner = capturing != nullptr ? vk::CommandBuffer{} : owner},
+    }};
+    it = currentStates.emplace(resHandle, std::move(initial)).first;
+  }
+  return std::get<ImageState>(it->second);
+}
+
 void ResourceStates::setExternalTextureState(
   vk::Image image,
   vk::PipelineStageFlags2 pipeline_stage_flag,
   vk::AccessFlags2 access_flags,
   vk::ImageLayout layout)
 {
+  std::lock_guard lock{mutex};
   HandleType resHandle = std::bit_cast<HandleType>(static_cast<VkImage>(image));
-  currentStates[resHandle] = TextureState{
-    .piplineStageFlags = pipeline_stage_flag,
-    .accessFlags = access_flags,
-    .layout = layout,
-    .owner = {},
-  };
+  currentStates[resHandle] = ImageState{LayerRangeState{
+    .beginLayer = 0,
+    .endLayer = ALL_LAYERS,
+    .state =
+      TextureState{
+        .piplineStageFlags = pipeline_stage_flag,
+        .accessFlags = access_flags,
+        .layout = layout,
+        .owner = {},
+      },
+  }};
+}
+
+template <class Range>
+static void split_ranges_at(std::vector<Range>& ranges, uint32_t layer)
+{
+  auto it = std::find_if(ranges.begin(), ranges.end(), [layer](const Range& range) {
+    return range.beginLayer < layer && layer < range.endLayer;
+  });
+  if (it == ranges.end())
+    return;
+
+  Range tail = *it;
+  tail.beginLayer = layer;
+  it->endLayer = layer;
+  ranges.insert(it + 1, tail);
+}
+
+template <class Range>
+static void merge_equal_ranges(std::vector<Range>& ranges)
+{
+  std::size_t last = 0;
+  for (std::size_t i = 1; i < ranges.size(); ++i)
+  {
+    if (ranges[i].state == ranges[last].state)
+      ranges[last].endLayer = ranges[i].endLayer;
+    else
+      ranges[++last] = ranges[i];
+  }
+  ranges.resize(last + 1);
 }
 
 void ResourceStates::setTextureState(
@@ -29,69 +88,270 @@ void ResourceStates::setTextureState(
   vk::AccessFlags2 access_flags,
   vk::ImageLayout layout,
   vk::ImageAspectFlags aspect_flags,
-  ForceSetState force)
+  ForceSetState force,
+  uint32_t base_layer,
+  uint32_t layer_count)
 {
-  HandleType resHandle = std::bit_cast<HandleType>(static_cast<VkImage>(image));
-  if (currentStates.count(resHandle) == 0)
+  std::lock_guard lock{mutex};
+  if (Capture* capture = findCapture(com_buffer))
   {
-    currentStates[resHandle] = TextureState{.owner = com_buffer};
+    capture->states->setTextureState(
+      com_buffer,
+      image,
+      pipeline_stage_flag,
+      access_flags,
+      layout,
+      aspect_flags,
+      force,
+      base_layer,
+      layer_count);
+    return;
   }
+
+  const uint32_t endLayer = layer_count == ALL_LAYERS ? ALL_LAYERS : base_layer + layer_count;
+
+  auto& ranges = getImageState(image, com_buffer);
+  split_ranges_at(ranges, base_layer);
+  split_ranges_at(ranges, endLayer);
+
   TextureState newState{
     .piplineStageFlags = pipeline_stage_flag,
     .accessFlags = access_flags,
     .layout = layout,
     .owner = com_buffer,
   };
-  auto& oldState = std::get<0>(currentStates[resHandle]);
-  if (force == ForceSetState::eFalse && newState == oldState)
+  for (auto& range : ranges)
+  {
+    if (range.endLayer <= base_layer || range.beginLayer >= endLayer)
+      continue;
+
+    auto& oldState = range.state;
+    if (capturing != nullptr && oldState == TextureState{})
+    {
+      capturing->imageRequirements.push_back(Capture::ImageRequirement{
+        .image = image,
+        .state = newState,
+        .aspectFlags = aspect_flags,
+        .force = force,
+        .beginLayer = range.beginLayer,
+        .endLayer = range.endLayer,
+      });
+      oldState = newState;
+      continue;
+    }
+    if (force == ForceSetState::eFalse && newState == oldState)
+      continue;
+    pendingBarriers[com_buffer].images.push_back(vk::ImageMemoryBarrier2{
+      .srcStageMask = oldState.piplineStageFlags,
+      .srcAccessMask = oldState.accessFlags,
+      .dstStageMask = newState.piplineStageFlags,
+      .dstAccessMask = newState.accessFlags,
+      .oldLayout = oldState.layout,
+      .newLayout = newState.layout,
+      .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .image = image,
+      .subresourceRange =
+        {
+          .aspectMask = aspect_flags,
+          .baseMipLevel = 0,
+          .levelCount = vk::RemainingMipLevels,
+          .baseArrayLayer = range.beginLayer,
+          .layerCount = range.endLayer == ALL_LAYERS ? vk::RemainingArrayLayers
+                                                     : range.endLayer - range.beginLayer,
+        },
+    });
+    oldState = newState;
+  }
+
+  merge_equal_ranges(ranges);
+}
+
+void ResourceStates::beginRenderScope(vk::CommandBuffer com_buf)
+{
+  std::lock_guard lock{mutex};
+  const bool inserted = buffersInRenderScope.insert(com_buf).second;
+  ETNA_VERIFYF(inserted, "RenderTargetState scopes shouldn't overlap.");
+}
+
+void ResourceStates::endRenderScope(vk::CommandBuffer com_buf)
+{
+  std::lock_guard lock{mutex};
+  buffersInRenderScope.erase(com_buf);
+}
+
+bool ResourceStates::hasUndefinedContents(
+  vk::Image image, uint32_t base_layer, uint32_t layer_count) const
+{
+  std::lock_guard lock{mutex};
+  HandleType resHandle = std::bit_cast<HandleType>(static_cast<VkImage>(image));
+  auto it = currentStates.find(resHandle);
+  if (it == currentStates.end() || !std::holds_alternative<ImageState>(it->second))
+    return true;
+
+  const uint32_t endLayer = layer_count == ALL_LAYERS ? ALL_LAYERS : base_layer + layer_count;
+  const auto& ranges = std::get<ImageState>(it->second);
+  return std::all_of(ranges.begin(), ranges.end(), [&](const LayerRangeState& range) {
+    return range.endLayer <= base_layer || range.beginLayer >= endLayer ||
+      range.state.layout == vk::ImageLayout::eUndefined;
+  });
+}
+
+static constexpr vk::AccessFlags2 WRITE_ACCESS_FLAGS = vk::AccessFlagBits2::eShaderWrite |
+  vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eColorAttachmentWrite |
+  vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eTransferWrite |
+  vk::AccessFlagBits2::eHostWrite | vk::AccessFlagBits2::eMemoryWrite;
+
+void ResourceStates::setBufferState(
+  vk::CommandBuffer com_buffer,
+  vk::Buffer buffer,
+  vk::PipelineStageFlags2 pipeline_stage_flag,
+  vk::AccessFlags2 access_flags,
+  ForceSetState force)
+{
+  std::lock_guard lock{mutex};
+  if (Capture* capture = findCapture(com_buffer))
+  {
+    capture->states->setBufferState(
+      com_buffer, buffer, pipeline_stage_flag, access_flags, force);
     return;
-  barriersToFlush.push_back(vk::ImageMemoryBarrier2{
+  }
+
+  BufferState newState{
+    .piplineStageFlags = pipeline_stage_flag,
+    .accessFlags = access_flags,
+    .owner = com_buffer,
+  };
+
+  HandleType resHandle = std::bit_cast<HandleType>(static_cast<VkBuffer>(buffer));
+  auto it = currentStates.find(resHandle);
+  // An image that had the handle before was destroyed without being forgotten
+  if (it != currentStates.end() && !std::holds_alternative<BufferState>(it->second))
+  {
+    currentStates.erase(it);
+    it = currentStates.end();
+  }
+  if (it == currentStates.end() && capturing != nullptr)
+  {
+    capturing->buffersAtRequirement[resHandle] = capturing->bufferRequirements.size();
+    capturing->bufferRequirements.push_back(Capture::BufferRequirement{
+      .buffer = buffer,
+      .state = newState,
+      .force = force,
+    });
+    currentStates.emplace(resHandle, newState);
+    return;
+  }
+  if (it == currentStates.end())
+    it = currentStates.emplace(resHandle, BufferState{.owner = com_buffer}).first;
+  auto& oldState = std::get<BufferState>(it->second);
+
+  // Writes have to wait for the previous ones even in the same state, e.g. two
+  // dispatches writing one storage buffer, so only identical reads are collapsed
+  if (
+    force == ForceSetState::eFalse && newState == oldState &&
+    !(newState.accessFlags & WRITE_ACCESS_FLAGS))
+    return;
+
+  // Nothing to wait for if the buffer wasn't used on the GPU yet
+  if (force == ForceSetState::eFalse && !oldState.accessFlags)
+  {
+    oldState = newState;
+    return;
+  }
+
+  const bool readAfterRead =
+    !(oldState.accessFlags & WRITE_ACCESS_FLAGS) && !(newState.accessFlags & WRITE_ACCESS_FLAGS);
+  if (force == ForceSetState::eFalse && readAfterRead)
+  {
+    // Following writes will have to wait for all of the reads
+    oldState.piplineStageFlags |= newState.piplineStageFlags;
+    oldState.accessFlags |= newState.accessFlags;
+    oldState.owner = com_buffer;
+    if (capturing != nullptr)
+    {
+      auto req = capturing->buffersAtRequirement.find(resHandle);
+      if (req != capturing->buffersAtRequirement.end())
+        capturing->bufferRequirements[req->second].state = oldState;
+    }
+    return;
+  }
+
+  if (capturing != nullptr)
+    capturing->buffersAtRequirement.erase(resHandle);
+
+  pendingBarriers[com_buffer].buffers.push_back(vk::BufferMemoryBarrier2{
     .srcStageMask = oldState.piplineStageFlags,
     .srcAccessMask = oldState.accessFlags,
     .dstStageMask = newState.piplineStageFlags,
     .dstAccessMask = newState.accessFlags,
-    .oldLayout = oldState.layout,
-    .newLayout = newState.layout,
     .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
     .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-    .image = image,
-    .subresourceRange =
-      {
-        .aspectMask = aspect_flags,
-        .baseMipLevel = 0,
-        .levelCount = vk::RemainingMipLevels,
-        .baseArrayLayer = 0,
-        .layerCount = vk::RemainingArrayLayers,
-      },
+    .buffer = buffer,
+    .offset = 0,
+    .size = vk::WholeSize,
   });
   oldState = newState;
 }
 
 void ResourceStates::flushBarriers(vk::CommandBuffer com_buf)
 {
-  if (barriersToFlush.empty())
+  std::lock_guard lock{mutex};
+  if (Capture* capture = findCapture(com_buf))
+  {
+    capture->states->flushBarriers(com_buf);
+    return;
+  }
+
+  // The entry is kept around, command buffers are usually reused every frame
+  auto it = pendingBarriers.find(com_buf);
+  if (it == pendingBarriers.end())
+    return;
+  auto& pending = it->second;
+  if (pending.images.empty() && pending.buffers.empty())
     return;
   vk::DependencyInfo depInfo{
     .dependencyFlags = vk::DependencyFlagBits::eByRegion,
-    .imageMemoryBarrierCount = static_cast<uint32_t>(barriersToFlush.size()),
-    .pImageMemoryBarriers = barriersToFlush.data(),
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(pending.buffers.size()),
+    .pBufferMemoryBarriers = pending.buffers.data(),
+    .imageMemoryBarrierCount = static_cast<uint32_t>(pending.images.size()),
+    .pImageMemoryBarriers = pending.images.data(),
   };
   com_buf.pipelineBarrier2(depInfo);
-  barriersToFlush.clear();
+  pending.images.clear();
+  pending.buffers.clear();
 }
 
 void ResourceStates::setColorTarget(
-  vk::CommandBuffer com_buffer, vk::Image image, BarrierBehavoir behavoir)
+  vk::CommandBuffer com_buffer,
+  vk::Image image,
+  BarrierBehavoir behavoir,
+  uint32_t base_layer,
+  uint32_t layer_count,
+  bool local_read)
 {
   if (get_context().shouldGenerateBarriersWhen(behavoir))
   {
+    vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eColorAttachmentOutput;
+    vk::AccessFlags2 access = vk::AccessFlagBits2::eColorAttachmentWrite;
+    vk::ImageLayout layout = vk::ImageLayout::eColorAttachmentOptimal;
+    if (local_read)
+    {
+      stages |= vk::PipelineStageFlagBits2::eFragmentShader;
+      access |= vk::AccessFlagBits2::eInputAttachmentRead;
+      layout = vk::ImageLayout::eRenderingLocalReadKHR;
+    }
+
     setTextureState(
       com_buffer,
       image,
-      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-      vk::AccessFlagBits2::eColorAttachmentWrite,
-      vk::ImageLayout::eColorAttachmentOptimal,
-      vk::ImageAspectFlagBits::eColor);
+      stages,
+      access,
+      layout,
+      vk::ImageAspectFlagBits::eColor,
+      ForceSetState::eFalse,
+      base_layer,
+      layer_count);
   }
 }
 
@@ -99,18 +359,34 @@ void ResourceStates::setDepthStencilTarget(
   vk::CommandBuffer com_buffer,
   vk::Image image,
   vk::ImageAspectFlags aspect_flags,
-  BarrierBehavoir behavoir)
+  BarrierBehavoir behavoir,
+  uint32_t base_layer,
+  uint32_t layer_count,
+  bool local_read)
 {
   if (get_context().shouldGenerateBarriersWhen(behavoir))
   {
+    vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+      vk::PipelineStageFlagBits2::eLateFragmentTests;
+    vk::AccessFlags2 access = vk::AccessFlagBits2::eDepthStencilAttachmentWrite;
+    vk::ImageLayout layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    if (local_read)
+    {
+      stages |= vk::PipelineStageFlagBits2::eFragmentShader;
+      access |= vk::AccessFlagBits2::eInputAttachmentRead;
+      layout = vk::ImageLayout::eRenderingLocalReadKHR;
+    }
+
     setTextureState(
       com_buffer,
       image,
-      vk::PipelineStageFlagBits2::eEarlyFragmentTests |
-        vk::PipelineStageFlagBits2::eLateFragmentTests,
-      vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
-      vk::ImageLayout::eDepthStencilAttachmentOptimal,
-      aspect_flags);
+      stages,
+      access,
+      layout,
+      aspect_flags,
+      ForceSetState::eFalse,
+      base_layer,
+      layer_count);
   }
 }
 
@@ -132,4 +408,102 @@ void ResourceStates::setResolveTarget(
   }
 }
 
+void ResourceStates::forget(vk::Image image)
+{
+  std::lock_guard lock{mutex};
+  currentStates.erase(std::bit_cast<HandleType>(static_cast<VkImage>(image)));
+}
+
+void ResourceStates::forget(vk::Buffer buffer)
+{
+  std::lock_guard lock{mutex};
+  currentStates.erase(std::bit_cast<HandleType>(static_cast<VkBuffer>(buffer)));
+}
+
+void ResourceStates::beginCapture(vk::CommandBuffer com_buf, Capture& capture)
+{
+  std::lock_guard lock{mutex};
+  capture.imageRequirements.clear();
+  capture.bufferRequirements.clear();
+  capture.buffersAtRequirement.clear();
+  capture.states = std::make_unique<ResourceStates>();
+  capture.states->capturing = &capture;
+
+  const bool inserted = captures.emplace(com_buf, &capture).second;
+  ETNA_VERIFYF(inserted, "The command buffer is already being captured.");
+}
+
+void ResourceStates::endCapture(vk::CommandBuffer com_buf)
+{
+  std::lock_guard lock{mutex};
+  auto it = captures.find(com_buf);
+  ETNA_VERIFYF(it != captures.end(), "The command buffer is not being captured.");
+  ETNA_VERIFYF(
+    !buffersInRenderScope.contains(com_buf),
+    "Captured commands must end all of their RenderTargetState scopes.");
+  it->second->states->flushBarriers(com_buf);
+  captures.erase(it);
+}
+
+ResourceStates::Capture* ResourceStates::findCapture(vk::CommandBuffer com_buf)
+{
+  std::lock_guard lock{mutex};
+  if (captures.empty())
+    return nullptr;
+  auto it = captures.find(com_buf);
+  return it != captures.end() ? it->second : nullptr;
+}
+
+void ResourceStates::replayCapture(vk::CommandBuffer com_buf, const Capture& capture)
+{
+  std::lock_guard lock{mutex};
+  ETNA_VERIFYF(capture.states != nullptr, "Replaying a capture that was never recorded.");
+
+  for (const auto& req : capture.imageRequirements)
+    setTextureState(
+      com_buf,
+      req.image,
+      req.state.piplineStageFlags,
+      req.state.accessFlags,
+      req.state.layout,
+      req.aspectFlags,
+      req.force,
+      req.beginLayer,
+      req.endLayer == ALL_LAYERS ? ALL_LAYERS : req.endLayer - req.beginLayer);
+  for (const auto& req : capture.bufferRequirements)
+    setBufferState(
+      com_buf, req.buffer, req.state.piplineStageFlags, req.state.accessFlags, req.force);
+  flushBarriers(com_buf);
+
+  // The barriers inside of the captured commands were already recorded,
+  // so the states they end with are simply taken over.
+  for (const auto& [handle, state] : capture.states->currentStates)
+  {
+    if (const auto* bufferState = std::get_if<BufferState>(&state))
+    {
+      BufferState newState = *bufferState;
+      newState.owner = com_buf;
+      currentStates[handle] = newState;
+      continue;
+    }
+
+    auto& ranges = getImageState(vk::Image{std::bit_cast<VkImage>(handle)}, com_buf);
+    for (const auto& captured : std::get<ImageState>(state))
+    {
+      if (captured.state == TextureState{})
+        continue;
+
+      split_ranges_at(ranges, captured.beginLayer);
+      split_ranges_at(ranges, captured.endLayer);
+      for (auto& range : ranges)
+        if (range.beginLayer >= captured.beginLayer && range.endLayer <= captured.endLayer)
+        {
+          range.state = captured.state;
+          range.state.owner = com_buf;
+        }
+    }
+    merge_equal_ranges(ranges);
+  }
+}
+
 } // namespace etna
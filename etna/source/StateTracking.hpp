@@ -5,12 +5,17 @@
 #include "etna/Vulkan.hpp"
 #include "etna/BarrierBehavoir.hpp"
 
+#include <memory>
+#include <mutex>
 #include <variant>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace etna
 {
 
+struct RecordingDescriptorPool;
+
 class ResourceStates
 {
   using HandleType = uint64_t;
@@ -22,11 +27,82 @@ class ResourceStates
     vk::CommandBuffer owner = {};
     bool operator==(const TextureState& other) const = default;
   };
-  using State = std::variant<TextureState>; // TODO: Add buffers
+  // State of array layers [beginLayer, endLayer) of an image
+  struct LayerRangeState
+  {
+    uint32_t beginLayer = 0;
+    uint32_t endLayer = 0;
+    TextureState state = {};
+  };
+  // Array layers of an image are tracked separately, so that multiview and layered
+  // rendering can transition only the layers that they render to. Ranges are sorted,
+  // don't overlap and cover every layer, hence the last one always ends at ALL_LAYERS.
+  // In the common case of whole-image transitions, this contains a single range.
+  using ImageState = std::vector<LayerRangeState>;
+  // Buffers are tracked as a whole, as sub-allocating parts of a buffer
+  // for different purposes within a single frame is uncommon in etna.
+  struct BufferState
+  {
+    vk::PipelineStageFlags2 piplineStageFlags = {};
+    vk::AccessFlags2 accessFlags = {};
+    vk::CommandBuffer owner = {};
+    bool operator==(const BufferState& other) const = default;
+  };
+  using State = std::variant<ImageState, BufferState>;
   std::unordered_map<HandleType, State> currentStates;
-  std::vector<vk::ImageMemoryBarrier2> barriersToFlush;
+  // Barriers are kept per command buffer, so that threads recording
+  // different command buffers never flush each other's barriers.
+  struct PendingBarriers
+  {
+    std::vector<vk::ImageMemoryBarrier2> images;
+    std::vector<vk::BufferMemoryBarrier2> buffers;
+  };
+  std::unordered_map<vk::CommandBuffer, PendingBarriers> pendingBarriers;
+  // Command buffers that are currently inside a RenderTargetState scope
+  std::unordered_set<vk::CommandBuffer> buffersInRenderScope;
+
+  static constexpr uint32_t ALL_LAYERS = vk::RemainingArrayLayers;
+
+  ImageState& getImageState(vk::Image image, vk::CommandBuffer owner);
 
 public:
+  /**
+   * Uses of resources by a command buffer that is recorded once and executed many
+   * times, see StaticCommandBuffer. The states of resources before its execution
+   * aren't known while recording, so the command buffer gets its own tracker, where
+   * every resource starts out unknown. Barriers between its own uses of a resource
+   * are recorded into it as usual, while the first use of a resource becomes a
+   * requirement, which is transitioned to on the primary command buffer right
+   * before every execution.
+   */
+  struct Capture
+  {
+    struct ImageRequirement
+    {
+      vk::Image image;
+      TextureState state;
+      vk::ImageAspectFlags aspectFlags;
+      ForceSetState force;
+      uint32_t beginLayer;
+      uint32_t endLayer;
+    };
+    struct BufferRequirement
+    {
+      vk::Buffer buffer;
+      BufferState state;
+      ForceSetState force;
+    };
+
+    std::vector<ImageRequirement> imageRequirements;
+    std::vector<BufferRequirement> bufferRequirements;
+    // Buffers that were only read since their requirement was recorded,
+    // further reads are merged into the requirement instead of the state.
+    std::unordered_map<HandleType, std::size_t> buffersAtRequirement;
+    std::unique_ptr<ResourceStates> states;
+    // Descriptor sets allocated for the command buffer must outlive a frame
+    RecordingDescriptorPool* descriptorPool = nullptr;
+  };
+
   void setExternalTextureState(
     vk::Image image,
     vk::PipelineStageFlags2 pipeline_stage_flag,
@@ -40,17 +116,36 @@ public:
     vk::AccessFlags2 access_flags,
     vk::ImageLayout layout,
     vk::ImageAspectFlags aspect_flags,
+    ForceSetState force = ForceSetState::eFalse,
+    uint32_t base_layer = 0,
+    uint32_t layer_count = vk::RemainingArrayLayers);
+
+  // Consecutive read-only uses of a buffer are merged without emitting barriers,
+  // as reads never need to wait for each other.
+  void setBufferState(
+    vk::CommandBuffer com_buffer,
+    vk::Buffer buffer,
+    vk::PipelineStageFlags2 pipeline_stage_flag,
+    vk::AccessFlags2 access_flags,
     ForceSetState force = ForceSetState::eFalse);
 
+  // With local_read, the target is put into the local read layout, so that
+  // fragment shaders can read it as an input attachment while rendering into it.
   void setColorTarget(
     vk::CommandBuffer com_buffer,
     vk::Image image,
-    BarrierBehavoir behavoir = BarrierBehavoir::eDefault);
+    BarrierBehavoir behavoir = BarrierBehavoir::eDefault,
+    uint32_t base_layer = 0,
+    uint32_t layer_count = vk::RemainingArrayLayers,
+    bool local_read = false);
   void setDepthStencilTarget(
     vk::CommandBuffer com_buffer,
     vk::Image image,
     vk::ImageAspectFlags aspect_flags,
-    BarrierBehavoir behavoir = BarrierBehavoir::eDefault);
+    BarrierBehavoir behavoir = BarrierBehavoir::eDefault,
+    uint32_t base_layer = 0,
+    uint32_t layer_count = vk::RemainingArrayLayers,
+    bool local_read = false);
   void setResolveTarget(
     vk::CommandBuffer com_buffer,
     vk::Image image,
@@ -58,6 +153,41 @@ public:
     BarrierBehavoir behavoir = BarrierBehavoir::eDefault);
 
   void flushBarriers(vk::CommandBuffer com_buf);
+
+  // Rendering scopes can't be nested, but different command buffers
+  // may be inside of their own scopes at the same time.
+  void beginRenderScope(vk::CommandBuffer com_buf);
+  void endRenderScope(vk::CommandBuffer com_buf);
+
+  // True if all of the given layers are tracked as being in the undefined layout,
+  // i.e. the next barrier for them will discard whatever they contain.
+  // Images that were never seen by the tracker are undefined as well.
+  bool hasUndefinedContents(
+    vk::Image image,
+    uint32_t base_layer = 0,
+    uint32_t layer_count = vk::RemainingArrayLayers) const;
+
+  // Drops the state of a destroyed resource, as its handle may be reused by a new
+  // image or buffer, which must not inherit the state of the old one.
+  void forget(vk::Image image);
+  void forget(vk::Buffer buffer);
+
+  // While capturing, all uses of resources on com_buf are tracked by the capture.
+  void beginCapture(vk::CommandBuffer com_buf, Capture& capture);
+  void endCapture(vk::CommandBuffer com_buf);
+  // Returns nullptr if com_buf is not being captured
+  Capture* findCapture(vk::CommandBuffer com_buf);
+
+  // Transitions the resources into the states the captured commands expect, flushing
+  // the barriers into com_buf, then takes over the states they leave resources in.
+  void replayCapture(vk::CommandBuffer com_buf, const Capture& capture);
+
+private:
+  // Every public method locks it, recursively as they call each other
+  mutable std::recursive_mutex mutex;
+  // Set by the tracker of a capture to record requirements into
+  Capture* capturing = nullptr;
+  std::unordered_map<vk::CommandBuffer, Capture*> captures;
 };
 
 } // namespace etna
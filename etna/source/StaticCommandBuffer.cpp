@@ -0,0 +1,132 @@
+#include <etna/StaticCommandBuffer.hpp>
+
+#include <algorithm>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/DescriptorSet.hpp>
+
+#include "StateTracking.hpp"
+
+
+namespace etna
+{
+
+struct StaticCommandBuffer::Recording
+{
+  vk::UniqueCommandPool pool;
+  vk::UniqueCommandBuffer commandBuffer;
+  // Never reset, so the sets stay valid until the recording is destroyed
+  std::unique_ptr<RecordingDescriptorPool> descriptors;
+  ResourceStates::Capture capture;
+  std::uint64_t lastExecutedBatch = 0;
+};
+
+StaticCommandBuffer::StaticCommandBuffer(const Dependencies& deps)
+  : workCount{deps.workCount}
+  , retireList{deps.retireList}
+  , device{deps.device}
+  , queueFamily{deps.queueFamily}
+  , inlineUniformBlocks{deps.inlineUniformBlocks}
+{
+}
+
+StaticCommandBuffer::~StaticCommandBuffer()
+{
+  retireCurrent();
+}
+
+void StaticCommandBuffer::retireCurrent()
+{
+  if (current != nullptr)
+    retireList.retire(std::move(current));
+}
+
+StaticRecordingRetireList::StaticRecordingRetireList(const GpuWorkCount& work_count)
+  : workCount{work_count}
+{
+}
+
+// Out of line, as recordings are only complete here
+StaticRecordingRetireList::~StaticRecordingRetireList() = default;
+
+void StaticRecordingRetireList::retire(std::unique_ptr<StaticCommandBuffer::Recording> recording)
+{
+  std::lock_guard lock{mutex};
+  retired.push_back(std::move(recording));
+  collectLocked();
+}
+
+void StaticRecordingRetireList::collect()
+{
+  std::lock_guard lock{mutex};
+  collectLocked();
+}
+
+void StaticRecordingRetireList::collectLocked()
+{
+  // PerFrameCmdMgr::acquireNext has waited for the frames that executed them
+  std::erase_if(retired, [this](const std::unique_ptr<StaticCommandBuffer::Recording>& old) {
+    return old->lastExecutedBatch + workCount.multiBufferingCount() <= workCount.batchIndex();
+  });
+}
+
+void StaticCommandBuffer::invalidate()
+{
+  ETNA_VERIFYF(!recording, "Can't invalidate a StaticCommandBuffer while recording it!");
+  retireCurrent();
+}
+
+vk::CommandBuffer StaticCommandBuffer::beginRecording()
+{
+  ETNA_VERIFYF(!recording, "StaticCommandBuffer is already being recorded!");
+  retireCurrent();
+
+  auto recordingData = std::make_unique<Recording>();
+  recordingData->pool =
+    unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+      .queueFamilyIndex = queueFamily,
+    }));
+  auto buffers = unwrap_vk_result(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+    .commandPool = recordingData->pool.get(),
+    .level = vk::CommandBufferLevel::eSecondary,
+    .commandBufferCount = 1,
+  }));
+  recordingData->commandBuffer = std::move(buffers[0]);
+  recordingData->descriptors =
+    std::make_unique<RecordingDescriptorPool>(device, workCount, inlineUniformBlocks);
+  recordingData->capture.descriptorPool = recordingData->descriptors.get();
+  current = std::move(recordingData);
+
+  // Frames in flight execute the same buffer, hence the simultaneous use
+  vk::CommandBufferInheritanceInfo inheritance{};
+  vk::CommandBuffer cmdBuf = current->commandBuffer.get();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse,
+    .pInheritanceInfo = &inheritance,
+  }));
+
+  get_context().getResourceTracker().beginCapture(cmdBuf, current->capture);
+  recording = true;
+  return cmdBuf;
+}
+
+void StaticCommandBuffer::endRecording()
+{
+  ETNA_VERIFYF(recording, "StaticCommandBuffer::endRecording without beginRecording!");
+  vk::CommandBuffer cmdBuf = current->commandBuffer.get();
+  get_context().getResourceTracker().endCapture(cmdBuf);
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  recording = false;
+}
+
+void StaticCommandBuffer::execute(vk::CommandBuffer cmd_buf)
+{
+  ETNA_VERIFYF(
+    current != nullptr && !recording, "Executing a StaticCommandBuffer that wasn't recorded!");
+
+  get_context().getResourceTracker().replayCapture(cmd_buf, current->capture);
+  cmd_buf.executeCommands(current->commandBuffer.get());
+  current->lastExecutedBatch = workCount.batchIndex();
+}
+
+} // namespace etna
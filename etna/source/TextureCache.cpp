@@ -0,0 +1,363 @@
+#include <etna/TextureCache.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <utility>
+
+#include <fmt/format.h>
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include <etna/ImageTransfers.hpp>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace etna
+{
+
+static constexpr std::uint32_t CACHE_MAGIC = 0x58455445; // "ETEX"
+// Bump whenever the layout of the files changes
+static constexpr std::uint32_t CACHE_VERSION = 2;
+// Limits of cached textures, which keep the layouts of corrupted files small.
+// They are above what devices support, and keep payload sizes far from overflowing.
+static constexpr std::uint32_t MAX_CACHED_EXTENT = 1u << 16;
+static constexpr std::uint32_t MAX_CACHED_DEPTH = 1u << 12;
+static constexpr std::uint32_t MAX_CACHED_LAYERS = 1u << 12;
+static constexpr std::uint32_t MAX_CACHED_MIPS = 32;
+
+struct CacheFileHeader
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t sourceHash;
+  std::uint64_t paramsHash;
+  std::uint32_t format;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t depth;
+  std::uint32_t mipLevels;
+  std::uint32_t layers;
+  std::uint64_t payloadSize;
+  std::uint64_t reserved;
+};
+static_assert(std::has_unique_object_representations_v<CacheFileHeader>);
+
+// The payload starts right after the header, which keeps it aligned in the mapping
+static_assert(sizeof(CacheFileHeader) % 16 == 0);
+
+static std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool is_cacheable(const TextureDesc& desc)
+{
+  return vk::blockSize(desc.format) > 0 && desc.extent.width > 0 && desc.extent.height > 0 &&
+    desc.extent.depth > 0 && desc.extent.width <= MAX_CACHED_EXTENT &&
+    desc.extent.height <= MAX_CACHED_EXTENT && desc.extent.depth <= MAX_CACHED_DEPTH &&
+    desc.mipLevels > 0 && desc.mipLevels <= MAX_CACHED_MIPS && desc.layers > 0 &&
+    desc.layers <= MAX_CACHED_LAYERS;
+}
+
+// Size of the subresources without the padding between them
+static std::uint64_t get_min_payload_size(const TextureDesc& desc)
+{
+  const auto blockExtent = vk::blockExtent(desc.format);
+  std::uint64_t result = 0;
+  for (std::uint32_t mip = 0; mip < desc.mipLevels; ++mip)
+  {
+    const std::uint64_t blocksX =
+      (std::max(desc.extent.width >> mip, 1u) + blockExtent[0] - 1) / blockExtent[0];
+    const std::uint64_t blocksY =
+      (std::max(desc.extent.height >> mip, 1u) + blockExtent[1] - 1) / blockExtent[1];
+    const std::uint64_t blocksZ =
+      (std::max(desc.extent.depth >> mip, 1u) + blockExtent[2] - 1) / blockExtent[2];
+    result += blocksX * blocksY * blocksZ * vk::blockSize(desc.format) * desc.layers;
+  }
+  return result;
+}
+
+static void unmap_file(void* mapping, std::size_t size)
+{
+  if (mapping == nullptr)
+    return;
+#if defined(_WIN32) || defined(_WIN64)
+  (void)size;
+  UnmapViewOfFile(mapping);
+#else
+  munmap(mapping, size);
+#endif
+}
+
+// Maps the whole file for reading, returns nullptr on failure
+static void* map_file(const std::filesystem::path& path, std::size_t& size)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE file = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return nullptr;
+
+  LARGE_INTEGER fileSize;
+  void* result = nullptr;
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+  {
+    // The view keeps the mapping alive, so both handles can be closed right away
+    HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (fileMapping != nullptr)
+    {
+      result = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+      size = static_cast<std::size_t>(fileSize.QuadPart);
+      CloseHandle(fileMapping);
+    }
+  }
+  CloseHandle(file);
+  return result;
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat info;
+  void* result = nullptr;
+  if (fstat(fd, &info) == 0 && info.st_size > 0)
+  {
+    size = static_cast<std::size_t>(info.st_size);
+    result = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (result == MAP_FAILED)
+      result = nullptr;
+    else
+      // The payload is read front to back exactly once
+      madvise(result, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  return result;
+#endif
+}
+
+MappedTexture::MappedTexture(void* mapping_, std::size_t mapping_size)
+  : mapping{mapping_}
+  , mappingSize{mapping_size}
+{
+}
+
+MappedTexture::MappedTexture(MappedTexture&& other) noexcept
+  : mapping{std::exchange(other.mapping, nullptr)}
+  , mappingSize{std::exchange(other.mappingSize, 0)}
+  , desc{other.desc}
+  , subresources{std::move(other.subresources)}
+  , payload{std::exchange(other.payload, {})}
+{
+}
+
+MappedTexture& MappedTexture::operator=(MappedTexture&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+  unmap_file(mapping, mappingSize);
+  mapping = std::exchange(other.mapping, nullptr);
+  mappingSize = std::exchange(other.mappingSize, 0);
+  desc = other.desc;
+  subresources = std::move(other.subresources);
+  payload = std::exchange(other.payload, {});
+  return *this;
+}
+
+MappedTexture::~MappedTexture()
+{
+  unmap_file(mapping, mappingSize);
+}
+
+TextureCache::TextureCache(CreateInfo info)
+  : directory{std::move(info.directory)}
+{
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  ETNA_VERIFYF(
+    !error,
+    "Unable to create the texture cache directory {}: {}",
+    directory.string(),
+    error.message());
+}
+
+// FNV-1a, fast enough for hashing source files once per start
+std::uint64_t TextureCache::hashBytes(std::span<const std::byte> bytes)
+{
+  std::uint64_t hash = 0xCBF29CE484222325ull;
+  for (std::byte byte : bytes)
+  {
+    hash ^= static_cast<std::uint64_t>(byte);
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+std::vector<MappedTexture::Subresource> TextureCache::layoutSubresources(const TextureDesc& desc)
+{
+  const auto blockExtent = vk::blockExtent(desc.format);
+  const std::uint64_t blockSize = vk::blockSize(desc.format);
+  ETNA_VERIFYF(blockSize > 0, "Can't cache textures of format {}!", vk::to_string(desc.format));
+  const std::uint64_t alignment = get_buffer_image_copy_alignment(desc.format);
+
+  std::vector<MappedTexture::Subresource> result;
+  result.reserve(desc.mipLevels * desc.layers);
+  std::uint64_t offset = 0;
+  for (std::uint32_t mip = 0; mip < desc.mipLevels; ++mip)
+  {
+    const vk::Extent3D extent{
+      .width = std::max(desc.extent.width >> mip, 1u),
+      .height = std::max(desc.extent.height >> mip, 1u),
+      .depth = std::max(desc.extent.depth >> mip, 1u),
+    };
+    const std::uint64_t blocksX = (extent.width + blockExtent[0] - 1) / blockExtent[0];
+    const std::uint64_t blocksY = (extent.height + blockExtent[1] - 1) / blockExtent[1];
+    const std::uint64_t blocksZ = (extent.depth + blockExtent[2] - 1) / blockExtent[2];
+    const std::uint64_t size = blocksX * blocksY * blocksZ * blockSize;
+
+    for (std::uint32_t layer = 0; layer < desc.layers; ++layer)
+    {
+      result.push_back(MappedTexture::Subresource{
+        .mipLevel = mip,
+        .layer = layer,
+        .extent = extent,
+        .offset = offset,
+        .size = size,
+      });
+      offset = align_up(offset + size, alignment);
+    }
+  }
+  return result;
+}
+
+std::filesystem::path TextureCache::getPath(const Key& key) const
+{
+  return directory / fmt::format("{:016x}{:016x}.etex", key.sourceHash, key.paramsHash);
+}
+
+std::optional<MappedTexture> TextureCache::load(const Key& key) const
+{
+  std::size_t size = 0;
+  void* mapping = map_file(getPath(key), size);
+  if (mapping == nullptr)
+    return std::nullopt;
+  MappedTexture result{mapping, size};
+
+  CacheFileHeader header;
+  if (size < sizeof(header))
+    return std::nullopt;
+  std::memcpy(&header, mapping, sizeof(header));
+  if (
+    header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+    header.sourceHash != key.sourceHash || header.paramsHash != key.paramsHash ||
+    header.payloadSize > size - sizeof(header))
+    return std::nullopt;
+
+  result.desc = TextureDesc{
+    .format = static_cast<vk::Format>(header.format),
+    .extent = {header.width, header.height, header.depth},
+    .mipLevels = header.mipLevels,
+    .layers = header.layers,
+  };
+  // Checked before the layout, whose size a corrupted header could blow up
+  if (!is_cacheable(result.desc) || get_min_payload_size(result.desc) > header.payloadSize)
+    return std::nullopt;
+  result.subresources = layoutSubresources(result.desc);
+  const auto& last = result.subresources.back();
+  if (last.offset + last.size > header.payloadSize)
+    return std::nullopt;
+
+  const auto* bytes = static_cast<const std::byte*>(mapping);
+  result.payload = std::span{bytes + sizeof(header), header.payloadSize};
+  return result;
+}
+
+void TextureCache::store(
+  const Key& key,
+  const TextureDesc& desc,
+  std::span<const std::span<const std::byte>> subresources) const
+{
+  ETNA_VERIFYF(
+    is_cacheable(desc),
+    "Texture of format {} with extent {}x{}x{}, {} mips and {} layers can't be cached!",
+    vk::to_string(desc.format),
+    desc.extent.width,
+    desc.extent.height,
+    desc.extent.depth,
+    desc.mipLevels,
+    desc.layers);
+  const auto layout = layoutSubresources(desc);
+  ETNA_VERIFYF(
+    layout.size() == subresources.size(),
+    "Expected {} subresources for the cached texture, but got {}!",
+    layout.size(),
+    subresources.size());
+
+  const CacheFileHeader header{
+    .magic = CACHE_MAGIC,
+    .version = CACHE_VERSION,
+    .sourceHash = key.sourceHash,
+    .paramsHash = key.paramsHash,
+    .format = static_cast<std::uint32_t>(desc.format),
+    .width = desc.extent.width,
+    .height = desc.extent.height,
+    .depth = desc.extent.depth,
+    .mipLevels = desc.mipLevels,
+    .layers = desc.layers,
+    .payloadSize = layout.back().offset + layout.back().size,
+    .reserved = 0,
+  };
+
+  // Written under a unique name and renamed, as renames replace files atomically
+  const auto path = getPath(key);
+  auto tempPath = path;
+  tempPath += fmt::format(".{:08x}.tmp", std::random_device{}());
+  {
+    std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+    ETNA_VERIFYF(file, "Unable to write the texture cache file {}!", tempPath.string());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const std::vector<char> padding(get_buffer_image_copy_alignment(desc.format));
+    std::uint64_t written = 0;
+    for (std::size_t i = 0; i < layout.size(); ++i)
+    {
+      ETNA_VERIFYF(
+        subresources[i].size() == layout[i].size,
+        "Subresource {} of the cached texture should be {} bytes, but is {}!",
+        i,
+        layout[i].size,
+        subresources[i].size());
+      file.write(padding.data(), static_cast<std::streamsize>(layout[i].offset - written));
+      file.write(
+        reinterpret_cast<const char*>(subresources[i].data()),
+        static_cast<std::streamsize>(subresources[i].size()));
+      written = layout[i].offset + layout[i].size;
+    }
+    ETNA_VERIFYF(file, "Unable to write the texture cache file {}!", tempPath.string());
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if (error)
+  {
+    // Some other instance of the application may have stored the same entry first
+    spdlog::warn("Unable to store {} in the texture cache: {}", path.string(), error.message());
+    std::filesystem::remove(tempPath, error);
+  }
+}
+
+} // namespace etna
@@ -0,0 +1,406 @@
+#include <etna/TextureStreamer.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/Profiling.hpp>
+#include <etna/TextureCache.hpp>
+#include <etna/ImageTransfers.hpp>
+
+
+namespace etna
+{
+
+static vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Compressed formats are copied by whole rows of blocks
+struct MipGeometry
+{
+  vk::Extent3D extent;
+  std::uint32_t blockHeight;
+  std::uint32_t blockRows;
+  vk::DeviceSize rowSize;
+};
+
+static MipGeometry get_mip_geometry(const Image& image, std::uint32_t mip)
+{
+  const auto blockExtent = vk::blockExtent(image.getFormat());
+  const vk::Extent3D extent{
+    .width = std::max(image.getExtent().width >> mip, 1u),
+    .height = std::max(image.getExtent().height >> mip, 1u),
+    .depth = 1,
+  };
+  return MipGeometry{
+    .extent = extent,
+    .blockHeight = blockExtent[1],
+    .blockRows = (extent.height + blockExtent[1] - 1) / blockExtent[1],
+    .rowSize = vk::DeviceSize{(extent.width + blockExtent[0] - 1) / blockExtent[0]} *
+      vk::blockSize(image.getFormat()),
+  };
+}
+
+static std::span<const std::byte> get_subresource_data(
+  const TextureStreamer::SubresourceSource& source,
+  const MipGeometry& geometry,
+  std::uint32_t mip,
+  std::uint32_t layer)
+{
+  const auto data = source(mip, layer);
+  ETNA_VERIFYF(
+    data.size() == geometry.rowSize * geometry.blockRows,
+    "Mip {} layer {} of a streamed texture should be {} bytes, but is {}!",
+    mip,
+    layer,
+    geometry.rowSize * geometry.blockRows,
+    data.size());
+  return data;
+}
+
+TextureStreamer::TextureStreamer(CreateInfo info)
+  : bytesPerFrame{info.bytesPerFrame}
+  , staging{get_context().getMainWorkCount(), [&info](std::size_t) {
+              auto buffer = get_context().createBuffer(Buffer::CreateInfo{
+                .size = info.bytesPerFrame,
+                .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+                .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+                .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                  VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                .name = "TextureStreamer::staging",
+              });
+              buffer.map();
+              return buffer;
+            }}
+{
+}
+
+TextureStreamer::TextureId TextureStreamer::add(OneShotCmdMgr& cmd_mgr, TextureInfo info)
+{
+  ZoneScoped;
+
+  auto& imageInfo = info.image;
+  ETNA_VERIFYF(
+    imageInfo.type == vk::ImageType::e2D && imageInfo.extent.depth == 1,
+    "Only 2D textures can be streamed, but {} is not one!",
+    imageInfo.name);
+  ETNA_VERIFYF(
+    info.initialMips > 0 && info.initialMips <= imageInfo.mipLevels,
+    "Texture {} has {} mips, so {} of them can't be uploaded initially!",
+    imageInfo.name,
+    imageInfo.mipLevels,
+    info.initialMips);
+  ETNA_VERIFYF(
+    vk::blockSize(imageInfo.format) > 0,
+    "Can't stream textures of format {}!",
+    vk::to_string(imageInfo.format));
+
+  Texture texture{
+    .image = {},
+    .name = std::string{imageInfo.name},
+    .source = std::move(info.source),
+    .firstResidentMip = static_cast<std::uint32_t>(imageInfo.mipLevels) - info.initialMips,
+  };
+  imageInfo.name = texture.name;
+  imageInfo.imageUsage |= vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+  texture.image = get_context().createImage(imageInfo);
+
+  const auto largestRow = get_mip_geometry(texture.image, 0).rowSize;
+  ETNA_VERIFYF(
+    largestRow <= bytesPerFrame,
+    "A single row of texture {} is {} bytes, which doesn't fit into {} bytes per frame!",
+    texture.name,
+    largestRow,
+    bytesPerFrame);
+
+  // The initial mips are small, so a temporary staging buffer is fine for them
+  const auto aspectMask = texture.image.getAspectMaskByFormat();
+  const auto layers = texture.image.getLayerCount();
+  const auto copyAlignment = get_buffer_image_copy_alignment(imageInfo.format);
+  std::vector<vk::BufferImageCopy2> copies;
+  vk::DeviceSize stagingSize = 0;
+  for (auto mip = texture.firstResidentMip; mip < texture.image.getMipLevelCount(); ++mip)
+  {
+    const auto geometry = get_mip_geometry(texture.image, mip);
+    for (std::uint32_t layer = 0; layer < layers; ++layer)
+    {
+      stagingSize = align_up(stagingSize, copyAlignment);
+      copies.push_back(vk::BufferImageCopy2{
+        .bufferOffset = stagingSize,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+          vk::ImageSubresourceLayers{
+            .aspectMask = aspectMask,
+            .mipLevel = mip,
+            .baseArrayLayer = layer,
+            .layerCount = 1,
+          },
+        .imageOffset = vk::Offset3D{0, 0, 0},
+        .imageExtent = geometry.extent,
+      });
+      stagingSize += geometry.rowSize * geometry.blockRows;
+    }
+  }
+
+  Buffer initialStaging = get_context().createBuffer(Buffer::CreateInfo{
+    .size = stagingSize,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+    .allocationCreate =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "TextureStreamer::initialStaging",
+  });
+  initialStaging.map();
+  for (const auto& copy : copies)
+  {
+    const auto mip = copy.imageSubresource.mipLevel;
+    const auto data = get_subresource_data(
+      texture.source,
+      get_mip_geometry(texture.image, mip),
+      mip,
+      copy.imageSubresource.baseArrayLayer);
+    std::memcpy(initialStaging.data() + copy.bufferOffset, data.data(), data.size());
+  }
+
+  auto cmdBuf = cmd_mgr.start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  {
+    etna::set_state(
+      cmdBuf,
+      texture.image.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      aspectMask);
+    etna::flush_barriers(cmdBuf);
+
+    cmdBuf.copyBufferToImage2(vk::CopyBufferToImageInfo2{
+      .srcBuffer = initialStaging.get(),
+      .dstImage = texture.image.get(),
+      .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+      .regionCount = static_cast<std::uint32_t>(copies.size()),
+      .pRegions = copies.data(),
+    });
+
+    etna::set_state(
+      cmdBuf, texture.image.get(), {}, {}, vk::ImageLayout::eShaderReadOnlyOptimal, aspectMask);
+    etna::flush_barriers(cmdBuf);
+  }
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmd_mgr.submitAndWait(cmdBuf);
+
+  if (texture.firstResidentMip == 0)
+    texture.source = nullptr;
+
+  textures.emplace_back(std::move(texture));
+  return static_cast<TextureId>(textures.size() - 1);
+}
+
+TextureStreamer::TextureId TextureStreamer::add(
+  OneShotCmdMgr& cmd_mgr,
+  MappedTexture texture,
+  std::string_view name,
+  std::uint32_t initial_mips)
+{
+  const auto& desc = texture.getDesc();
+  Image::CreateInfo imageInfo{
+    .extent = desc.extent,
+    .name = name,
+    .format = desc.format,
+    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+    .layers = desc.layers,
+    .mipLevels = desc.mipLevels,
+  };
+
+  // std::function needs a copyable callable, while the mapping is move-only
+  auto mapped = std::make_shared<MappedTexture>(std::move(texture));
+  auto source = [mapped](std::uint32_t mip, std::uint32_t layer) {
+    const auto& subresource = mapped->getSubresources()[mip * mapped->getDesc().layers + layer];
+    return mapped->getData(subresource);
+  };
+
+  return add(
+    cmd_mgr,
+    TextureInfo{
+      .image = imageInfo,
+      .source = std::move(source),
+      .initialMips = initial_mips,
+    });
+}
+
+void TextureStreamer::remove(TextureId id)
+{
+  auto& texture = textures.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(texture.has_value(), "Removing a texture that was removed already!");
+  retired.push_back(Retired{
+    .image = std::move(texture->image),
+    .retireBatch = get_context().getMainWorkCount().batchIndex(),
+  });
+  texture.reset();
+}
+
+TextureStreamer::Texture& TextureStreamer::getTexture(TextureId id)
+{
+  auto& texture = textures.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(texture.has_value(), "Using a removed texture!");
+  return *texture;
+}
+
+const TextureStreamer::Texture& TextureStreamer::getTexture(TextureId id) const
+{
+  const auto& texture = textures.at(static_cast<std::uint32_t>(id));
+  ETNA_VERIFYF(texture.has_value(), "Using a removed texture!");
+  return *texture;
+}
+
+const Image& TextureStreamer::getImage(TextureId id) const
+{
+  return getTexture(id).image;
+}
+
+std::uint32_t TextureStreamer::getFirstResidentMip(TextureId id) const
+{
+  return getTexture(id).firstResidentMip;
+}
+
+ImageBinding TextureStreamer::genBinding(TextureId id, vk::Sampler sampler) const
+{
+  const auto& texture = getTexture(id);
+  Image::ViewParams params{};
+  if (get_context().getOptionalFeatures().imageViewMinLod)
+    params.minLod = static_cast<float>(texture.firstResidentMip);
+  else
+    params.baseMip = texture.firstResidentMip;
+  return texture.image.genBinding(sampler, vk::ImageLayout::eShaderReadOnlyOptimal, params);
+}
+
+void TextureStreamer::update(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, TextureStreamer::update);
+
+  const auto& workCount = get_context().getMainWorkCount();
+  std::erase_if(retired, [&workCount](const Retired& old) {
+    return old.retireBatch + workCount.multiBufferingCount() <= workCount.batchIndex();
+  });
+
+  struct Upload
+  {
+    const Image* image;
+    std::vector<vk::BufferImageCopy2> copies;
+  };
+  std::vector<Upload> uploads;
+
+  // Textures are streamed in the order they were added, a few rows at a time
+  auto& stagingBuffer = staging.get();
+  vk::DeviceSize used = 0;
+  for (auto& slot : textures)
+  {
+    if (!slot.has_value() || slot->firstResidentMip == 0)
+      continue;
+    auto& texture = *slot;
+
+    Upload upload{.image = &texture.image, .copies = {}};
+    const auto copyAlignment = get_buffer_image_copy_alignment(texture.image.getFormat());
+    while (texture.firstResidentMip > 0)
+    {
+      // Textures of different formats share the staging buffer
+      used = align_up(used, copyAlignment);
+      const std::uint32_t mip = texture.firstResidentMip - 1;
+      const auto geometry = get_mip_geometry(texture.image, mip);
+      const auto rows = std::min<vk::DeviceSize>(
+        geometry.blockRows - texture.nextBlockRow,
+        (bytesPerFrame - std::min(bytesPerFrame, used)) / geometry.rowSize);
+      if (rows == 0)
+        break;
+
+      const auto data = get_subresource_data(texture.source, geometry, mip, texture.nextLayer);
+      std::memcpy(
+        stagingBuffer.data() + used,
+        data.data() + texture.nextBlockRow * geometry.rowSize,
+        rows * geometry.rowSize);
+
+      const std::uint32_t firstTexelRow = texture.nextBlockRow * geometry.blockHeight;
+      const std::uint32_t texelRows = std::min(
+        static_cast<std::uint32_t>(rows) * geometry.blockHeight,
+        geometry.extent.height - firstTexelRow);
+      upload.copies.push_back(vk::BufferImageCopy2{
+        .bufferOffset = used,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+          vk::ImageSubresourceLayers{
+            .aspectMask = texture.image.getAspectMaskByFormat(),
+            .mipLevel = mip,
+            .baseArrayLayer = texture.nextLayer,
+            .layerCount = 1,
+          },
+        .imageOffset = vk::Offset3D{0, static_cast<std::int32_t>(firstTexelRow), 0},
+        .imageExtent = vk::Extent3D{geometry.extent.width, texelRows, 1},
+      });
+      used += rows * geometry.rowSize;
+
+      // The mip may only be sampled once all of its layers have arrived
+      texture.nextBlockRow += static_cast<std::uint32_t>(rows);
+      if (texture.nextBlockRow < geometry.blockRows)
+        continue;
+      texture.nextBlockRow = 0;
+      if (++texture.nextLayer < texture.image.getLayerCount())
+        continue;
+      texture.nextLayer = 0;
+      --texture.firstResidentMip;
+    }
+
+    // Releases the source data, e.g. unmaps cached files
+    if (texture.firstResidentMip == 0)
+      texture.source = nullptr;
+    if (!upload.copies.empty())
+      uploads.push_back(std::move(upload));
+    if (used >= bytesPerFrame)
+      break;
+  }
+
+  if (uploads.empty())
+    return;
+
+  // Copies are recorded before any rendering of the frame, so the mips that
+  // became resident can be sampled by this very frame already
+  for (const auto& upload : uploads)
+    etna::set_state(
+      cmd_buf,
+      upload.image->get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      upload.image->getAspectMaskByFormat());
+  etna::flush_barriers(cmd_buf);
+
+  for (const auto& upload : uploads)
+    cmd_buf.copyBufferToImage2(vk::CopyBufferToImageInfo2{
+      .srcBuffer = stagingBuffer.get(),
+      .dstImage = upload.image->get(),
+      .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+      .regionCount = static_cast<std::uint32_t>(upload.copies.size()),
+      .pRegions = upload.copies.data(),
+    });
+
+  // Transitioned straight to the shaders that sample it, as a barrier to no stages
+  // wouldn't be chained with the one emitted when the image is bound
+  for (const auto& upload : uploads)
+    etna::set_state(
+      cmd_buf,
+      upload.image->get(),
+      vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead,
+      vk::ImageLayout::eShaderReadOnlyOptimal,
+      upload.image->getAspectMaskByFormat());
+  etna::flush_barriers(cmd_buf);
+}
+
+} // namespace etna
@@ -0,0 +1,350 @@
+#include <etna/TiledExecutor.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <future>
+#include <limits>
+
+#include <tracy/Tracy.hpp>
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+
+
+namespace etna
+{
+
+static bool is_single_pixel_format(vk::Format format)
+{
+  const auto blockExtent = vk::blockExtent(format);
+  return vk::blockSize(format) > 0 && blockExtent[0] == 1 && blockExtent[1] == 1;
+}
+
+TiledExecutor::TiledExecutor(CreateInfo info_)
+  : device{get_context().getDevice()}
+  , info{info_}
+  , inputPixelSize{vk::blockSize(info.inputFormat)}
+  , outputPixelSize{vk::blockSize(info.outputFormat)}
+  , workCount{info.tilesInFlight}
+  , descriptorPool{device, workCount, get_context().getOptionalFeatures().inlineUniformBlock}
+{
+  ETNA_VERIFYF(
+    is_single_pixel_format(info.inputFormat) && is_single_pixel_format(info.outputFormat),
+    "Tiles can't be processed in {} and {} formats, they must be uncompressed!",
+    vk::to_string(info.inputFormat),
+    vk::to_string(info.outputFormat));
+  ETNA_VERIFYF(
+    info.tileExtent.width > 0 && info.tileExtent.height > 0, "Tiles can't be empty!");
+
+  auto& ctx = get_context();
+  const vk::Extent3D inputExtent{
+    .width = info.tileExtent.width + 2 * info.halo,
+    .height = info.tileExtent.height + 2 * info.halo,
+    .depth = 1,
+  };
+  const vk::Extent3D outputExtent{info.tileExtent.width, info.tileExtent.height, 1};
+
+  slots.reserve(info.tilesInFlight);
+  for (std::uint32_t i = 0; i < info.tilesInFlight; ++i)
+  {
+    auto& slot = slots.emplace_back();
+    slot.queue = ctx.getComputeQueue(i % ctx.getComputeQueueCount());
+    slot.pool = unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+      .flags = vk::CommandPoolCreateFlagBits::eTransient,
+      .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+    }));
+    slot.cmdBuf =
+      unwrap_vk_result(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+        .commandPool = slot.pool.get(),
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+      }))[0];
+    slot.fence = unwrap_vk_result(device.createFenceUnique(vk::FenceCreateInfo{}));
+
+    slot.upload = ctx.createBuffer(Buffer::CreateInfo{
+      .size = vk::DeviceSize{inputExtent.width} * inputExtent.height * inputPixelSize,
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+      .allocationCreate =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .name = "TiledExecutor::upload",
+    });
+    slot.upload.map();
+    slot.input = ctx.createImage(Image::CreateInfo{
+      .extent = inputExtent,
+      .name = "TiledExecutor::input",
+      .format = info.inputFormat,
+      .imageUsage = info.inputUsage | vk::ImageUsageFlagBits::eTransferDst,
+    });
+    slot.output = ctx.createImage(Image::CreateInfo{
+      .extent = outputExtent,
+      .name = "TiledExecutor::output",
+      .format = info.outputFormat,
+      .imageUsage = info.outputUsage | vk::ImageUsageFlagBits::eTransferSrc,
+    });
+    // Read by the CPU, so cached memory is preferred
+    slot.readback = ctx.createBuffer(Buffer::CreateInfo{
+      .size = vk::DeviceSize{outputExtent.width} * outputExtent.height * outputPixelSize,
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO,
+      .allocationCreate =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .name = "TiledExecutor::readback",
+    });
+    slot.readback.map();
+  }
+}
+
+DescriptorSet TiledExecutor::createDescriptorSet(
+  DescriptorLayoutId layout, vk::CommandBuffer cmd_buf, std::vector<Binding> bindings)
+{
+  auto set = descriptorPool.allocateSet(layout, std::move(bindings), cmd_buf);
+  write_set(set);
+  return set;
+}
+
+void TiledExecutor::run(
+  const InputImage& input, std::span<std::byte> output, const RecordTile& record)
+{
+  ZoneScoped;
+
+  const auto [width, height] = input.extent;
+  const std::size_t pixelCount = std::size_t{width} * height;
+  ETNA_VERIFYF(
+    input.pixels.size() == pixelCount * inputPixelSize,
+    "Expected {} bytes of input pixels, but got {}!",
+    pixelCount * inputPixelSize,
+    input.pixels.size());
+  ETNA_VERIFYF(
+    output.size() == pixelCount * outputPixelSize,
+    "Expected {} bytes of output pixels, but got {}!",
+    pixelCount * outputPixelSize,
+    output.size());
+
+  const std::uint32_t tilesX = (width + info.tileExtent.width - 1) / info.tileExtent.width;
+  const std::uint32_t tilesY = (height + info.tileExtent.height - 1) / info.tileExtent.height;
+  const std::uint32_t tileCount = tilesX * tilesY;
+
+  for (std::uint32_t index = 0; index < tileCount; ++index)
+  {
+    // The previous tile of the slot was submitted tilesInFlight tiles ago,
+    // so the waiting only stalls when the GPU is the slowest stage.
+    Slot& slot = slots[index % slots.size()];
+    if (slot.pending.has_value())
+      finishTile(slot, output, width);
+
+    const std::uint32_t x = index % tilesX * info.tileExtent.width;
+    const std::uint32_t y = index / tilesX * info.tileExtent.height;
+    const vk::Rect2D tile{
+      .offset = {static_cast<std::int32_t>(x), static_cast<std::int32_t>(y)},
+      .extent =
+        {std::min(info.tileExtent.width, width - x), std::min(info.tileExtent.height, height - y)},
+    };
+    submitTile(slot, input, tile, index, record);
+  }
+
+  // The last tiles are finished in the order they were submitted
+  for (std::size_t i = 0; i < slots.size(); ++i)
+  {
+    Slot& slot = slots[(tileCount + i) % slots.size()];
+    if (slot.pending.has_value())
+      finishTile(slot, output, width);
+  }
+  for (auto& slot : slots)
+    if (slot.readbackCopy.valid())
+      slot.readbackCopy.get();
+}
+
+void TiledExecutor::submitTile(
+  Slot& slot,
+  const InputImage& input,
+  const vk::Rect2D& tile,
+  std::uint32_t index,
+  const RecordTile& record)
+{
+  ZoneScoped;
+
+  const auto halo = static_cast<std::int32_t>(info.halo);
+  const vk::Offset2D inputOffset{
+    .x = std::max(tile.offset.x - halo, 0),
+    .y = std::max(tile.offset.y - halo, 0),
+  };
+  const vk::Offset2D inputEnd{
+    .x = std::min(
+      tile.offset.x + static_cast<std::int32_t>(tile.extent.width) + halo,
+      static_cast<std::int32_t>(input.extent.width)),
+    .y = std::min(
+      tile.offset.y + static_cast<std::int32_t>(tile.extent.height) + halo,
+      static_cast<std::int32_t>(input.extent.height)),
+  };
+  const vk::Extent2D inputExtent{
+    .width = static_cast<std::uint32_t>(inputEnd.x - inputOffset.x),
+    .height = static_cast<std::uint32_t>(inputEnd.y - inputOffset.y),
+  };
+
+  // The fence of the slot has signaled, so the upload buffer is free and
+  // is filled by a worker while the commands are being recorded
+  auto uploadCopy = std::async(
+    std::launch::async,
+    [dst = slot.upload.data(),
+     src = input.pixels.data(),
+     imageWidth = input.extent.width,
+     pixelSize = inputPixelSize,
+     inputOffset,
+     inputExtent]() {
+      ZoneScopedN("TiledExecutor::uploadCopy");
+      const std::size_t rowSize = inputExtent.width * pixelSize;
+      for (std::uint32_t row = 0; row < inputExtent.height; ++row)
+      {
+        const std::size_t srcPixel =
+          (static_cast<std::size_t>(inputOffset.y) + row) * imageWidth +
+          static_cast<std::size_t>(inputOffset.x);
+        std::memcpy(dst + row * rowSize, src + srcPixel * pixelSize, rowSize);
+      }
+    });
+
+  vk::CommandBuffer cmdBuf = slot.cmdBuf;
+  ETNA_CHECK_VK_RESULT(device.resetCommandPool(slot.pool.get()));
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+  {
+    etna::set_state(
+      cmdBuf,
+      slot.input.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      slot.input.getAspectMaskByFormat());
+    etna::flush_barriers(cmdBuf);
+
+    const vk::BufferImageCopy2 uploadRegion{
+      .bufferOffset = 0,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource =
+        vk::ImageSubresourceLayers{
+          .aspectMask = slot.input.getAspectMaskByFormat(),
+          .mipLevel = 0,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+      .imageOffset = vk::Offset3D{0, 0, 0},
+      .imageExtent = vk::Extent3D{inputExtent.width, inputExtent.height, 1},
+    };
+    cmdBuf.copyBufferToImage2(vk::CopyBufferToImageInfo2{
+      .srcBuffer = slot.upload.get(),
+      .dstImage = slot.input.get(),
+      .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+      .regionCount = 1,
+      .pRegions = &uploadRegion,
+    });
+
+    record(
+      cmdBuf,
+      Tile{
+        .index = index,
+        .offset = tile.offset,
+        .extent = tile.extent,
+        .inputOffset = inputOffset,
+        .inputExtent = inputExtent,
+        .input = slot.input,
+        .output = slot.output,
+      });
+
+    etna::set_state(
+      cmdBuf,
+      slot.output.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferSrcOptimal,
+      slot.output.getAspectMaskByFormat());
+    etna::set_state(
+      cmdBuf,
+      slot.readback.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite);
+    etna::flush_barriers(cmdBuf);
+
+    const vk::BufferImageCopy2 readbackRegion{
+      .bufferOffset = 0,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource =
+        vk::ImageSubresourceLayers{
+          .aspectMask = slot.output.getAspectMaskByFormat(),
+          .mipLevel = 0,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+      .imageOffset = vk::Offset3D{0, 0, 0},
+      .imageExtent = vk::Extent3D{tile.extent.width, tile.extent.height, 1},
+    };
+    cmdBuf.copyImageToBuffer2(vk::CopyImageToBufferInfo2{
+      .srcImage = slot.output.get(),
+      .srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+      .dstBuffer = slot.readback.get(),
+      .regionCount = 1,
+      .pRegions = &readbackRegion,
+    });
+
+    // The fence doesn't make the copy visible to the host by itself
+    etna::set_state(
+      cmdBuf,
+      slot.readback.get(),
+      vk::PipelineStageFlagBits2::eHost,
+      vk::AccessFlagBits2::eHostRead);
+    etna::flush_barriers(cmdBuf);
+  }
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+  // The GPU reads the upload and overwrites the readback of the previous tile
+  uploadCopy.get();
+  if (slot.readbackCopy.valid())
+    slot.readbackCopy.get();
+
+  std::array cbsInfo{vk::CommandBufferSubmitInfo{
+    .commandBuffer = cmdBuf,
+    .deviceMask = 1,
+  }};
+  vk::SubmitInfo2 sInfo{};
+  sInfo.setCommandBufferInfos(cbsInfo);
+  ETNA_CHECK_VK_RESULT(slot.queue.submit2({sInfo}, slot.fence.get()));
+
+  slot.pending = tile;
+  workCount.submit();
+}
+
+void TiledExecutor::finishTile(Slot& slot, std::span<std::byte> output, std::uint32_t image_width)
+{
+  ZoneScoped;
+
+  ETNA_CHECK_VK_RESULT(device.waitForFences(
+    {slot.fence.get()}, vk::True, std::numeric_limits<std::uint64_t>::max()));
+  device.resetFences({slot.fence.get()});
+  slot.readback.invalidate();
+
+  // Copied by a worker, while the next tile of the slot is being uploaded and recorded
+  slot.readbackCopy = std::async(
+    std::launch::async,
+    [dst = output.data(),
+     src = slot.readback.data(),
+     imageWidth = image_width,
+     pixelSize = outputPixelSize,
+     tile = *slot.pending]() {
+      ZoneScopedN("TiledExecutor::readbackCopy");
+      const std::size_t rowSize = tile.extent.width * pixelSize;
+      for (std::uint32_t row = 0; row < tile.extent.height; ++row)
+      {
+        const std::size_t dstPixel =
+          (static_cast<std::size_t>(tile.offset.y) + row) * imageWidth +
+          static_cast<std::size_t>(tile.offset.x);
+        std::memcpy(dst + dstPixel * pixelSize, src + row * rowSize, rowSize);
+      }
+    });
+  slot.pending.reset();
+}
+
+} // namespace etna
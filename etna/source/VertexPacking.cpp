@@ -0,0 +1,242 @@
+#include <etna/VertexPacking.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <etna/Assert.hpp>
+
+#include "HalfFloat.hpp"
+
+
+namespace etna
+{
+
+struct Bounds
+{
+  std::array<float, 3> min;
+  std::array<float, 3> max;
+};
+
+template <std::size_t N>
+static Bounds get_bounds(std::span<const std::array<float, N>> values)
+{
+  Bounds bounds;
+  bounds.min.fill(std::numeric_limits<float>::max());
+  bounds.max.fill(std::numeric_limits<float>::lowest());
+  for (const auto& value : values)
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      bounds.min[i] = std::min(bounds.min[i], value[i]);
+      bounds.max[i] = std::max(bounds.max[i], value[i]);
+    }
+  return bounds;
+}
+
+static std::int16_t float_to_snorm16(float value)
+{
+  return static_cast<std::int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static std::uint16_t float_to_unorm16(float value)
+{
+  return static_cast<std::uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+// Degenerate dimensions of the bounds are encoded as zeros
+static float inverse_or_zero(float value)
+{
+  return value > 0.0f ? 1.0f / value : 0.0f;
+}
+
+static float sign_not_zero(float value)
+{
+  return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Projects the normal onto an octahedron and unfolds its lower half onto the square
+static std::array<float, 2> octahedral_encode(const std::array<float, 3>& normal)
+{
+  const float l1 = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+  if (l1 == 0.0f)
+    return {0.0f, 0.0f};
+
+  const float x = normal[0] / l1;
+  const float y = normal[1] / l1;
+  if (normal[2] >= 0.0f)
+    return {x, y};
+  return {(1.0f - std::abs(y)) * sign_not_zero(x), (1.0f - std::abs(x)) * sign_not_zero(y)};
+}
+
+template <class T, std::size_t N>
+static void write_attribute(std::byte* dst, const std::array<T, N>& value)
+{
+  std::memcpy(dst, value.data(), sizeof(value));
+}
+
+static void pack_positions(
+  std::span<const std::array<float, 3>> positions, PositionEncoding encoding, PackedMesh& mesh)
+{
+  const auto [min, max] = get_bounds(positions);
+  std::array<float, 3> center;
+  std::array<float, 3> halfExtent;
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    center[i] = positions.empty() ? 0.0f : (min[i] + max[i]) * 0.5f;
+    halfExtent[i] = positions.empty() ? 0.0f : (max[i] - min[i]) * 0.5f;
+  }
+
+  vk::Format format = vk::Format::eR32G32B32Sfloat;
+  std::uint32_t stride = 3 * sizeof(float);
+  if (encoding != PositionEncoding::eFloat)
+  {
+    // 3 component 16 bit formats are rarely supported for vertex buffers
+    format = encoding == PositionEncoding::eHalf ? vk::Format::eR16G16B16A16Sfloat
+                                                 : vk::Format::eR16G16B16A16Snorm;
+    stride = 4 * sizeof(std::uint16_t);
+    mesh.positionDecode.offset = {center[0], center[1], center[2], 0.0f};
+  }
+  if (encoding == PositionEncoding::eSnorm16)
+    mesh.positionDecode.scale = {halfExtent[0], halfExtent[1], halfExtent[2], 1.0f};
+
+  mesh.positionFormat = VertexByteStreamFormatDescription{
+    .stride = stride,
+    .attributes = {{.format = format, .offset = 0}},
+  };
+  mesh.positionStream.resize(positions.size() * stride);
+
+  const std::array<float, 3> invHalfExtent{
+    inverse_or_zero(halfExtent[0]),
+    inverse_or_zero(halfExtent[1]),
+    inverse_or_zero(halfExtent[2]),
+  };
+  for (std::size_t v = 0; v < positions.size(); ++v)
+  {
+    const auto& p = positions[v];
+    std::byte* dst = mesh.positionStream.data() + v * stride;
+    switch (encoding)
+    {
+    case PositionEncoding::eFloat:
+      write_attribute(dst, p);
+      break;
+    case PositionEncoding::eHalf:
+      write_attribute(
+        dst,
+        std::array{
+          float_to_half(p[0] - center[0]),
+          float_to_half(p[1] - center[1]),
+          float_to_half(p[2] - center[2]),
+          float_to_half(1.0f),
+        });
+      break;
+    case PositionEncoding::eSnorm16:
+      write_attribute(
+        dst,
+        std::array{
+          float_to_snorm16((p[0] - center[0]) * invHalfExtent[0]),
+          float_to_snorm16((p[1] - center[1]) * invHalfExtent[1]),
+          float_to_snorm16((p[2] - center[2]) * invHalfExtent[2]),
+          std::int16_t{32767},
+        });
+      break;
+    }
+  }
+}
+
+static void pack_attributes(const MeshAttributes& attributes, PackedMesh& mesh)
+{
+  const bool hasNormals = !attributes.normals.empty();
+  const bool hasTexCoords = !attributes.texCoords.empty();
+  if (!hasNormals && !hasTexCoords)
+    return;
+
+  std::uint32_t stride = 0;
+  if (hasNormals)
+  {
+    mesh.attributeFormat.attributes.push_back({vk::Format::eR16G16Snorm, stride});
+    stride += 2 * sizeof(std::int16_t);
+  }
+  const std::uint32_t texCoordOffset = stride;
+  if (hasTexCoords)
+  {
+    mesh.attributeFormat.attributes.push_back({vk::Format::eR16G16Unorm, stride});
+    stride += 2 * sizeof(std::uint16_t);
+  }
+  mesh.attributeFormat.stride = stride;
+
+  std::array<float, 2> texCoordMin{};
+  std::array<float, 2> invTexCoordExtent{};
+  if (hasTexCoords)
+  {
+    const auto [min, max] = get_bounds(attributes.texCoords);
+    texCoordMin = {min[0], min[1]};
+    invTexCoordExtent = {inverse_or_zero(max[0] - min[0]), inverse_or_zero(max[1] - min[1])};
+    mesh.texCoordDecode = AttributeDecodeParams{
+      .scale = {max[0] - min[0], max[1] - min[1], 1.0f, 1.0f},
+      .offset = {min[0], min[1], 0.0f, 0.0f},
+    };
+  }
+
+  mesh.attributeStream.resize(std::size_t{mesh.vertexCount} * stride);
+  for (std::size_t v = 0; v < mesh.vertexCount; ++v)
+  {
+    std::byte* dst = mesh.attributeStream.data() + v * stride;
+    if (hasNormals)
+    {
+      const auto [x, y] = octahedral_encode(attributes.normals[v]);
+      write_attribute(dst, std::array{float_to_snorm16(x), float_to_snorm16(y)});
+    }
+    if (hasTexCoords)
+    {
+      const auto& uv = attributes.texCoords[v];
+      write_attribute(
+        dst + texCoordOffset,
+        std::array{
+          float_to_unorm16((uv[0] - texCoordMin[0]) * invTexCoordExtent[0]),
+          float_to_unorm16((uv[1] - texCoordMin[1]) * invTexCoordExtent[1]),
+        });
+    }
+  }
+}
+
+PackedMesh pack_mesh(const MeshAttributes& mesh, PositionEncoding position_encoding)
+{
+  const std::size_t vertexCount = mesh.positions.size();
+  ETNA_VERIFYF(
+    vertexCount <= std::numeric_limits<std::uint32_t>::max(),
+    "Mesh has too many vertices: {}!",
+    vertexCount);
+  ETNA_VERIFYF(
+    mesh.normals.empty() || mesh.normals.size() == vertexCount,
+    "Mesh has {} normals for {} vertices!",
+    mesh.normals.size(),
+    vertexCount);
+  ETNA_VERIFYF(
+    mesh.texCoords.empty() || mesh.texCoords.size() == vertexCount,
+    "Mesh has {} texture coordinates for {} vertices!",
+    mesh.texCoords.size(),
+    vertexCount);
+
+  PackedMesh result;
+  result.vertexCount = static_cast<std::uint32_t>(vertexCount);
+  pack_positions(mesh.positions, position_encoding, result);
+  pack_attributes(mesh, result);
+  return result;
+}
+
+VertexShaderInputDescription PackedMesh::getVertexInput(bool depth_only) const
+{
+  VertexShaderInputDescription result;
+  result.bindings.push_back(VertexShaderInputDescription::Binding{
+    .byteStreamDescription = positionFormat,
+  });
+  if (!depth_only && !attributeFormat.attributes.empty())
+    result.bindings.push_back(VertexShaderInputDescription::Binding{
+      .byteStreamDescription = attributeFormat,
+      .firstLocation = 1,
+    });
+  return result;
+}
+
+} // namespace etna
@@ -226,7 +226,7 @@ Window::SwapchainData Window::createSwapchain(const DesiredProperties& props) co
   {
     auto& el = newSwapchain.elements.emplace_back();
     el.image = imgs[i];
-    set_debug_name(el.image, fmt::format("Swapchain element #{}", i).c_str());
+    set_debug_name(device, el.image, fmt::format("Swapchain element #{}", i).c_str());
     vk::ImageViewCreateInfo info{
       .image = el.image,
       .viewType = vk::ImageViewType::e2D,
@@ -239,7 +239,7 @@ Window::SwapchainData Window::createSwapchain(const DesiredProperties& props) co
         .baseArrayLayer = 0,
         .layerCount = 1}};
     el.image_view = unwrap_vk_result(device.createImageViewUnique(info));
-    set_debug_name(el.image_view.get(), fmt::format("Swapchain element #{}", i).c_str());
+    set_debug_name(device, el.image_view.get(), fmt::format("Swapchain element #{}", i).c_str());
   }
 
   return newSwapchain;
@@ -0,0 +1,303 @@
+// Checks every GpuPrimitives operation against a CPU reference, for both the
+// subgroup and the shared memory versions of the shaders. Needs a Vulkan 1.3 device.
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/GpuPrimitives.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/BlockingTransferHelper.hpp>
+
+
+// Work groups process 256 elements and scan blocks 1024, so the sizes cover
+// single elements, powers of two, their neighbours, and enough elements for
+// the scan to need a second level of block sums.
+static constexpr std::array<std::uint32_t, 14> SIZES{
+  1, 2, 7, 255, 256, 257, 1000, 1023, 1024, 1025, 4099, 65536 + 17, 1 << 20, (1 << 20) + 4097};
+static constexpr std::uint32_t MAX_ELEMENTS = SIZES.back();
+
+static int gFailures = 0;
+
+struct Fixture
+{
+  etna::OneShotCmdMgr& cmdMgr;
+  etna::BlockingTransferHelper& transfer;
+  etna::GpuPrimitives& primitives;
+  std::mt19937& rng;
+};
+
+static void global_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stages,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stages,
+  vk::AccessFlags2 dst_access)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stages,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stages,
+    .dstAccessMask = dst_access,
+  };
+  cmd_buf.pipelineBarrier2(
+    vk::DependencyInfo{.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+}
+
+// BlockingTransferHelper doesn't track the states of buffers, so the recorded
+// commands are fenced off from the uploads before and the readbacks after them.
+// Every job is a frame of its own, so the descriptor pools get recycled.
+template <class F>
+static void run_blocking(Fixture& fixture, F&& record)
+{
+  etna::begin_frame();
+  auto cmdBuf = fixture.cmdMgr.start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  global_barrier(
+    cmdBuf,
+    vk::PipelineStageFlagBits2::eAllTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eAllTransfer,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite |
+      vk::AccessFlagBits2::eTransferWrite);
+  record(cmdBuf);
+  global_barrier(
+    cmdBuf,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eAllTransfer,
+    vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eAllTransfer,
+    vk::AccessFlagBits2::eTransferRead);
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  fixture.cmdMgr.submitAndWait(cmdBuf);
+  etna::end_frame();
+}
+
+static etna::Buffer create_buffer(std::uint32_t count, std::string_view name)
+{
+  return etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * std::max(count, 1u),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+      vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+    .name = name,
+  });
+}
+
+static etna::Buffer upload(
+  Fixture& fixture, std::span<const std::uint32_t> values, std::string_view name)
+{
+  auto buffer = create_buffer(static_cast<std::uint32_t>(values.size()), name);
+  fixture.transfer.uploadBuffer(fixture.cmdMgr, buffer, 0, values);
+  return buffer;
+}
+
+static std::vector<std::uint32_t> readback(
+  Fixture& fixture, const etna::Buffer& buffer, std::size_t count)
+{
+  std::vector<std::uint32_t> result(count);
+  fixture.transfer.readbackBuffer(fixture.cmdMgr, std::span{result}, buffer, 0);
+  return result;
+}
+
+static std::vector<std::uint32_t> random_values(
+  Fixture& fixture, std::uint32_t count, std::uint32_t max)
+{
+  std::uniform_int_distribution<std::uint32_t> distribution{0, max};
+  std::vector<std::uint32_t> result(count);
+  std::generate(result.begin(), result.end(), [&]() { return distribution(fixture.rng); });
+  return result;
+}
+
+static void expect_equal(
+  std::string_view what,
+  std::uint32_t count,
+  std::span<const std::uint32_t> actual,
+  std::span<const std::uint32_t> expected)
+{
+  auto [actualIt, expectedIt] =
+    std::mismatch(actual.begin(), actual.end(), expected.begin(), expected.end());
+  if (actualIt == actual.end() && expectedIt == expected.end())
+    return;
+
+  ++gFailures;
+  if (actualIt == actual.end() || expectedIt == expected.end())
+    spdlog::error(
+      "{} of {} elements: got {} elements, expected {}",
+      what,
+      count,
+      actual.size(),
+      expected.size());
+  else
+    spdlog::error(
+      "{} of {} elements: element {} is {}, expected {}",
+      what,
+      count,
+      actualIt - actual.begin(),
+      *actualIt,
+      *expectedIt);
+}
+
+static void test_scans(Fixture& fixture, std::uint32_t count)
+{
+  // Sums wrap around the same way on both sides, so the values may be anything
+  const auto values = random_values(fixture, count, 0xFFFFFFFFu);
+  auto src = upload(fixture, values, "scan_src");
+  auto dst = create_buffer(count, "scan_dst");
+
+  std::vector<std::uint32_t> expected(count);
+  std::exclusive_scan(values.begin(), values.end(), expected.begin(), std::uint32_t{0});
+  run_blocking(fixture, [&](vk::CommandBuffer cmd_buf) {
+    fixture.primitives.exclusiveScan(cmd_buf, src, dst, count);
+  });
+  expect_equal("exclusiveScan", count, readback(fixture, dst, count), expected);
+
+  std::inclusive_scan(values.begin(), values.end(), expected.begin());
+  run_blocking(fixture, [&](vk::CommandBuffer cmd_buf) {
+    fixture.primitives.inclusiveScan(cmd_buf, src, dst, count);
+  });
+  expect_equal("inclusiveScan", count, readback(fixture, dst, count), expected);
+
+  run_blocking(fixture, [&](vk::CommandBuffer cmd_buf) {
+    fixture.primitives.inclusiveScan(cmd_buf, src, src, count);
+  });
+  expect_equal("in-place inclusiveScan", count, readback(fixture, src, count), expected);
+}
+
+static void test_reductions(Fixture& fixture, std::uint32_t count)
+{
+  const auto values = random_values(fixture, count, 0xFFFFFFFFu);
+  auto src = upload(fixture, values, "reduce_src");
+  auto result = create_buffer(1, "reduce_result");
+
+  struct Case
+  {
+    etna::ReduceOp op;
+    std::string_view name;
+    std::uint32_t expected;
+  };
+  const std::array cases{
+    Case{
+      etna::ReduceOp::eAdd,
+      "reduce(eAdd)",
+      std::accumulate(values.begin(), values.end(), std::uint32_t{0}),
+    },
+    Case{etna::ReduceOp::eMin, "reduce(eMin)", *std::min_element(values.begin(), values.end())},
+    Case{etna::ReduceOp::eMax, "reduce(eMax)", *std::max_element(values.begin(), values.end())},
+  };
+  for (const auto& reduceCase : cases)
+  {
+    run_blocking(fixture, [&](vk::CommandBuffer cmd_buf) {
+      fixture.primitives.reduce(cmd_buf, src, result, count, reduceCase.op);
+    });
+    expect_equal(
+      reduceCase.name, count, readback(fixture, result, 1), std::span{&reduceCase.expected, 1});
+  }
+}
+
+static void test_compaction(Fixture& fixture, std::uint32_t count)
+{
+  const auto values = random_values(fixture, count, 0xFFFFFFFFu);
+  // Any non-zero flag keeps the value, not only ones
+  auto flags = random_values(fixture, count, 3);
+  for (auto& flag : flags)
+    flag = flag == 3 ? 0xFFFFFFFFu : flag;
+  auto valuesBuf = upload(fixture, values, "compact_values");
+  auto flagsBuf = upload(fixture, flags, "compact_flags");
+  auto dst = create_buffer(count, "compact_dst");
+  auto dstCount = create_buffer(1, "compact_count");
+
+  std::vector<std::uint32_t> expected;
+  for (std::uint32_t i = 0; i < count; ++i)
+    if (flags[i] != 0)
+      expected.push_back(values[i]);
+  const auto expectedCount = static_cast<std::uint32_t>(expected.size());
+
+  run_blocking(fixture, [&](vk::CommandBuffer cmd_buf) {
+    fixture.primitives.compact(cmd_buf, valuesBuf, flagsBuf, dst, dstCount, count);
+  });
+  expect_equal(
+    "compact count", count, readback(fixture, dstCount, 1), std::span{&expectedCount, 1});
+  expect_equal("compact", count, readback(fixture, dst, expected.size()), expected);
+}
+
+static void test_sort(Fixture& fixture, std::uint32_t count)
+{
+  // Few distinct keys in the low bits, so the stability is checked as well
+  auto keys = random_values(fixture, count, 0xFFFFFFFFu);
+  for (std::uint32_t i = 0; i < count; i += 2)
+    keys[i] &= 0xFF00000Fu;
+  std::vector<std::uint32_t> values(count);
+  std::iota(values.begin(), values.end(), 0u);
+  auto keysBuf = upload(fixture, keys, "sort_keys");
+  auto valuesBuf = upload(fixture, values, "sort_values");
+
+  std::stable_sort(values.begin(), values.end(), [&keys](std::uint32_t a, std::uint32_t b) {
+    return keys[a] < keys[b];
+  });
+  std::vector<std::uint32_t> expectedKeys(count);
+  std::transform(values.begin(), values.end(), expectedKeys.begin(), [&keys](std::uint32_t i) {
+    return keys[i];
+  });
+
+  run_blocking(fixture, [&](vk::CommandBuffer cmd_buf) {
+    fixture.primitives.sortPairs(cmd_buf, keysBuf, valuesBuf, count);
+  });
+  expect_equal("sortPairs keys", count, readback(fixture, keysBuf, count), expectedKeys);
+  expect_equal("sortPairs values", count, readback(fixture, valuesBuf, count), values);
+}
+
+int main()
+{
+  etna::initialize(etna::InitParams{
+    .applicationName = "etna_gpu_primitives_test",
+    .applicationVersion = vk::makeApiVersion(0, 0, 1, 0),
+    .profile = etna::ContextProfile::eComputeOnly,
+  });
+
+  {
+    auto cmdMgr = etna::get_context().createOneShotCmdMgr();
+    etna::BlockingTransferHelper transfer{{.stagingSize = 16 << 20}};
+    std::mt19937 rng{20240229};
+
+    for (bool disableSubgroups : {false, true})
+    {
+      etna::GpuPrimitives primitives{{
+        .maxElements = MAX_ELEMENTS,
+        .disableSubgroups = disableSubgroups,
+      }};
+      if (!disableSubgroups && !primitives.usesSubgroups())
+      {
+        spdlog::warn("The device has no subgroup arithmetic, only shared memory is tested");
+        continue;
+      }
+      spdlog::info("Testing the {} version", disableSubgroups ? "shared memory" : "subgroup");
+
+      Fixture fixture{*cmdMgr, transfer, primitives, rng};
+      for (std::uint32_t count : SIZES)
+      {
+        test_scans(fixture, count);
+        test_reductions(fixture, count);
+        test_compaction(fixture, count);
+        test_sort(fixture, count);
+      }
+    }
+  }
+
+  etna::shutdown();
+
+  if (gFailures != 0)
+  {
+    spdlog::error("{} checks failed", gFailures);
+    return EXIT_FAILURE;
+  }
+  spdlog::info("All checks passed");
+  return EXIT_SUCCESS;
+}
@@ -1,7 +1,9 @@
 cmake_minimum_required(VERSION 3.25)
 
 
-find_package(Vulkan 1.3.275 REQUIRED)
+# glslc compiles the shaders that etna's GPU utilities are built on,
+# without it etna is built without those utilities' shaders
+find_package(Vulkan 1.3.275 REQUIRED OPTIONAL_COMPONENTS glslc)
 
 # GPU-side allocator for Vulkan by AMD
 CPMAddPackage(